@@ -0,0 +1,304 @@
+#include "pch.h"
+#include "analytics.h"
+
+/*! \file analytics.cpp
+	\brief In situ flock statistics computed on the live boids during the run.
+*/
+
+/**
+ * \brief  Sets up sampling. The master opens the time series and separation trace files and writes their headers.
+ * \param  name | File name prefix, files are <name>-analytics.txt and <name>-trace.txt
+ * \param  interval | Sample every interval steps, 0 disables sampling
+ * \param  rank | MPI node rank
+ */
+template <int Dim>
+FlockAnalytics<Dim>::FlockAnalytics(const string &name, int interval, int rank)
+{
+	interval_ = interval;
+	rank_ = rank;
+
+	if (interval_ <= 0 || rank_ != MASTER)
+	{
+		return;
+	}
+
+	series_file_.open(name + "-analytics.txt");
+	series_file_ << "Boid Simulation Analytics:" << endl;
+	series_file_ << "Number of Boids: " << BOID_NUMBER << endl;
+	series_file_ << "Sample Interval: " << interval_ << endl;
+	series_file_ << "step polarisation mean_nearest_distance clusters";
+	for (int bin = 0; bin < ANALYTICS_BINS; bin++)
+	{
+		series_file_ << " neighbours_" << bin << (bin == ANALYTICS_BINS - 1 ? "+" : "");
+	}
+	series_file_ << endl;
+
+	trace_file_.open(name + "-trace.txt");
+	trace_file_ << "Boid Simulation Separation Trace:" << endl;
+	trace_file_ << "Traced Boid: " << min(ANALYTICS_TRACE_BOID, BOID_NUMBER - 1) << endl;
+	trace_file_ << "Sample Interval: " << interval_ << endl;
+	trace_file_ << "step followed by the periodic distance to every other boid in index order" << endl;
+}
+
+/**
+ * \brief  Measures the flock if this is a sample step. Must be called by every rank on every step, after the
+ *		   neighbour search is up to date with the boid positions, since the sums are reduced across ranks.
+ *		   Each rank measures polarisation, nearest neighbour distance and neighbour counts over its own boids.
+ *		   The master also visits every other boid to label clusters, holding a full replicated copy of the flock.
+ * \param  step | Simulation step just completed
+ * \param  boids | Full boid vector
+ * \param  search | Neighbour search backend over the boids
+ * \param  sight_range | Range within which two boids count as neighbours
+ * \param  start | First boid this rank updates
+ * \param  end | One past the last boid this rank updates
+ */
+template <int Dim>
+void FlockAnalytics<Dim>::Sample(int step, vector<Boid>& boids, NeighbourSearchT<Dim>& search, float sight_range, int start, int end)
+{
+	if (interval_ <= 0 || step % interval_ != 0)
+	{
+		return;
+	}
+
+	double start_time = MPI_Wtime();
+	int boid_number = boids.size();
+	float sight_range_sq = sight_range * sight_range;
+	bool label_clusters = rank_ == MASTER;
+	int first = label_clusters ? 0 : start;
+	int last = label_clusters ? boid_number : end;
+
+	if (label_clusters)
+	{
+		if (cluster_parent_.size() != boid_number)
+		{
+			vector<atomic<int>>(boid_number).swap(cluster_parent_);
+		}
+		for (int boid = 0; boid < boid_number; boid++)
+		{
+			cluster_parent_[boid].store(boid, memory_order_relaxed);
+		}
+	}
+
+	double heading_sum[Dim] = {}, nearest_sum = 0, nearest_count = 0, histogram[ANALYTICS_BINS] = {};
+
+	//Each thread sums into its own copies, merged once its share of the loop is done
+	#pragma omp parallel
+	{
+		double thread_heading[Dim] = {}, thread_nearest_sum = 0, thread_nearest_count = 0, thread_histogram[ANALYTICS_BINS] = {};
+
+		#pragma omp for schedule(SCHEDULE) nowait
+		for (int boid = first; boid < last; boid++)
+		{
+			Boid &self = boids[boid];
+			typename Boid::VectorD position = self.GetPosition();
+			float nearest_sq = sight_range_sq;
+			int neighbours = 0;
+
+			search.UpdateNearCells(self);
+
+			for (auto &cell : self.neighbouring_cells_buffer_)
+			{
+				if (cell.distance_squared >= sight_range_sq)
+				{
+					continue;
+				}
+
+				for (Boid* const* other = cell.begin; other != cell.end; other++)
+				{
+					float distance_squared = ((*other)->GetPosition() - position).squaredNorm();
+
+					if (*other == &self || distance_squared >= sight_range_sq)
+					{
+						continue;
+					}
+
+					neighbours++;
+					nearest_sq = min(nearest_sq, distance_squared);
+
+					int other_index = *other - &boids[0];
+					if (label_clusters && boid < other_index)
+					{
+						JoinClusters(boid, other_index);
+					}
+				}
+			}
+
+			if (boid < start || boid >= end)
+			{
+				continue; //visited only to label clusters, measured by the rank that owns it
+			}
+
+			typename Boid::VectorD velocity = self.GetVelocity();
+			if (velocity.squaredNorm() > 0)
+			{
+				velocity.normalize();
+				for (int i = 0; i < Dim; i++)
+				{
+					thread_heading[i] += velocity[i];
+				}
+			}
+
+			thread_histogram[min(neighbours, ANALYTICS_BINS - 1)]++;
+
+			if (neighbours > 0)
+			{
+				thread_nearest_sum += sqrt(nearest_sq);
+				thread_nearest_count++;
+			}
+		}
+
+		#pragma omp critical
+		{
+			for (int i = 0; i < Dim; i++)
+			{
+				heading_sum[i] += thread_heading[i];
+			}
+			for (int bin = 0; bin < ANALYTICS_BINS; bin++)
+			{
+				histogram[bin] += thread_histogram[bin];
+			}
+			nearest_sum += thread_nearest_sum;
+			nearest_count += thread_nearest_count;
+		}
+	}
+
+	//heading sum, nearest distance sum, boids with a neighbour, neighbour count histogram
+	vector<double> local_stats(heading_sum, heading_sum + Dim);
+	local_stats.push_back(nearest_sum);
+	local_stats.push_back(nearest_count);
+	local_stats.insert(local_stats.end(), histogram, histogram + ANALYTICS_BINS);
+
+	vector<double> stats(local_stats.size());
+	MPI_Reduce(local_stats.data(), stats.data(), local_stats.size(), MPI_DOUBLE, MPI_SUM, MASTER, compute_comm);
+
+	if (label_clusters)
+	{
+		int clusters = 0;
+
+		#pragma omp parallel for schedule(static) reduction(+:clusters)
+		for (int boid = 0; boid < boid_number; boid++)
+		{
+			clusters += cluster_parent_[boid].load(memory_order_relaxed) == boid;
+		}
+
+		double polarisation = Map<Matrix<double, Dim, 1>>(stats.data()).norm() / boid_number;
+		double mean_nearest = stats[Dim + 1] > 0 ? stats[Dim] / stats[Dim + 1] : 0;
+
+		series_file_ << step << " " << polarisation << " " << mean_nearest << " " << clusters;
+		for (int bin = 0; bin < ANALYTICS_BINS; bin++)
+		{
+			series_file_ << " " << int(stats[Dim + 2 + bin]);
+		}
+		series_file_ << "\n";
+
+		WriteTrace(step, boids);
+	}
+
+	time_taken_ += MPI_Wtime() - start_time;
+}
+
+/**
+ * \brief  Wall time spent sampling, so it can be reported apart from the simulation itself.
+ * \return  | Seconds
+ */
+template <int Dim>
+double FlockAnalytics<Dim>::GetTimeTaken() const
+{
+	return time_taken_;
+}
+
+/**
+ * \brief  Finds the root of a boids cluster, halving the path on the way so later finds are shorter.
+ *		   Safe to call concurrently with JoinClusters since a non root only ever moves closer to its root.
+ * \param  boid | Boid index
+ * \return  | Index of the clusters root boid
+ */
+template <int Dim>
+int FlockAnalytics<Dim>::FindCluster(int boid)
+{
+	while (true)
+	{
+		int parent = cluster_parent_[boid].load(memory_order_relaxed);
+		if (parent == boid)
+		{
+			return boid;
+		}
+
+		int grandparent = cluster_parent_[parent].load(memory_order_relaxed);
+		if (grandparent != parent)
+		{
+			cluster_parent_[boid].compare_exchange_weak(parent, grandparent, memory_order_relaxed);
+		}
+		boid = grandparent;
+	}
+}
+
+/**
+ * \brief  Merges the clusters of two neighbouring boids. Lock free: the larger root is linked under the smaller
+ *		   with a compare and swap that only succeeds while it is still a root, retrying if another thread got there first.
+ * \param  a | Index of one boid
+ * \param  b | Index of the other boid
+ */
+template <int Dim>
+void FlockAnalytics<Dim>::JoinClusters(int a, int b)
+{
+	while (true)
+	{
+		a = FindCluster(a);
+		b = FindCluster(b);
+
+		if (a == b)
+		{
+			return;
+		}
+		if (a < b)
+		{
+			swap(a, b);
+		}
+
+		int expected = a;
+		if (cluster_parent_[a].compare_exchange_strong(expected, b))
+		{
+			return;
+		}
+	}
+}
+
+/**
+ * \brief  Writes the periodic distance from the traced boid to every other boid, the data correlation.py used to
+ *		   extract from a full trajectory.
+ * \param  step | Simulation step just completed
+ * \param  boids | Full boid vector
+ */
+template <int Dim>
+void FlockAnalytics<Dim>::WriteTrace(int step, vector<Boid>& boids)
+{
+	int boid_number = boids.size();
+	int traced = min(ANALYTICS_TRACE_BOID, boid_number - 1);
+	typename Boid::VectorD traced_position = boids[traced].GetPosition();
+	vector<float> distances(boid_number);
+
+	#pragma omp parallel for schedule(static)
+	for (int boid = 0; boid < boid_number; boid++)
+	{
+		typename Boid::VectorD difference = (boids[boid].GetPosition() - traced_position).cwiseAbs();
+		for (int i = 0; i < Dim; i++)
+		{
+			difference[i] = min(difference[i], LENGTH - difference[i]);
+		}
+		distances[boid] = difference.norm();
+	}
+
+	trace_file_ << step;
+	for (int boid = 0; boid < boid_number; boid++)
+	{
+		if (boid != traced)
+		{
+			trace_file_ << " " << distances[boid];
+		}
+	}
+	trace_file_ << "\n";
+}
+
+template class FlockAnalytics<2>;
+template class FlockAnalytics<3>;
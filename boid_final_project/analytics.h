@@ -0,0 +1,44 @@
+#pragma once
+#include "pch.h"
+#include "preprocessor.h"
+#include "boid.h"
+#include "neighbour_search.h"
+#include "communication.h"
+#include "Eigen/Dense"
+#include "omp.h"
+#include <mpi.h>
+#include <atomic>
+#include <fstream>
+#include <string>
+#include <vector>
+
+/**
+ * \brief  In situ flock statistics sampled every few steps from the live boids, so trajectories need not be stored for analysis.
+ *		   Each rank measures the boids it updates through the neighbour search backend and the sums are reduced to the master,
+ *		   which labels clusters over the whole replicated flock and writes the time series and separation trace files.
+ */
+template <int Dim>
+class FlockAnalytics
+{
+public:
+	typedef BoidT<Dim> Boid;
+
+	FlockAnalytics(const string &name, int interval, int rank);
+	~FlockAnalytics() = default;
+
+	void Sample(int step, vector<Boid> &boids, NeighbourSearchT<Dim> &search, float sight_range, int start, int end);
+	double GetTimeTaken() const;
+
+private:
+
+	int interval_;
+	int rank_;
+	double time_taken_ = 0; //Wall time spent sampling
+	ofstream series_file_;
+	ofstream trace_file_;
+	vector<atomic<int>> cluster_parent_; //union-find forest over boid indexes for cluster labelling, master only
+
+	int FindCluster(int boid);
+	void JoinClusters(int a, int b);
+	void WriteTrace(int step, vector<Boid> &boids);
+};
@@ -1,5 +1,9 @@
 #include "pch.h"
 #include "boid.h"
+#include "obstacle_field.h"
+#include "species.h"
+#include "phase_profiler.h"
+#include <cstring>
 
 /*! \file boid.cpp
 	\brief Implementation of the boid class
@@ -8,70 +12,370 @@
 /**
  * \brief  Constructor: Initializes internal variables and allocates required memory for cell and nearby boid buffers. 
  */
-Boid::Boid()
+template <int Dim>
+BoidT<Dim>::BoidT()
 {
-	position_ = Vector3f::Zero();
-	velocity_ = Vector3f::Zero();
-	acceleration_ = Vector3f::Zero();
-	grid_coord_.resize(SYS_DIM);
-	neighbouring_cells_buffer_.resize(27);
-	nearby_boid_buffer_.resize(BOID_NUMBER / BUFFER_FRACTION); // Over allocates to save time associated with dynamic allocation. 
+	position_ = VectorD::Zero();
+	velocity_ = VectorD::Zero();
+	acceleration_ = VectorD::Zero();
+	grid_coord_.resize(Dim);
+	neighbouring_cells_buffer_.reserve(STENCIL_SIZE);
+	nearby_boid_buffer_.resize(max(min(BOID_NUMBER / BUFFER_FRACTION, NEIGHBOUR_BUFFER_MAX), TOPOLOGICAL_NEIGHBOURS)); // Over allocates to save time associated with dynamic allocation, grown in GetNearbyBoids past the cap.
 }
 
 /**
  * \brief  Main update loop. Finds nearby boids in local cells, calculates steering forces and weights them by provided coefficients.
  *		   Then updates kinematic variables. Boundary conditions are imposed and variables reset for next update loop.
+ * \param  parameters | Behaviour weights, sight range and interaction rule
  */
-void Boid::Update()
+template <int Dim>
+void BoidT<Dim>::Update(const BoidParameters &parameters)
+{
+	float sight_range_sq = parameters.sight_range * parameters.sight_range;
+	newton_steps_ = NewtonSteps(parameters.accuracy);
+	max_speed_ = parameters.max_speed;
+	max_force_ = parameters.max_force;
+
+	if (parameters.profiler)
+	{
+		parameters.profiler->Enter(ProfilePhase::Gather);
+	}
+
+	if (parameters.interaction == InteractionRule::Topological)
+	{
+		GetNearestBoids(sight_range_sq);
+	}
+	else
+	{
+		GetNearbyBoids(sight_range_sq);
+	}
+
+	if (parameters.profiler)
+	{
+		parameters.profiler->Enter(ProfilePhase::Steering);
+	}
+
+	acceleration_ = parameters.cohesion_factor * Cohesion(nearby_boid_buffer_) + parameters.separation_factor * Separation(nearby_boid_buffer_) + parameters.alignment_factor * Alignment(nearby_boid_buffer_);
+
+	if (parameters.obstacles)
+	{
+		acceleration_ += parameters.avoidance_factor * AvoidObstacles(*parameters.obstacles);
+	}
+
+	if (!parameters.synchronous)
+	{
+		Integrate();
+	}
+}
+
+/**
+ * \brief  Update loop for the cell tiled kernel. Accumulates the three steering sums in a single SIMD pass over
+ *		   a gathered tile instead of the nearby boid buffer, then steers and integrates exactly as Update.
+ *		   Only the metric interaction rule applies. Multi-species runs take UpdateFromSpeciesTile instead.
+ * \param  tile | Neighbourhood of the boids cell, may include the boid itself
+ * \param  parameters | Behaviour weights, sight range and sqrt accuracy
+ */
+template <int Dim>
+void BoidT<Dim>::UpdateFromTile(const NeighbourTile & tile, const BoidParameters & parameters)
+{
+	if (parameters.species)
+	{
+		UpdateFromSpeciesTile(tile, parameters);
+		return;
+	}
+
+	float sight_range_sq = parameters.sight_range * parameters.sight_range;
+	float vel_sum[Dim] = {}, pos_sum[Dim] = {}, sep_sum[Dim] = {};
+
+	newton_steps_ = NewtonSteps(parameters.accuracy);
+	max_speed_ = parameters.max_speed;
+	max_force_ = parameters.max_force;
+
+	int num_boids = AccumulateTile(tile, 0, tile.size, sight_range_sq, vel_sum, pos_sum, sep_sum);
+
+	acceleration_ = VectorD::Zero();
+
+	if (num_boids > 0)
+	{
+		VectorD average_vel = Map<VectorD>(vel_sum) / num_boids;
+		VectorD average_pos = Map<VectorD>(sep_sum) / num_boids;
+		VectorD centre_mass = Map<VectorD>(pos_sum) / num_boids;
+		if (tile.fixed_point)
+		{
+			centre_mass += position_; //fixed point tiles sum offsets to the nearest images, back to a position next to this boid
+		}
+		acceleration_ = parameters.cohesion_factor * SteerCohesion(average_vel) + parameters.separation_factor * SteerSeparation(average_pos) + parameters.alignment_factor * SteerAlignment(centre_mass);
+	}
+
+	if (parameters.obstacles)
+	{
+		acceleration_ += parameters.avoidance_factor * AvoidObstacles(*parameters.obstacles);
+	}
+
+	if (!parameters.synchronous)
+	{
+		Integrate();
+	}
+}
+
+/**
+ * \brief  Update loop for a multi-species tile, whose neighbourhood is sorted into one contiguous run per species.
+ *		   Each species pair gets its own SIMD pass over the target species run, with the observers sight range,
+ *		   and its own steering weights from the response table, so no boid is ever tested for its species in the loop.
+ *		   Speed and force limits are the observer species own.
+ * \param  tile | Neighbourhood of the boids cell sorted by species, may include the boid itself
+ * \param  parameters | Run parameters holding the species table, sqrt accuracy and obstacles
+ */
+template <int Dim>
+void BoidT<Dim>::UpdateFromSpeciesTile(const NeighbourTile & tile, const BoidParameters & parameters)
+{
+	const SpeciesTable &species = *parameters.species;
+	const BoidParameters &own = species.parameters[species_];
+	float sight_range_sq = own.sight_range * own.sight_range;
+
+	newton_steps_ = NewtonSteps(parameters.accuracy);
+	max_speed_ = own.max_speed;
+	max_force_ = own.max_force;
+	acceleration_ = VectorD::Zero();
+
+	for (int target = 0; target < species.Count(); target++)
+	{
+		const Vector3f &weights = species.Response(species_, target);
+		if (weights.isZero())
+		{
+			continue;
+		}
+
+		float vel_sum[Dim] = {}, pos_sum[Dim] = {}, sep_sum[Dim] = {};
+		int num_boids = AccumulateTile(tile, tile.species_offset[target], tile.species_offset[target + 1], sight_range_sq, vel_sum, pos_sum, sep_sum);
+
+		if (num_boids > 0)
+		{
+			VectorD average_vel = Map<VectorD>(vel_sum) / num_boids;
+			VectorD average_pos = Map<VectorD>(sep_sum) / num_boids;
+			VectorD centre_mass = Map<VectorD>(pos_sum) / num_boids;
+			if (tile.fixed_point)
+			{
+				centre_mass += position_;
+			}
+			acceleration_ += weights[0] * SteerCohesion(average_vel) + weights[2] * SteerSeparation(average_pos) + weights[1] * SteerAlignment(centre_mass);
+		}
+	}
+
+	if (parameters.obstacles)
+	{
+		acceleration_ += parameters.avoidance_factor * AvoidObstacles(*parameters.obstacles);
+	}
+
+	if (!parameters.synchronous)
+	{
+		Integrate();
+	}
+}
+
+/**
+ * \brief  Runs the SIMD pass instantiated for the current sqrt accuracy and tile kind.
+ *		   Newton count and fixed point are template arguments so each combination gets its own vectorised loop.
+ * \param  tile | Neighbourhood of the boids cell
+ * \param  begin | First tile entry to visit
+ * \param  end | One past the last tile entry to visit
+ * \param  sight_range_sq | Squared cutoff range
+ * \param  vel_sum | Output, summed neighbour velocities
+ * \param  pos_sum | Output, summed neighbour positions, or offsets to their nearest images in a fixed point tile
+ * \param  sep_sum | Output, summed (position - neighbour position) / distance
+ * \return  | Number of neighbours in range
+ */
+template <int Dim>
+int BoidT<Dim>::AccumulateTile(const NeighbourTile & tile, int begin, int end, float sight_range_sq, float * vel_sum, float * pos_sum, float * sep_sum)
+{
+	switch (newton_steps_)
+	{
+	case 0:
+		return tile.fixed_point ? AccumulateTile<0, true>(tile, begin, end, sight_range_sq, vel_sum, pos_sum, sep_sum)
+			: AccumulateTile<0, false>(tile, begin, end, sight_range_sq, vel_sum, pos_sum, sep_sum);
+	case 1:
+		return tile.fixed_point ? AccumulateTile<1, true>(tile, begin, end, sight_range_sq, vel_sum, pos_sum, sep_sum)
+			: AccumulateTile<1, false>(tile, begin, end, sight_range_sq, vel_sum, pos_sum, sep_sum);
+	case 2:
+		return tile.fixed_point ? AccumulateTile<2, true>(tile, begin, end, sight_range_sq, vel_sum, pos_sum, sep_sum)
+			: AccumulateTile<2, false>(tile, begin, end, sight_range_sq, vel_sum, pos_sum, sep_sum);
+	default:
+		return tile.fixed_point ? AccumulateTile<-1, true>(tile, begin, end, sight_range_sq, vel_sum, pos_sum, sep_sum)
+			: AccumulateTile<-1, false>(tile, begin, end, sight_range_sq, vel_sum, pos_sum, sep_sum);
+	}
+}
+
+/**
+ * \brief  SIMD pass of the tiled kernel, summing neighbour velocities, positions and distance weighted offsets.
+ * \param  tile | Neighbourhood of the boids cell
+ * \param  begin | First tile entry to visit
+ * \param  end | One past the last tile entry to visit
+ * \param  sight_range_sq | Squared cutoff range
+ * \param  vel_sum | Output, summed neighbour velocities
+ * \param  pos_sum | Output, summed neighbour positions, or offsets to their nearest images in a fixed point tile
+ * \param  sep_sum | Output, summed (position - neighbour position) / distance
+ * \return  | Number of neighbours in range
+ */
+template <int Dim>
+template <int NewtonSteps, bool FixedPoint>
+int BoidT<Dim>::AccumulateTile(const NeighbourTile & tile, int begin, int end, float sight_range_sq, float * vel_sum, float * pos_sum, float * sep_sum)
+{
+	//Scalar accumulators per axis rather than array reductions, which compilers do not vectorise.
+	//The z axis folds away at compile time in 2D.
+	const bool has_z = Dim > 2;
+	float px = position_[0], py = position_[1], pz = has_z ? position_[Dim - 1] : 0;
+	uint32_t qx = fixed_position_[0], qy = fixed_position_[1], qz = fixed_position_[Dim - 1];
+	float vel_x = 0, vel_y = 0, vel_z = 0;
+	float pos_x = 0, pos_y = 0, pos_z = 0;
+	float sep_x = 0, sep_y = 0, sep_z = 0;
+	int num_boids = 0;
+
+	const float *x = tile.position[0].data(), *y = tile.position[1].data(), *z = tile.position[Dim - 1].data();
+	const float *vx = tile.velocity[0].data(), *vy = tile.velocity[1].data(), *vz = tile.velocity[Dim - 1].data();
+	const uint32_t *fx = tile.fixed_position[0].data(), *fy = tile.fixed_position[1].data(), *fz = tile.fixed_position[Dim - 1].data();
+
+	#pragma omp simd reduction(+:vel_x,vel_y,vel_z,pos_x,pos_y,pos_z,sep_x,sep_y,sep_z,num_boids)
+	for (int j = begin; j < end; j++)
+	{
+		//Fixed point offsets come from the integer difference, the minimum image, exactly as the nearby boid buffer measures them
+		float dx = FixedPoint ? int32_t(fx[j] - qx) * FIXED_TO_LENGTH : x[j] - px;
+		float dy = FixedPoint ? int32_t(fy[j] - qy) * FIXED_TO_LENGTH : y[j] - py;
+		float dz = !has_z ? 0 : FixedPoint ? int32_t(fz[j] - qz) * FIXED_TO_LENGTH : z[j] - pz;
+		float distance_squared = dx * dx + dy * dy + dz * dz;
+
+		//Out of range boids are masked by zero weights rather than skipped so every load is unconditional
+		bool in_range = distance_squared != 0 && distance_squared < sight_range_sq;
+		float weight = in_range ? 1.0f : 0.0f;
+		float inverse_distance = in_range ? InverseSqrt<NewtonSteps>(distance_squared) : 0.0f;
+
+		vel_x += weight * vx[j]; vel_y += weight * vy[j]; vel_z += has_z ? weight * vz[j] : 0;
+		pos_x += weight * (FixedPoint ? dx : x[j]); pos_y += weight * (FixedPoint ? dy : y[j]); pos_z += has_z ? weight * (FixedPoint ? dz : z[j]) : 0;
+		sep_x -= dx * inverse_distance; sep_y -= dy * inverse_distance; sep_z -= dz * inverse_distance;
+		num_boids += in_range;
+	}
+
+	const float vel[3] = { vel_x, vel_y, vel_z }, pos[3] = { pos_x, pos_y, pos_z }, sep[3] = { sep_x, sep_y, sep_z };
+	for (int i = 0; i < Dim; i++)
+	{
+		vel_sum[i] = vel[i];
+		pos_sum[i] = pos[i];
+		sep_sum[i] = sep[i];
+	}
+
+	return num_boids;
+}
+
+/**
+ * \brief  Applies the current acceleration, imposes boundary conditions and resets acceleration for the next update.
+ *		   Run by the update itself, or in synchronous runs by the driver once every boid has been updated.
+ *		   Fixed point boids add the step in integer units, so leaving the box wraps round it by overflow, keeping the overshoot, without a branch.
+ */
+template <int Dim>
+void BoidT<Dim>::Integrate()
 {
-    GetNearbyBoids();
-	acceleration_ = COHESION_FACTOR * Cohesion(nearby_boid_buffer_) + SEPARATION_FACTOR * Separation(nearby_boid_buffer_) + ALIGNMENT_FACTOR * Alignment(nearby_boid_buffer_);
 	velocity_ += acceleration_;
-	position_ += velocity_;
-	UpdateEdges();
-	acceleration_ = Vector3f::Zero();
+
+	if (fixed_point_)
+	{
+		for (int i = 0; i < Dim; i++)
+		{
+			fixed_position_[i] += uint32_t(int32_t(lrintf(velocity_[i] * LENGTH_TO_FIXED)));
+		}
+		DecodePosition();
+	}
+	else
+	{
+		position_ += velocity_;
+		UpdateEdges();
+	}
+
+	acceleration_ = VectorD::Zero();
 }
 
 /**
- * \brief  Sets the boids position and velocity to a random value according to provided distributions. 
- * \param  random_engine | Random number generator
- * \param  vel_distr | Probability distribution of the velocity values
- * \param  pos_distr | Probability distribution of the position values
+ * \brief  Sets the boids position and velocity, used to set up initial conditions.
+ * \param  position | Position
+ * \param  velocity | Velocity
  */
-void Boid::SetRanValues(default_random_engine & random_engine, uniform_real_distribution<float>& vel_distr, uniform_real_distribution<float>& pos_distr)
+template <int Dim>
+void BoidT<Dim>::SetState(const VectorD &position, const VectorD &velocity)
 {
-	for (int i = 0; i < SYS_DIM; i++)
+	position_ = position;
+	velocity_ = velocity;
+
+	if (fixed_point_)
 	{
-		velocity_[i] = vel_distr(random_engine);
-		position_[i] = pos_distr(random_engine);
+		SetFixedPoint();
 	}
 }
 
 /**
- * \brief  Serializes boid object into 6 floats in the provided vector at specified location.
+ * \brief  Serializes boid object into 2*Dim floats (position then velocity) in the provided vector at specified location.
  * \param  memory | Float vector where the values should be stored
  * \param  start_location | Index of the vector where the values should be stored from
  */
-void Boid::Serialize(vector<float>& memory, int start_location)
+template <int Dim>
+void BoidT<Dim>::Serialize(vector<float>& memory, size_t start_location)
 {
-	for (int i = 0; i < SYS_DIM; i++)
-	{
-		memory[start_location + i] = position_[i];
-		memory[start_location + SYS_DIM + i] = velocity_[i];
-	}
+	Serialize(&memory[start_location]);
 }
 
 /**
- * \brief  Deserializes boid object from  6 floats in vector.
+ * \brief  Deserializes boid object from 2*Dim floats in vector.
  * \param  memory | Float vector to get values from
  * \param  start_location | Start index off the vector where values located
  */
-void Boid::DeSerialize(vector<float>& memory, int start_location)
+template <int Dim>
+void BoidT<Dim>::DeSerialize(vector<float>& memory, size_t start_location)
 {
-	for (int i = 0; i < SYS_DIM; i++)
+	DeSerialize(&memory[start_location]);
+}
+
+/**
+ * \brief  Serializes boid object into 2*Dim floats (position then velocity) at raw memory, such as a shared window.
+ *		   Fixed point boids store the bits of their fixed point position in the position floats, so every copy holds the exact state.
+ * \param  memory | Where the values should be stored
+ */
+template <int Dim>
+void BoidT<Dim>::Serialize(float *memory) const
+{
+	for (int i = 0; i < Dim; i++)
+	{
+		if (fixed_point_)
+		{
+			memcpy(&memory[i], &fixed_position_[i], sizeof(float));
+		}
+		else
+		{
+			memory[i] = position_[i];
+		}
+		memory[Dim + i] = velocity_[i];
+	}
+}
+
+/**
+ * \brief  Deserializes boid object from 2*Dim floats at raw memory, written by a boid with the same coordinates.
+ * \param  memory | Where the values are stored
+ */
+template <int Dim>
+void BoidT<Dim>::DeSerialize(const float *memory)
+{
+	for (int i = 0; i < Dim; i++)
+	{
+		if (fixed_point_)
+		{
+			memcpy(&fixed_position_[i], &memory[i], sizeof(float));
+		}
+		else
+		{
+			position_[i] = memory[i];
+		}
+		velocity_[i] = memory[Dim + i];
+	}
+
+	if (fixed_point_)
 	{
-		position_[i] = memory[start_location + i];
-		velocity_[i] = memory[start_location + SYS_DIM + i];
+		DecodePosition();
 	}
 }
 
@@ -79,7 +383,8 @@ void Boid::DeSerialize(vector<float>& memory, int start_location)
   * \brief   Position vector getter
   * \return  | Position vector
   */
- Vector3f Boid::GetPosition() const
+ template <int Dim>
+typename BoidT<Dim>::VectorD BoidT<Dim>::GetPosition() const
  {
 	return position_;
 }
@@ -88,25 +393,139 @@ void Boid::DeSerialize(vector<float>& memory, int start_location)
   * \brief   Velocity vector getter 
   * \return  | Velocity vector
   */
- Vector3f Boid::GetVelocity() const
+ template <int Dim>
+typename BoidT<Dim>::VectorD BoidT<Dim>::GetVelocity() const
  {
 	return velocity_;
 }
 
+/**
+ * \brief   Address of the position, for views that stride over a boid vector without copying.
+ * \return  | Pointer to Dim floats
+ */
+template <int Dim>
+const float* BoidT<Dim>::GetPositionData() const
+{
+	return position_.data();
+}
+
+/**
+ * \brief   Address of the velocity, for views that stride over a boid vector without copying.
+ * \return  | Pointer to Dim floats
+ */
+template <int Dim>
+const float* BoidT<Dim>::GetVelocityData() const
+{
+	return velocity_.data();
+}
+
 /**
  * \brief   Neighbouring cells getter
  * \return  | Neighbouring cells buffer
  */
-vector<list<Boid*>*> Boid::GetNeighbourBuffer() const
+template <int Dim>
+vector<CellSpanT<Dim>> BoidT<Dim>::GetNeighbourBuffer() const
 {
 	return neighbouring_cells_buffer_;
 }
 
+/**
+ * \brief   Boids in the cells handed over by the neighbour search, the candidates the last update scanned.
+ * \return  | Candidate count
+ */
+template <int Dim>
+int BoidT<Dim>::GetCandidateCount() const
+{
+	int count = 0;
+	for (const CellSpan &span : neighbouring_cells_buffer_)
+	{
+		count += span.end - span.begin;
+	}
+	return count;
+}
+
+/**
+ * \brief   Species getter
+ * \return  | Index of the boids species in the species table, 0 in a single species run
+ */
+template <int Dim>
+int BoidT<Dim>::GetSpecies() const
+{
+	return species_;
+}
+
+/**
+ * \brief  Species setter
+ * \param  species | Index of the boids species in the species table
+ */
+template <int Dim>
+void BoidT<Dim>::SetSpecies(int species)
+{
+	species_ = species;
+}
+
+/**
+ * \brief  Switches the boid to fixed point coordinates, rounding its position to the nearest unit. Positions set
+ *		   or received afterwards are fixed point too, so every boid of a flock must be switched before any exchange.
+ */
+template <int Dim>
+void BoidT<Dim>::SetFixedPoint()
+{
+	fixed_point_ = true;
+
+	for (int i = 0; i < Dim; i++)
+	{
+		fixed_position_[i] = uint32_t(llrint(double(position_[i]) * (FIXED_RANGE / LENGTH)));
+	}
+
+	DecodePosition();
+}
+
+/**
+ * \brief   Whether the boid keeps its position in fixed point
+ * \return  | True after SetFixedPoint
+ */
+template <int Dim>
+bool BoidT<Dim>::IsFixedPoint() const
+{
+	return fixed_point_;
+}
+
+/**
+ * \brief   Fixed point position getter, meaningful after SetFixedPoint
+ * \return  | Pointer to Dim coordinates in units of LENGTH / 2^32
+ */
+template <int Dim>
+const uint32_t* BoidT<Dim>::GetFixedPosition() const
+{
+	return fixed_position_;
+}
+
+/**
+ * \brief   Minimum image vector from a fixed point position to this boid. The unsigned difference wraps round the box and
+ *			 reading it as signed picks the nearer image, so the periodic boundary costs nothing.
+ * \param   origin | Dim fixed point coordinates to measure from
+ * \return  | Offset from origin to the boid, each component within half the box
+ */
+template <int Dim>
+typename BoidT<Dim>::VectorD BoidT<Dim>::GetImageOffset(const uint32_t *origin) const
+{
+	VectorD offset;
+
+	for (int i = 0; i < Dim; i++)
+	{
+		offset[i] = int32_t(fixed_position_[i] - origin[i]) * FIXED_TO_LENGTH;
+	}
+
+	return offset;
+}
+
 /**
  * \brief   Grid cell co-ordinates getter 
  * \return  | Grid cell co-ordinates
  */
-vector<int> Boid::GetGridCoord() const
+template <int Dim>
+vector<int> BoidT<Dim>::GetGridCoord() const
 {
 	return grid_coord_;
 }
@@ -115,7 +534,8 @@ vector<int> Boid::GetGridCoord() const
  * \brief  Grid cell co-ordinates setter 
  * \param  grid_coord | Grid cell co-ordinates to set
  */
-void Boid::SetGridCoord(vector<int>& grid_coord)
+template <int Dim>
+void BoidT<Dim>::SetGridCoord(vector<int>& grid_coord)
 {
 	grid_coord_ = grid_coord;
 }
@@ -123,9 +543,10 @@ void Boid::SetGridCoord(vector<int>& grid_coord)
 /**
  * \brief  Checks if boid position is out of bounds of simulation space and if so implements boundary conditions.
  */
-void Boid::UpdateEdges()
+template <int Dim>
+void BoidT<Dim>::UpdateEdges()
 {
-	for (int i = 0; i < SYS_DIM; i++)
+	for (int i = 0; i < Dim; i++)
 	{
 		if (position_[i] > LENGTH)
 		{
@@ -139,25 +560,46 @@ void Boid::UpdateEdges()
 }
 
 /**
- * \brief  Iterates over the cells provided by the grid and finds which boids are within range.
+ * \brief  Refreshes the float position read by the search structures, analytics and output from the fixed point position.
+ */
+template <int Dim>
+void BoidT<Dim>::DecodePosition()
+{
+	for (int i = 0; i < Dim; i++)
+	{
+		position_[i] = float(fixed_position_[i]) * FIXED_TO_LENGTH;
+	}
+}
+
+/**
+ * \brief  Iterates over the cells provided by the neighbour search and finds which boids are within range.
  *		   Then stores them in the buffer for use in steering calculations.
+ *		   Buffer grows if a sight range larger than BUFFER_FRACTION was sized for overfills it.
+ * \param  sight_range_sq | Squared cutoff range
  */
-void Boid::GetNearbyBoids()
+template <int Dim>
+void BoidT<Dim>::GetNearbyBoids(float sight_range_sq)
 {
 	int i = 0;
 
 	for (auto &cell : neighbouring_cells_buffer_)
 	{
-		for (auto& boid : *cell)
+		for (BoidT* const* boid = cell.begin; boid != cell.end; boid++)
 		{
-		    float distance_squared = (boid->GetPosition() -position_).squaredNorm();
+		    float distance_squared = fixed_point_ ? (*boid)->GetImageOffset(fixed_position_).squaredNorm() : ((*boid)->GetPosition() -position_).squaredNorm();
 			
-			if (distance_squared != 0 && distance_squared < SIGHT_RANGE_SQ)
+			if (distance_squared != 0 && distance_squared < sight_range_sq)
 			{
 				//only calculates square root for boids that are nearby to reduce number of expensive calls to sqrt()
 				
-				get<0>(nearby_boid_buffer_[i]) = boid;
-				get<1>(nearby_boid_buffer_[i]) = sqrt(distance_squared);
+				if (i == nearby_boid_buffer_.size())
+				{
+					nearby_boid_buffer_.resize(2 * i + 1);
+				}
+
+				get<0>(nearby_boid_buffer_[i]) = *boid;
+				//The reciprocal of the estimate, so Separation divides by exactly what the tiled kernel multiplies by
+				get<1>(nearby_boid_buffer_[i]) = newton_steps_ < 0 ? sqrt(distance_squared) : 1 / InverseSqrt(distance_squared, newton_steps_);
 				i++;	
 			}
 		}
@@ -166,17 +608,81 @@ void Boid::GetNearbyBoids()
 	buffer_end_index_ = i; //So that the steering functions know where to iterate to
 }
 
+/**
+ * \brief  Finds the TOPOLOGICAL_NEIGHBOURS nearest boids within range and stores them in the buffer for use in steering calculations.
+ *		   The front of the nearby boid buffer is used as a bounded max-heap on squared distance, so cost per candidate is O(log k).
+ *		   Cells are visited nearest first and traversal stops once no remaining cell can hold a boid closer than the heap top.
+ * \param  sight_range_sq | Squared cutoff range
+ */
+template <int Dim>
+void BoidT<Dim>::GetNearestBoids(float sight_range_sq)
+{
+	auto further = [](const tuple<BoidT*, float> &a, const tuple<BoidT*, float> &b) { return get<1>(a) < get<1>(b); };
+	auto heap_begin = nearby_boid_buffer_.begin();
+	int i = 0;
+
+	sort(neighbouring_cells_buffer_.begin(), neighbouring_cells_buffer_.end(),
+		[](const CellSpan &a, const CellSpan &b) { return a.distance_squared < b.distance_squared; });
+
+	for (auto &cell : neighbouring_cells_buffer_)
+	{
+		if (cell.distance_squared >= sight_range_sq || (i == TOPOLOGICAL_NEIGHBOURS && cell.distance_squared >= get<1>(nearby_boid_buffer_[0])))
+		{
+			break;
+		}
+
+		for (BoidT* const* boid = cell.begin; boid != cell.end; boid++)
+		{
+			float distance_squared = fixed_point_ ? (*boid)->GetImageOffset(fixed_position_).squaredNorm() : ((*boid)->GetPosition() - position_).squaredNorm();
+
+			if (distance_squared == 0 || distance_squared >= sight_range_sq)
+			{
+				continue;
+			}
+
+			if (i < TOPOLOGICAL_NEIGHBOURS)
+			{
+				nearby_boid_buffer_[i] = make_tuple(*boid, distance_squared);
+				i++;
+				push_heap(heap_begin, heap_begin + i, further);
+			}
+			else if (distance_squared < get<1>(nearby_boid_buffer_[0]))
+			{
+				pop_heap(heap_begin, heap_begin + i, further);
+				nearby_boid_buffer_[i - 1] = make_tuple(*boid, distance_squared);
+				push_heap(heap_begin, heap_begin + i, further);
+			}
+		}
+	}
+
+	for (int index = 0; index < i; index++)
+	{
+		float distance_squared = get<1>(nearby_boid_buffer_[index]);
+		get<1>(nearby_boid_buffer_[index]) = newton_steps_ < 0 ? sqrt(distance_squared) : 1 / InverseSqrt(distance_squared, newton_steps_);
+	}
+
+	buffer_end_index_ = i;
+}
+
 
 
 /**
  * \brief  Takes a vector and returns a vector in the same direction but a set magnitude
+ *		   On the fast math path the sqrt and divide of normalized() become one approximate reciprocal square root.
  * \param  vector | Vector to normalise
  * \param  magnitude | Magnitude to set the vector to 
  * \return  | Normalised Vector
  */
-inline Vector3f Boid::NormaliseToMag(Vector3f & vector, float magnitude)
+template <int Dim>
+inline typename BoidT<Dim>::VectorD BoidT<Dim>::NormaliseToMag(VectorD & vector, float magnitude)
 {
-	return  vector.normalized()*magnitude;
+	if (newton_steps_ < 0)
+	{
+		return  vector.normalized()*magnitude;
+	}
+
+	float squared_norm = vector.squaredNorm();
+	return squared_norm > 0 ? VectorD(vector * (magnitude * InverseSqrt(squared_norm, newton_steps_))) : VectorD(vector * magnitude);
 }
 
 /**
@@ -185,11 +691,12 @@ inline Vector3f Boid::NormaliseToMag(Vector3f & vector, float magnitude)
  * \param  nearby_boids | Nearby boid buffer to iterate over.
  * \return  | Acceleration due to cohesion steering behaviour
  */
-Vector3f Boid::Cohesion(vector<tuple<Boid*, float>>& nearby_boids)
+template <int Dim>
+typename BoidT<Dim>::VectorD BoidT<Dim>::Cohesion(vector<tuple<BoidT*, float>>& nearby_boids)
 {
 	int num_boids = 0;
-	Vector3f average_vel = Vector3f::Zero();
-	Vector3f correction_force = Vector3f::Zero();
+	VectorD average_vel = VectorD::Zero();
+	VectorD correction_force = VectorD::Zero();
 
 	for (int index = 0 ; index < buffer_end_index_; index++)
 	{
@@ -201,30 +708,42 @@ Vector3f Boid::Cohesion(vector<tuple<Boid*, float>>& nearby_boids)
 	if (num_boids > 0)
 	{
 		average_vel /= num_boids;
-		average_vel = NormaliseToMag(average_vel, MAX_SPEED);
-		correction_force = average_vel - velocity_;
-		correction_force = NormaliseToMag(correction_force, MAX_FORCE);
-
+		correction_force = SteerCohesion(average_vel);
 	}
 
 	return correction_force;
 }
 
+/**
+ * \brief  Turns the mean neighbour velocity into the cohesion steering force.
+ * \param  average_vel | Mean velocity of the neighbours
+ * \return  | Acceleration due to cohesion steering behaviour
+ */
+template <int Dim>
+typename BoidT<Dim>::VectorD BoidT<Dim>::SteerCohesion(VectorD & average_vel)
+{
+	VectorD desired_vel = NormaliseToMag(average_vel, max_speed_);
+	VectorD correction_force = desired_vel - velocity_;
+	return NormaliseToMag(correction_force, max_force_);
+}
+
 /**
  * \brief   Calculates acceleration due to separation behaviour, boid tries to accelerate away from nearby boids.
  *			Effect weighted by how close neighbouring boid is by 1/r effect.
  * \param  nearby_boids | Nearby boid buffer to iterate over
  * \return  | Acceleration due to separation behaviour
  */
-Vector3f Boid::Separation(vector<tuple<Boid*, float>>& nearby_boids)
+template <int Dim>
+typename BoidT<Dim>::VectorD BoidT<Dim>::Separation(vector<tuple<BoidT*, float>>& nearby_boids)
 {
 	int num_boids = 0;
-	Vector3f average_pos = Vector3f::Zero();
-	Vector3f correction_force = Vector3f::Zero();
+	VectorD average_pos = VectorD::Zero();
+	VectorD correction_force = VectorD::Zero();
 
 	for (int index = 0; index < buffer_end_index_; index++)
 	{
-		Vector3f pos_difference = position_ - get<0>(nearby_boid_buffer_[index])->GetPosition();
+		BoidT *neighbour = get<0>(nearby_boid_buffer_[index]);
+		VectorD pos_difference = fixed_point_ ? VectorD(-neighbour->GetImageOffset(fixed_position_)) : VectorD(position_ - neighbour->GetPosition());
 		pos_difference /= get<1>(nearby_boid_buffer_[index]);
 		average_pos += pos_difference;
 		num_boids++;
@@ -233,23 +752,36 @@ Vector3f Boid::Separation(vector<tuple<Boid*, float>>& nearby_boids)
 	if (num_boids > 0)
 	{
 		average_pos /= num_boids;
+		correction_force = SteerSeparation(average_pos);
+	}
+	
+	return correction_force;
 
-		if (average_pos.squaredNorm() > 0)
-		{
-			average_pos = NormaliseToMag(average_pos, MAX_SPEED);
-		}
+}
 
-		correction_force = average_pos - velocity_;
+/**
+ * \brief  Turns the mean distance weighted offset from the neighbours into the separation steering force.
+ * \param  average_pos | Mean of (position - neighbour position) / distance
+ * \return  | Acceleration due to separation behaviour
+ */
+template <int Dim>
+typename BoidT<Dim>::VectorD BoidT<Dim>::SteerSeparation(VectorD & average_pos)
+{
+	VectorD desired_vel = average_pos;
 
-		if (correction_force.squaredNorm() > MAX_FORCE*MAX_FORCE)
-		{
-			correction_force = NormaliseToMag(correction_force, MAX_FORCE);
-		}
+	if (desired_vel.squaredNorm() > 0)
+	{
+		desired_vel = NormaliseToMag(desired_vel, max_speed_);
+	}
+
+	VectorD correction_force = desired_vel - velocity_;
 
+	if (correction_force.squaredNorm() > max_force_*max_force_)
+	{
+		correction_force = NormaliseToMag(correction_force, max_force_);
 	}
-	
-	return correction_force;
 
+	return correction_force;
 }
 
 /**
@@ -258,37 +790,96 @@ Vector3f Boid::Separation(vector<tuple<Boid*, float>>& nearby_boids)
  * \param  nearby_boids | Nearby boid buffer to iterate over
  * \return  | Acceleration due to alignment behaviour
  */
-Vector3f Boid::Alignment(vector<tuple<Boid*, float>>& nearby_boids)
+template <int Dim>
+typename BoidT<Dim>::VectorD BoidT<Dim>::Alignment(vector<tuple<BoidT*, float>>& nearby_boids)
 {
 	int num_boids = 0;
-	Vector3f centre_mass = Vector3f::Zero();
-	Vector3f correction_force = Vector3f::Zero();
+	VectorD centre_mass = VectorD::Zero();
+	VectorD correction_force = VectorD::Zero();
 
 
 	for (int index = 0; index < buffer_end_index_; index++)
 	{
-		centre_mass += get<0>(nearby_boid_buffer_[index])->GetPosition();
+		BoidT *neighbour = get<0>(nearby_boid_buffer_[index]);
+		centre_mass += fixed_point_ ? neighbour->GetImageOffset(fixed_position_) : neighbour->GetPosition();
 		num_boids++;
 	}
 
 	if (num_boids > 0)
 	{
 		centre_mass /= num_boids;
-		Vector3f vector_to_com = centre_mass - position_;
-		if (vector_to_com.squaredNorm() > 0)
+		if (fixed_point_)
 		{
-			vector_to_com = NormaliseToMag(vector_to_com, MAX_SPEED);
+			centre_mass += position_; //fixed point sums offsets to the nearest images, back to a position next to this boid
 		}
+		correction_force = SteerAlignment(centre_mass);
+	}
+	
+	return correction_force;
 
-		correction_force = vector_to_com - velocity_;
+}
 
-		if (correction_force.squaredNorm() > MAX_FORCE*MAX_FORCE)
-		{
-			correction_force = NormaliseToMag(correction_force, MAX_FORCE);
-		}
+/**
+ * \brief  Turns the neighbours centre of mass into the alignment steering force.
+ * \param  centre_mass | Mean position of the neighbours
+ * \return  | Acceleration due to alignment behaviour
+ */
+template <int Dim>
+typename BoidT<Dim>::VectorD BoidT<Dim>::SteerAlignment(VectorD & centre_mass)
+{
+	VectorD vector_to_com = centre_mass - position_;
 
+	if (vector_to_com.squaredNorm() > 0)
+	{
+		vector_to_com = NormaliseToMag(vector_to_com, max_speed_);
 	}
-	
+
+	VectorD correction_force = vector_to_com - velocity_;
+
+	if (correction_force.squaredNorm() > max_force_*max_force_)
+	{
+		correction_force = NormaliseToMag(correction_force, max_force_);
+	}
+
 	return correction_force;
+}
+
+/**
+ * \brief  Calculates acceleration due to obstacle avoidance from one lookup of the precomputed distance field.
+ *		   Within OBSTACLE_RANGE of a surface the boid steers towards its velocity turned away from the surface,
+ *		   growing stronger as it gets closer.
+ * \param  obstacles | Obstacle distance field
+ * \return  | Acceleration due to obstacle avoidance
+ */
+template <int Dim>
+typename BoidT<Dim>::VectorD BoidT<Dim>::AvoidObstacles(const ObstacleField & obstacles)
+{
+	VectorD gradient;
+	float distance = obstacles.Sample<Dim>(position_, gradient);
+
+	if (distance >= OBSTACLE_RANGE || gradient.squaredNorm() == 0)
+	{
+		return VectorD::Zero();
+	}
+
+	float urgency = 1 - max(distance, 0.0f) / OBSTACLE_RANGE;
+	VectorD away = NormaliseToMag(gradient, max_speed_);
+	VectorD desired_vel = velocity_ + away;
 
+	if (desired_vel.squaredNorm() > 0)
+	{
+		desired_vel = NormaliseToMag(desired_vel, max_speed_);
+	}
+
+	VectorD correction_force = desired_vel - velocity_;
+
+	if (correction_force.squaredNorm() > max_force_*max_force_)
+	{
+		correction_force = NormaliseToMag(correction_force, max_force_);
+	}
+
+	return urgency * correction_force;
 }
+
+template class BoidT<2>;
+template class BoidT<3>;
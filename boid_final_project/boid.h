@@ -1,56 +1,163 @@
 #pragma once
 #include "pch.h"
 #include "preprocessor.h"
+#include "fast_math.h"
 #include "Eigen/Dense"
 #include <vector>
 #include <list>
 #include <tuple>
 #include <random>
+#include <algorithm>
+#include <cstdint>
 
 using namespace Eigen;
 using namespace std;
 
+template <int Dim> class BoidT;
+class ObstacleField;
+struct SpeciesTable;
+class PhaseProfiler;
+
+/**
+ * \brief  Contiguous run of boid pointers handed to a boid by the neighbour search backend.
+ *		   Depending on the backend this is a grid cell, a range of a sorted cell list or a k-d tree leaf.
+ */
+template <int Dim>
+struct CellSpanT
+{
+	BoidT<Dim>* const* begin;
+	BoidT<Dim>* const* end;
+	float distance_squared; //lower bound on the squared distance from the querying boid to any boid in the span
+};
+
+/**
+ * \brief  Rule deciding which boids a boid interacts with.
+ */
+enum class InteractionRule
+{
+	Metric,		//!< Every boid within SIGHT_RANGE.
+	Topological //!< The TOPOLOGICAL_NEIGHBOURS nearest boids within SIGHT_RANGE.
+};
+
+/**
+ * \brief  Behaviour parameters of a simulation. Defaults are the compile time constants,
+ *		   ensemble runs override them per member.
+ */
+struct BoidParameters
+{
+	float cohesion_factor = COHESION_FACTOR;
+	float alignment_factor = ALIGNMENT_FACTOR;
+	float separation_factor = SEPARATION_FACTOR;
+	float sight_range = SIGHT_RANGE;
+	float max_speed = MAX_SPEED;
+	float max_force = MAX_FORCE;
+	InteractionRule interaction = InteractionRule::Metric;
+	SqrtAccuracy accuracy = SqrtAccuracy::Exact;
+	float avoidance_factor = AVOIDANCE_FACTOR;
+	const ObstacleField *obstacles = nullptr; //static obstacles to steer around, null for open space
+	const SpeciesTable *species = nullptr; //per species parameters of a multi-species run, null for a single species
+	bool synchronous = false; //updates leave integration to the driver, so every boid steers from the same state whatever the update order
+	PhaseProfiler *profiler = nullptr; //counts the gather and steering phases of each update, null when not profiled
+};
+
+/**
+ * \brief  Positions and velocities of a cells neighbourhood gathered into contiguous per axis arrays,
+ *		   so every boid resident in the cell can stream over the same candidates without pointer chasing.
+ */
+template <int Dim>
+struct NeighbourTileT
+{
+	vector<float> position[Dim];
+	vector<float> velocity[Dim];
+	int size = 0;
+	vector<int> species_offset; //start of each species run of the tile in a multi-species gather, species count + 1 entries
+	bool fixed_point = false; //fixed point tiles hold each boid's fixed point position instead of its float position
+	vector<uint32_t> fixed_position[Dim];
+};
+
 /**
  * \brief  Boid class that implements basic behaviors and kinematic variables/dynamics 
+ *		   Templated on the number of spatial dimensions, instantiated for 2 (planar flocks) and 3.
  */
-class Boid
+template <int Dim>
+class BoidT
 {
 public:
-	Boid();
-	~Boid() = default;
+	typedef Matrix<float, Dim, 1> VectorD;
+	typedef CellSpanT<Dim> CellSpan;
+	typedef NeighbourTileT<Dim> NeighbourTile;
+
+	static constexpr int STENCIL_SIZE = Dim == 2 ? 9 : 27; //cells in the 3^Dim neighbourhood of a grid cell
 
-	void Update();
-	void SetRanValues(default_random_engine &random_engine, uniform_real_distribution<float> &vel_distr, uniform_real_distribution<float> &pos_distr);
+	BoidT();
+	~BoidT() = default;
+
+	void Update(const BoidParameters &parameters);
+	void UpdateFromTile(const NeighbourTile &tile, const BoidParameters &parameters);
+	void Integrate();
+	void SetState(const VectorD &position, const VectorD &velocity);
 	
-	void Serialize(vector<float> &memory, int start_location);
-	void DeSerialize(vector<float> &memory, int start_location);
+	void Serialize(vector<float> &memory, size_t start_location);
+	void DeSerialize(vector<float> &memory, size_t start_location);
+	void Serialize(float *memory) const;
+	void DeSerialize(const float *memory);
 
-	Vector3f GetPosition() const;
-    Vector3f GetVelocity() const;
-	vector<list<Boid*>*> GetNeighbourBuffer() const;
+	VectorD GetPosition() const;
+    VectorD GetVelocity() const;
+	const float* GetPositionData() const;
+	const float* GetVelocityData() const;
+	vector<CellSpan> GetNeighbourBuffer() const;
+	int GetCandidateCount() const;
+	int GetSpecies() const;
+	void SetSpecies(int species);
+	void SetFixedPoint();
+	bool IsFixedPoint() const;
+	const uint32_t* GetFixedPosition() const;
+	VectorD GetImageOffset(const uint32_t *origin) const;
 	vector<int> GetGridCoord() const;
 	void SetGridCoord(vector<int> &grid_coord);
-	vector<list<Boid*>*> neighbouring_cells_buffer_; //pre-allocated memory to store pointers to the 27 relevant cells containing boid pointers that are surrounding the boid in the spatial grid
+	vector<CellSpan> neighbouring_cells_buffer_; //pre-allocated memory to store the candidate cells/leaves surrounding the boid, filled by the neighbour search backend
 
 private:
 
-	Vector3f position_;
-	Vector3f velocity_;
-	Vector3f acceleration_;
+	VectorD position_;
+	VectorD velocity_;
+	VectorD acceleration_;
 
 	vector<int> grid_coord_;
 
-	vector<tuple<Boid*, float>> nearby_boid_buffer_; //pre-allocated memory for storing pointers to nearby boids and their distances which is then iterated through in Cohesion... etc
+	vector<tuple<BoidT*, float>> nearby_boid_buffer_; //pre-allocated memory for storing pointers to nearby boids and their distances which is then iterated through in Cohesion... etc
 	int buffer_end_index_{}; // on each update stores how many boids were nearby and where to iterate to
+	int newton_steps_ = -1; // reciprocal square root refinement for the current update, -1 for the exact path
+	float max_speed_ = MAX_SPEED; // speed and force limits for the current update
+	float max_force_ = MAX_FORCE;
+	int species_ = 0;
+	uint32_t fixed_position_[Dim] = {}; // position in units of LENGTH / 2^32, the boid's state when fixed_point_ is set and position_ is decoded from it
+	bool fixed_point_ = false;
 	
+	template <int NewtonSteps, bool FixedPoint>
+	int AccumulateTile(const NeighbourTile &tile, int begin, int end, float sight_range_sq, float *vel_sum, float *pos_sum, float *sep_sum);
+	int AccumulateTile(const NeighbourTile &tile, int begin, int end, float sight_range_sq, float *vel_sum, float *pos_sum, float *sep_sum);
+	void UpdateFromSpeciesTile(const NeighbourTile &tile, const BoidParameters &parameters);
+
 	void UpdateEdges();
-	void GetNearbyBoids();
+	void DecodePosition();
+	void GetNearbyBoids(float sight_range_sq);
+	void GetNearestBoids(float sight_range_sq);
+
+	inline VectorD NormaliseToMag(VectorD &vector, float magnitude);
 
-	inline Vector3f NormaliseToMag(Vector3f &vector, float magnitude);
+	VectorD Cohesion(vector<tuple<BoidT*, float>> &nearby_boids);
+	VectorD Separation(vector<tuple<BoidT*, float>> &nearby_boids);
+	VectorD Alignment(vector<tuple<BoidT*, float>> &nearby_boids);
 
-	Vector3f Cohesion(vector<tuple<Boid*, float>> &nearby_boids);
-	Vector3f Separation(vector<tuple<Boid*, float>> &nearby_boids);
-	Vector3f Alignment(vector<tuple<Boid*, float>> &nearby_boids);
+	VectorD SteerCohesion(VectorD &average_vel);
+	VectorD SteerSeparation(VectorD &average_pos);
+	VectorD SteerAlignment(VectorD &centre_mass);
+	VectorD AvoidObstacles(const ObstacleField &obstacles);
 	
 };
 
+typedef BoidT<SYS_DIM> Boid;
+typedef CellSpanT<SYS_DIM> CellSpan;
+typedef NeighbourTileT<SYS_DIM> NeighbourTile;
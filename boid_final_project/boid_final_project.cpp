@@ -1,8 +1,18 @@
 #include "pch.h"
 #include "preprocessor.h"
-#include "single_node.h"
-#include "master.h"
-#include "worker.h"
+#include "simulation.h"
+#include "options.h"
+#include "analytics.h"
+#include "live_stream.h"
+#include "io_aggregator.h"
+#include "ensemble.h"
+#include "pipeline.h"
+#include "topology.h"
+#include "trajectory_format.h"
+#include "obstacle_field.h"
+#include "species.h"
+#include "equivalence.h"
+#include "memory_plan.h"
 
 
 #include "Eigen/Dense"
@@ -11,6 +21,7 @@
 #include <fstream>
 #include <chrono>
 #include <ctime>
+#include <random>
 
 
 /*! \file boid_final_project.cpp
@@ -27,7 +38,8 @@ using namespace Eigen;
  * \param steps | How many steps of data there are in the vector
  * \param boid_number | How many boids there are in the vector
  */
-void WriteToFile(string name, vector<Vector3f> &paths, int steps, int boid_number)
+template <int Dim>
+void WriteToFile(string name, vector<Matrix<float, Dim, 1>> &paths, int steps, int boid_number)
 {
 
 	ofstream file;
@@ -40,19 +52,19 @@ void WriteToFile(string name, vector<Vector3f> &paths, int steps, int boid_numbe
 	file << "Time of Simulation: " << ctime(&now_time) << endl;
 	file << "Number of Boids: " << BOID_NUMBER << endl;
 	file << "Size of Simulation Area: " << LENGTH << endl;
-	file << "Number of Simulation Steps: " << STEPS << endl;
+	file << "Number of Simulation Steps: " << steps << endl;
 	file << endl;
 
 	for (int step = 0; step < steps; step++)
 	{
 		for (int boid = 0; boid < boid_number; boid++)
 		{
-			Vector3f position = paths[PathIndice(boid,step,boid_number)];
+			Matrix<float, Dim, 1> position = paths[PathIndice(boid,step,boid_number)];
 
-			for (int i = 0; i < SYS_DIM; i++)
+			for (int i = 0; i < Dim; i++)
 			{
 				file << position[i];
-				if (i == (SYS_DIM-1))
+				if (i == (Dim-1))
 				{
 					file << "$";
 				}
@@ -71,6 +83,253 @@ void WriteToFile(string name, vector<Vector3f> &paths, int steps, int boid_numbe
 	
 }
 
+/**
+ * \brief Saves the boid positions for each step to a binary trajectory file that the trajectory analyzer can memory map.
+ * \param name | What to name the file
+ * \param paths | Vector of positions of each boid for every time step
+ * \param steps | How many steps of data there are in the vector
+ * \param boid_number | How many boids there are in the vector
+ * \param first_boid | Simulation index of the first boid in the vector
+ */
+template <int Dim>
+void WriteTrajectory(string name, vector<Matrix<float, Dim, 1>> &paths, int steps, int boid_number, int first_boid)
+{
+	static_assert(sizeof(Matrix<float, Dim, 1>) == Dim * sizeof(float), "Positions must be packed floats to be written as one block");
+
+	TrajectoryHeader header = {};
+	copy(TRAJECTORY_MAGIC, TRAJECTORY_MAGIC + sizeof(header.magic), header.magic);
+	header.version = TRAJECTORY_VERSION;
+	header.dimension = Dim;
+	header.boid_number = boid_number;
+	header.steps = steps;
+	header.length = LENGTH;
+	header.first_boid = first_boid;
+
+	ofstream file(name + ".bin", ios::binary);
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(paths.data()), sizeof(float) * Dim * size_t(steps) * boid_number);
+	file.close();
+}
+
+/**
+ * \brief Saves the paths in the format chosen on the command line, if any, unless they were shipped to I/O servers during the run.
+ * \param options | Run time options
+ * \param name | What to name the file, without extension
+ * \param paths | Vector of positions of each boid for every time step
+ * \param boid_number | How many boids there are in the vector
+ * \param first_boid | Simulation index of the first boid in the vector
+ */
+template <int Dim>
+void SavePaths(const SimulationOptions &options, string name, vector<Matrix<float, Dim, 1>> &paths, int boid_number, int first_boid)
+{
+	if (options.io_ranks > 0)
+	{
+		return;
+	}
+	else if (options.save == SaveFormat::Text)
+	{
+		WriteToFile(name, paths, options.steps, boid_number);
+	}
+	else if (options.save == SaveFormat::Binary)
+	{
+		WriteTrajectory(name, paths, options.steps, boid_number, first_boid);
+	}
+}
+
+/**
+ * \brief Runs this rank's part of the simulation through the engine. Output and analytics are hooks on the engine's step:
+ *		  the positions of this rank's boids are recorded only when paths are saved, so a run that saves nothing keeps no paths.
+ * \param rank | MPI node rank
+ * \param num_nodes | Number of MPI nodes running the simulation
+ * \param options | Run time options
+ * \return | Positions of this rank's boids at each step, empty when paths are not saved
+ */
+template <int Dim>
+vector<Matrix<float, Dim, 1>> run_engine(int rank, int num_nodes, const SimulationOptions &options)
+{
+	Simulation<Dim> simulation(options, rank, num_nodes);
+	FlockAnalytics<Dim> analytics(num_nodes == 1 ? "single-node" : "multi-node", options.analytics_interval, rank);
+	LiveStream<Dim> stream(options.stream_interval, options.stream_socket, rank);
+	IoAggregator<Dim> io(options, rank, num_nodes);
+
+	int start = simulation.GetStart();
+	int end = simulation.GetEnd();
+	int boid_number = end - start;
+	vector<Matrix<float, Dim, 1>> paths(options.save == SaveFormat::None ? 0 : boid_number*size_t(options.steps));
+
+	if (!paths.empty())
+	{
+		simulation.AddHook([&](int step, Simulation<Dim> &simulation)
+		{
+			const BoidT<Dim> *boids = simulation.GetOwnedBoids();
+
+			#pragma omp parallel for schedule(static)
+			for (int boid = start; boid < end; boid++)
+			{
+				paths[MultiPathIndice(boid, step, boid_number, start)] = boids[boid - start].GetPosition();
+			}
+			io.Ship(step, paths);
+		});
+	}
+	if (options.analytics_interval > 0)
+	{
+		//Only on sampled steps, the shared window loads the whole flock for them
+		simulation.AddHook([&](int step, Simulation<Dim> &simulation)
+		{
+			if (step % options.analytics_interval == 0)
+			{
+				analytics.Sample(step, simulation.GetBoids(), simulation.GetSearch(), options.parameters.sight_range, start, end);
+			}
+		});
+	}
+	if (options.stream_interval > 0)
+	{
+		simulation.AddHook([&](int step, Simulation<Dim> &simulation)
+		{
+			if (rank == MASTER && step % options.stream_interval == 0)
+			{
+				stream.Publish(step, simulation.GetBoids());
+			}
+		});
+	}
+
+	simulation.Run(options.steps);
+	io.Finish();
+	ProfileTotals profile = simulation.GetProfile();
+
+	if (rank != MASTER)
+	{
+		return paths;
+	}
+
+	simulation.PrintSummary();
+	if (options.analytics_interval > 0)
+	{
+		printf("| Analytics every    |%10d|\n", options.analytics_interval);
+		printf(" --------------------------------\n");
+		printf("| Analytics time/s   |%10f|\n", analytics.GetTimeTaken());
+		printf(" --------------------------------\n");
+	}
+	if (io.IsEnabled())
+	{
+		printf("|    I/O Servers     |%10d|\n", io.GetServerNumber());
+		printf(" --------------------------------\n");
+		printf("|    Written/MB      |%10f|\n", io.GetBytesWritten() / 1048576.0);
+		printf(" --------------------------------\n");
+		printf("|   Write MB/s       |%10f|\n", io.GetBytesWritten() / 1048576.0 / max(io.GetServerTime(), 1e-9));
+		printf(" --------------------------------\n");
+		printf("|   Disk time/s      |%10f|\n", io.GetWriteTime());
+		printf(" --------------------------------\n");
+		printf("|    I/O wait/s      |%10f|\n", io.GetWaitTime());
+		printf(" --------------------------------\n");
+	}
+	if (options.stream_interval > 0)
+	{
+		printf("|  Frames Streamed   |%10d|\n", stream.GetPublished());
+		printf(" --------------------------------\n");
+		printf("|  Frames Dropped    |%10d|\n", stream.GetDropped());
+		printf(" --------------------------------\n");
+		printf("|  Stream time/s     |%10f|\n", stream.GetTimeTaken());
+		printf(" --------------------------------\n");
+	}
+	if (options.profile)
+	{
+		PrintProfile(profile);
+		WriteProfile(string(num_nodes == 1 ? "single-node" : "multi-node") + "-profile", profile, num_nodes);
+	}
+
+	return paths;
+}
+
+/**
+ * \brief Picks the single node step. The pipelined step is 3D only so planar runs always take the engine's step.
+ * \param options | Run time options
+ * \return | Boid positions for each step of the simulation
+ */
+template <int Dim>
+vector<Matrix<float, Dim, 1>> run_single_node(const SimulationOptions &options)
+{
+	if (options.pipeline)
+	{
+		printf("The pipelined step is 3D only, running the plain single node step\n");
+	}
+
+	return run_engine<Dim>(MASTER, 1, options);
+}
+
+template <>
+vector<Vector3f> run_single_node<3>(const SimulationOptions &options)
+{
+	if (options.pipeline && options.parameters.synchronous)
+	{
+		printf("The pipelined step updates boids in place, running the plain single node step\n");
+		return run_engine<3>(MASTER, 1, options);
+	}
+	if (options.pipeline && options.fixed_point)
+	{
+		printf("The pipelined step keeps float positions, running the plain single node step\n");
+		return run_engine<3>(MASTER, 1, options);
+	}
+	if (options.pipeline && options.parameters.species)
+	{
+		printf("The pipelined step is single species, running the tiled step\n");
+		return run_engine<3>(MASTER, 1, options);
+	}
+	if (options.pipeline && options.analytics_interval > 0)
+	{
+		printf("In situ analytics are not sampled by the pipelined step\n");
+	}
+	if (options.pipeline && options.stream_interval > 0)
+	{
+		printf("Live frames are not streamed by the pipelined step\n");
+	}
+	if (options.pipeline && options.profile)
+	{
+		printf("Phases are not profiled by the pipelined step\n");
+	}
+
+	return options.pipeline ? run_pipelined(options) : run_engine<3>(MASTER, 1, options);
+}
+
+/**
+ * \brief Runs the simulation in the requested number of dimensions and saves the paths of this nodes boids.
+ *		  I/O server ranks, numbered after the compute ranks, write the paths shipped to them instead.
+ * \param rank | MPI node rank
+ * \param num_nodes | Number of MPI nodes running the simulation
+ * \param options | Run time options
+ */
+template <int Dim>
+void run_simulation(int rank, int num_nodes, const SimulationOptions &options)
+{
+	if (rank >= num_nodes)
+	{
+		IoAggregator<Dim> io(options, rank, num_nodes);
+		io.Serve();
+	}
+
+	else if (num_nodes == 1)
+	{
+		if (options.shared_window || options.halo_depth != 0)
+		{
+			printf("The shared window and deep halo are only used by multi-node runs\n");
+		}
+		vector<Matrix<float, Dim, 1>> paths = run_single_node<Dim>(options);
+		SavePaths(options, "single-node-results", paths, BOID_NUMBER, 0);
+	}
+
+	else if(rank == MASTER)
+	{
+		vector<Matrix<float, Dim, 1>> paths = run_engine<Dim>(rank, num_nodes, options);
+		SavePaths(options, "multi-node-0", paths, BOID_NUMBER/num_nodes+BOID_NUMBER%num_nodes, (num_nodes - 1)*(BOID_NUMBER / num_nodes));
+	}
+
+	else
+	{
+		vector<Matrix<float, Dim, 1>> paths = run_engine<Dim>(rank, num_nodes, options);
+		SavePaths(options, "multi-node-"+to_string(rank), paths, BOID_NUMBER / num_nodes, (rank - 1)*(BOID_NUMBER / num_nodes));
+	}
+}
+
 
 int main(int argc, char* argv[])
 {
@@ -80,32 +339,144 @@ int main(int argc, char* argv[])
 	MPI_Comm_rank(MPI_COMM_WORLD, &rank);
 	
 	omp_set_num_threads(THREAD_NUM);	
+	SimulationOptions options = ParseOptions(argc, argv);
+
+	if (options.io_ranks > 0 && (options.io_ranks >= num_nodes || options.save == SaveFormat::None || options.pipeline || !options.ensemble_file.empty() || options.check_equivalence))
+	{
+		if (rank == MASTER)
+		{
+			printf("I/O servers need more ranks than --io-ranks, saved paths and a plain or multi-node run, writing paths from every rank\n");
+		}
+		options.io_ranks = 0;
+	}
+	if (options.io_ranks > 0)
+	{
+		//The last ranks only serve I/O, the simulation and its collectives run on the others
+		num_nodes -= options.io_ranks;
+		MPI_Comm_split(MPI_COMM_WORLD, rank >= num_nodes, rank, &compute_comm);
+	}
+
+	if (!options.seeded)
+	{
+		//Every rank generates boids from the same seed, so the master draws it for all
+		random_device rand_dev;
+		options.seed = rand_dev();
+		MPI_Bcast(&options.seed, 1, MPI_UINT64_T, MASTER, MPI_COMM_WORLD);
+	}
+
+	if (options.check_fast_math)
+	{
+		bool passed = rank != MASTER || CheckFastMath();
+		MPI_Finalize();
+		return passed ? 0 : 1;
+	}
+
+	if (options.check_equivalence)
+	{
+		bool passed = options.dimension == 2 ? CheckEquivalence<2>(rank, num_nodes, options) : CheckEquivalence<3>(rank, num_nodes, options);
+		MPI_Finalize();
+		return passed ? 0 : 1;
+	}
+
+	if (options.numa)
+	{
+		Placement placement = SetupPlacement(DetectTopology());
+		if (rank == MASTER)
+		{
+			printf("NUMA placement: %d domains, %d ranks per node, %d threads per rank\n", placement.domain_number, placement.ranks_on_node, placement.thread_number);
+			if (!placement.pinned)
+			{
+				printf("Thread pinning is unsupported on this platform, threads are left where the OS puts them\n");
+			}
+		}
+	}
 	
-	if (num_nodes == 1)
+	ObstacleField obstacles;
+	if (!options.obstacle_file.empty() && obstacles.Load(options.obstacle_file, options.ensemble_file.empty() ? options.dimension : 3))
 	{
-		vector<Vector3f> paths = run_single();
-		if (SAVE) 
+		options.parameters.obstacles = &obstacles;
+		if (rank == MASTER)
 		{
-			WriteToFile("single-node-results", paths, STEPS, BOID_NUMBER);
+			printf("Obstacle field: %d primitives, %d triangles, built in %f s\n", obstacles.GetPrimitiveNumber(), obstacles.GetTriangleNumber(), obstacles.GetBuildTime());
 		}
 	}
 
-	else if(rank == MASTER)
+	SpeciesTable species;
+	if (!options.species_file.empty() && options.ensemble_file.empty())
+	{
+		species = ReadSpecies(options.species_file, options.parameters, BOID_NUMBER);
+
+		if (species.Count() > 0)
+		{
+			//Species kernels run per species pair over a species sorted tile, the stencil is sized by the longest sight range
+			options.parameters.species = &species;
+			options.parameters.sight_range = species.max_sight_range;
+			if (rank == MASTER && (!options.tiled || options.parameters.interaction == InteractionRule::Topological))
+			{
+				printf("Multi-species runs use the tiled metric kernel\n");
+			}
+			options.tiled = true;
+			options.parameters.interaction = InteractionRule::Metric;
+		}
+	}
+
+	if (options.fixed_point && options.search != SearchBackend::Grid)
 	{
-		vector<Vector3f> paths = run_master(rank, num_nodes);
-		if (SAVE)
+		//The other backends work from float positions and do not search across the periodic boundary
+		if (rank == MASTER)
 		{
-			WriteToFile("multi-node-0", paths, STEPS, BOID_NUMBER/num_nodes+BOID_NUMBER%num_nodes);
+			printf("Fixed point coordinates find cells by shifting positions, using the grid backend\n");
 		}
+		options.search = SearchBackend::Grid;
 	}
 
-	else
+	if (options.shared_window && options.halo_depth != 0 && num_nodes > 1)
+	{
+		//Ranks keep only their own boids with the window, so there are no ghosts to carry between exchanges
+		if (rank == MASTER)
+		{
+			printf("The shared window exchanges every step, ignoring --halo\n");
+		}
+		options.halo_depth = 0;
+	}
+
+	//Ensemble members size their own flocks, every other run is planned before it allocates
+	if (options.ensemble_file.empty() && !CheckMemory(options, rank, num_nodes))
+	{
+		if (compute_comm != MPI_COMM_WORLD)
+		{
+			MPI_Comm_free(&compute_comm);
+		}
+		MPI_Finalize();
+		return 1;
+	}
+
+	if (!options.ensemble_file.empty())
 	{
-		vector<Vector3f> paths = run_worker(rank, num_nodes);
-		if (SAVE)
+		if (options.dimension != 3 && rank == MASTER)
+		{
+			printf("Ensemble runs are 3D only, ignoring --dim\n");
+		}
+		if (options.fixed_point && rank == MASTER)
 		{
-			WriteToFile("multi-node-"+to_string(rank), paths, STEPS, BOID_NUMBER / num_nodes);
+			printf("Ensemble members keep float positions, ignoring --fixed-point\n");
 		}
+		run_ensemble(rank, num_nodes, options);
+	}
+
+	else if (options.dimension == 2)
+	{
+		run_simulation<2>(rank, num_nodes, options);
+	}
+
+	else
+	{
+		run_simulation<3>(rank, num_nodes, options);
+	}
+
+	if (compute_comm != MPI_COMM_WORLD)
+	{
+		MPI_Comm_free(&compute_comm);
 	}
 	   	  
 	MPI_Finalize();
@@ -5,16 +5,78 @@
 	\brief Functions to handle inter-node communication of data
 */
 
+MPI_Comm compute_comm = MPI_COMM_WORLD;
+
+/**
+ * \brief  MPI broadcast of any number of elements. MPI counts are int, so the data goes out in calls of at most MPI_CHUNK elements.
+ * \param  data | First element
+ * \param  count | Number of elements, may pass 2^31
+ * \param  type | MPI type of an element
+ * \param  root | MPI Broadcast root rank
+ * \param  comm | Communicator
+ */
+void BroadcastChunked(void *data, size_t count, MPI_Datatype type, int root, MPI_Comm comm)
+{
+	int type_size;
+	MPI_Type_size(type, &type_size);
+	for (size_t offset = 0; offset < count; offset += MPI_CHUNK)
+	{
+		int chunk = int(min(count - offset, size_t(MPI_CHUNK)));
+		MPI_Bcast(static_cast<char*>(data) + offset * type_size, chunk, type, root, comm);
+	}
+}
+
+/**
+ * \brief  MPI send of any number of elements, in calls of at most MPI_CHUNK elements. Pair with ReceiveChunked of the same count.
+ * \param  data | First element
+ * \param  count | Number of elements, may pass 2^31
+ * \param  type | MPI type of an element
+ * \param  destination | Destination node MPI rank
+ * \param  tag | Message tag, shared by every chunk
+ * \param  comm | Communicator
+ */
+void SendChunked(const void *data, size_t count, MPI_Datatype type, int destination, int tag, MPI_Comm comm)
+{
+	int type_size;
+	MPI_Type_size(type, &type_size);
+	for (size_t offset = 0; offset < count; offset += MPI_CHUNK)
+	{
+		int chunk = int(min(count - offset, size_t(MPI_CHUNK)));
+		MPI_Send(static_cast<const char*>(data) + offset * type_size, chunk, type, destination, tag, comm);
+	}
+}
+
+/**
+ * \brief  MPI receive of any number of elements sent by SendChunked. Chunks of one tag arrive in order, as MPI does not overtake.
+ * \param  data | Where to receive the first element
+ * \param  count | Number of elements, may pass 2^31
+ * \param  type | MPI type of an element
+ * \param  source | Source node MPI rank
+ * \param  tag | Message tag, shared by every chunk
+ * \param  comm | Communicator
+ */
+void ReceiveChunked(void *data, size_t count, MPI_Datatype type, int source, int tag, MPI_Comm comm)
+{
+	int type_size;
+	MPI_Type_size(type, &type_size);
+	for (size_t offset = 0; offset < count; offset += MPI_CHUNK)
+	{
+		int chunk = int(min(count - offset, size_t(MPI_CHUNK)));
+		MPI_Recv(static_cast<char*>(data) + offset * type_size, chunk, type, source, tag, comm, MPI_STATUS_IGNORE);
+	}
+}
+
 /**
  * \brief  Deserializes all boids represented in float memory to vector of boid objects.
  * \param  boids | Boid vector to deserialize to
  * \param  memory | Flot vector to deserialize from
  */
-void DeSerializeBoids(vector<Boid>& boids, vector<float>& memory)
+template <int Dim>
+void DeSerializeBoids(vector<BoidT<Dim>>& boids, vector<float>& memory)
 {
 	for (int boid = 0; boid < boids.size(); boid++)
 	{
-		boids[boid].DeSerialize(memory, boid * SYS_DIM * 2);
+		boids[boid].DeSerialize(memory, size_t(boid) * Dim * 2);
 	}
 }
 
@@ -25,11 +87,12 @@ void DeSerializeBoids(vector<Boid>& boids, vector<float>& memory)
  * \param  start | Vector start index
  * \param  end | Vector index
  */
-void DeSerializeBoids(vector<Boid>& boids, vector<float>& memory, int start, int end)
+template <int Dim>
+void DeSerializeBoids(vector<BoidT<Dim>>& boids, vector<float>& memory, int start, int end)
 {
 	for (int boid = start; boid < end; boid++)
 	{
-		boids[boid].DeSerialize(memory, (boid - start) *SYS_DIM * 2);
+		boids[boid].DeSerialize(memory, size_t(boid - start) * Dim * 2);
 	}
 }
 
@@ -38,11 +101,12 @@ void DeSerializeBoids(vector<Boid>& boids, vector<float>& memory, int start, int
  * \param  boids | Boid vector to serialize from
  * \param  memory | Float vector to serialize to
  */
-void SerializeBoids(vector<Boid>& boids, vector<float>& memory)
+template <int Dim>
+void SerializeBoids(vector<BoidT<Dim>>& boids, vector<float>& memory)
 {
 	for (int boid = 0; boid < boids.size(); boid++)
 	{
-		boids[boid].Serialize(memory, boid*SYS_DIM * 2);
+		boids[boid].Serialize(memory, size_t(boid) * Dim * 2);
 	}
 }
 
@@ -53,11 +117,12 @@ void SerializeBoids(vector<Boid>& boids, vector<float>& memory)
  * \param  start | Boid vector index to start serializing at
  * \param  end | Boid vector indext to end serializing at
  */
-void SerializeBoids(vector<Boid>& boids, vector<float>& memory, int start, int end)
+template <int Dim>
+void SerializeBoids(vector<BoidT<Dim>>& boids, vector<float>& memory, int start, int end)
 {
 	for (int boid = start; boid < end; boid++)
 	{
-		boids[boid].Serialize(memory, (boid - start) * SYS_DIM * 2);
+		boids[boid].Serialize(memory, size_t(boid - start) * Dim * 2);
 	}
 }
 
@@ -67,10 +132,11 @@ void SerializeBoids(vector<Boid>& boids, vector<float>& memory, int start, int e
  * \param  memory | Intermediary float vector to hold values for MPI broadcast routine
  * \param  rank | MPI Broadcast root rank
  */
-void BroadcastSendBoids(vector<Boid>& boids, vector<float>& memory, int rank)
+template <int Dim>
+void BroadcastSendBoids(vector<BoidT<Dim>>& boids, vector<float>& memory, int rank)
 {
 	SerializeBoids(boids, memory);
-	MPI_Bcast(&memory[0], memory.size(), MPI_FLOAT, rank, MPI_COMM_WORLD);
+	BroadcastChunked(&memory[0], memory.size(), MPI_FLOAT, rank, compute_comm);
 }
 
 /**
@@ -80,9 +146,10 @@ void BroadcastSendBoids(vector<Boid>& boids, vector<float>& memory, int rank)
  * \param  memory | Intermediary float vector for MPI to broadcast to
  * \param  rank | MPI Broadcast rank to receive from
  */
-void BroadcastReceiveBoids(vector<Boid>& boids, vector<float>& memory, int rank)
+template <int Dim>
+void BroadcastReceiveBoids(vector<BoidT<Dim>>& boids, vector<float>& memory, int rank)
 {
-	MPI_Bcast(&memory[0], memory.size(), MPI_FLOAT, rank, MPI_COMM_WORLD);
+	BroadcastChunked(&memory[0], memory.size(), MPI_FLOAT, rank, compute_comm);
 	DeSerializeBoids(boids, memory);
 }
 
@@ -95,10 +162,11 @@ void BroadcastReceiveBoids(vector<Boid>& boids, vector<float>& memory, int rank)
  * \param  start | Boid vector start index of selection to send
  * \param  stop | Boid vector end index of selection to send
  */
-void SendBoids(vector<Boid>& boids, vector<float>& memory, int destination, int start, int stop)
+template <int Dim>
+void SendBoids(vector<BoidT<Dim>>& boids, vector<float>& memory, int destination, int start, int stop)
 {
 	SerializeBoids(boids, memory, start, stop);
-	MPI_Send(&memory[0], memory.size(), MPI_FLOAT, destination, 5, MPI_COMM_WORLD);
+	SendChunked(&memory[0], memory.size(), MPI_FLOAT, destination, 5, compute_comm);
 }
 
 /**
@@ -111,10 +179,10 @@ void SendBoids(vector<Boid>& boids, vector<float>& memory, int destination, int
  * \param  start | Boid vector start index for where to deserialize the selection to
  * \param  stop | Boid vector end index for where to deserialize the selection to
  */
-void ReceiveBoids(vector<Boid>& boids, vector<float>& memory, int source, int destination, int start, int stop)
+template <int Dim>
+void ReceiveBoids(vector<BoidT<Dim>>& boids, vector<float>& memory, int source, int destination, int start, int stop)
 {
-	MPI_Status stat;
-	MPI_Recv(&memory[0], memory.size(), MPI_FLOAT, source, 5, MPI_COMM_WORLD, &stat);
+	ReceiveChunked(&memory[0], memory.size(), MPI_FLOAT, source, 5, compute_comm);
 	DeSerializeBoids(boids, memory, start, stop);
 }
 
@@ -126,11 +194,11 @@ void ReceiveBoids(vector<Boid>& boids, vector<float>& memory, int source, int de
  */
 void SendGridUpdates(vector<int> &updates, int destination)
 {
-	int size = updates.size();
-	MPI_Send(&size, 1, MPI_INT, destination, 6, MPI_COMM_WORLD);
+	long long size = updates.size();
+	MPI_Send(&size, 1, MPI_LONG_LONG, destination, 6, compute_comm);
 	if (size > 0)
 	{
-		MPI_Send(&updates[0], size, MPI_INT, destination, 6, MPI_COMM_WORLD);
+		SendChunked(&updates[0], size, MPI_INT, destination, 6, compute_comm);
 	}
 }
 
@@ -142,13 +210,12 @@ void SendGridUpdates(vector<int> &updates, int destination)
  */
 void ReceiveGridUpdates(vector<int> &updates, int source)
 {
-	int size;
-	MPI_Status stat;
-	MPI_Recv(&size, 1, MPI_INT, source, 6, MPI_COMM_WORLD, &stat);
+	long long size;
+	MPI_Recv(&size, 1, MPI_LONG_LONG, source, 6, compute_comm, MPI_STATUS_IGNORE);
 	if (size > 0)
 	{
 		updates.resize(size);
-		MPI_Recv(&updates[0], size, MPI_INT, source, 6, MPI_COMM_WORLD, &stat);
+		ReceiveChunked(&updates[0], size, MPI_INT, source, 6, compute_comm);
 	}
 	else
 	{
@@ -164,11 +231,11 @@ void ReceiveGridUpdates(vector<int> &updates, int source)
  */
 void BroadcastSendGridUpdates(vector<int> &updates, int source)
 {
-	int size = updates.size();
-	MPI_Bcast(&size, 1, MPI_INT, source, MPI_COMM_WORLD);
+	long long size = updates.size();
+	MPI_Bcast(&size, 1, MPI_LONG_LONG, source, compute_comm);
 	if (size > 0)
 	{
-		MPI_Bcast(&updates[0], size, MPI_INT, source, MPI_COMM_WORLD);
+		BroadcastChunked(&updates[0], size, MPI_INT, source, compute_comm);
 	}
 }
 
@@ -180,11 +247,29 @@ void BroadcastSendGridUpdates(vector<int> &updates, int source)
  */
 void BroadcastReceiveGridUpdates(vector<int> &updates, int source)
 {
-	int size;
-	MPI_Bcast(&size, 1, MPI_INT, source, MPI_COMM_WORLD);
+	long long size;
+	MPI_Bcast(&size, 1, MPI_LONG_LONG, source, compute_comm);
 	if (size > 0)
 	{
 		updates.resize(size);
-		MPI_Bcast(&updates[0], size, MPI_INT, source, MPI_COMM_WORLD);
+		BroadcastChunked(&updates[0], size, MPI_INT, source, compute_comm);
 	}
-}
\ No newline at end of file
+}
+
+//Instantiated for planar and spatial flocks, the wire format is 2*Dim floats per boid.
+template void DeSerializeBoids<2>(vector<BoidT<2>>&, vector<float>&);
+template void DeSerializeBoids<2>(vector<BoidT<2>>&, vector<float>&, int, int);
+template void SerializeBoids<2>(vector<BoidT<2>>&, vector<float>&);
+template void SerializeBoids<2>(vector<BoidT<2>>&, vector<float>&, int, int);
+template void BroadcastSendBoids<2>(vector<BoidT<2>>&, vector<float>&, int);
+template void BroadcastReceiveBoids<2>(vector<BoidT<2>>&, vector<float>&, int);
+template void SendBoids<2>(vector<BoidT<2>>&, vector<float>&, int, int, int);
+template void ReceiveBoids<2>(vector<BoidT<2>>&, vector<float>&, int, int, int, int);
+template void DeSerializeBoids<3>(vector<BoidT<3>>&, vector<float>&);
+template void DeSerializeBoids<3>(vector<BoidT<3>>&, vector<float>&, int, int);
+template void SerializeBoids<3>(vector<BoidT<3>>&, vector<float>&);
+template void SerializeBoids<3>(vector<BoidT<3>>&, vector<float>&, int, int);
+template void BroadcastSendBoids<3>(vector<BoidT<3>>&, vector<float>&, int);
+template void BroadcastReceiveBoids<3>(vector<BoidT<3>>&, vector<float>&, int);
+template void SendBoids<3>(vector<BoidT<3>>&, vector<float>&, int, int, int);
+template void ReceiveBoids<3>(vector<BoidT<3>>&, vector<float>&, int, int, int, int);
@@ -4,21 +4,37 @@
 #include <mpi.h>
 #include <vector>
 
-void DeSerializeBoids(vector<Boid> &boids, vector<float> &memory);
+extern MPI_Comm compute_comm; //Ranks running the simulation, MPI_COMM_WORLD less any I/O servers
 
-void DeSerializeBoids(vector<Boid> &boids, vector<float> &memory, int start, int end);
+void BroadcastChunked(void *data, size_t count, MPI_Datatype type, int root, MPI_Comm comm);
 
-void SerializeBoids(vector<Boid> &boids, vector<float> &memory);
+void SendChunked(const void *data, size_t count, MPI_Datatype type, int destination, int tag, MPI_Comm comm);
 
-void SerializeBoids(vector<Boid> &boids, vector<float> &memory, int start, int end);
+void ReceiveChunked(void *data, size_t count, MPI_Datatype type, int source, int tag, MPI_Comm comm);
 
-void BroadcastSendBoids(vector<Boid>& boids, vector<float>& memory, int rank);
+template <int Dim>
+void DeSerializeBoids(vector<BoidT<Dim>> &boids, vector<float> &memory);
 
-void BroadcastReceiveBoids(vector<Boid>& boids, vector<float>& memory, int rank);
+template <int Dim>
+void DeSerializeBoids(vector<BoidT<Dim>> &boids, vector<float> &memory, int start, int end);
 
-void SendBoids(vector<Boid>& boids, vector<float>& memory, int destination, int start, int stop);
+template <int Dim>
+void SerializeBoids(vector<BoidT<Dim>> &boids, vector<float> &memory);
 
-void ReceiveBoids(vector<Boid>& boids, vector<float>& memory, int source, int destination, int start, int stop);
+template <int Dim>
+void SerializeBoids(vector<BoidT<Dim>> &boids, vector<float> &memory, int start, int end);
+
+template <int Dim>
+void BroadcastSendBoids(vector<BoidT<Dim>>& boids, vector<float>& memory, int rank);
+
+template <int Dim>
+void BroadcastReceiveBoids(vector<BoidT<Dim>>& boids, vector<float>& memory, int rank);
+
+template <int Dim>
+void SendBoids(vector<BoidT<Dim>>& boids, vector<float>& memory, int destination, int start, int stop);
+
+template <int Dim>
+void ReceiveBoids(vector<BoidT<Dim>>& boids, vector<float>& memory, int source, int destination, int start, int stop);
 
 void SendGridUpdates(vector<int>& updates, int destination);
 
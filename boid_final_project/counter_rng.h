@@ -0,0 +1,106 @@
+#pragma once
+#include "pch.h"
+#include <cstdint>
+#include <cmath>
+
+using namespace std;
+
+/**
+ * \brief  Philox4x32-10 counter based generator (Salmon et al., SC11). Four 32 bit counter words are mixed with a
+ *		   64 bit key by ten rounds of multiply and xor, giving four random words. Any block of the stream can be
+ *		   computed directly from its counter, so no state is shared between boids, threads or ranks.
+ * \param  counter | Counter words, replaced by the random words
+ * \param  key | Key words
+ */
+inline void Philox4x32(uint32_t counter[4], const uint32_t key[2])
+{
+	uint32_t key_0 = key[0], key_1 = key[1];
+
+	for (int round = 0; round < 10; round++)
+	{
+		uint64_t product_0 = uint64_t(0xD2511F53u) * counter[0];
+		uint64_t product_1 = uint64_t(0xCD9E8D57u) * counter[2];
+
+		uint32_t next_0 = uint32_t(product_1 >> 32) ^ counter[1] ^ key_0;
+		uint32_t next_2 = uint32_t(product_0 >> 32) ^ counter[3] ^ key_1;
+		counter[1] = uint32_t(product_1);
+		counter[3] = uint32_t(product_0);
+		counter[0] = next_0;
+		counter[2] = next_2;
+
+		key_0 += 0x9E3779B9u;
+		key_1 += 0xBB67AE85u;
+	}
+}
+
+/**
+ * \brief  Random numbers of one (seed, id, step) triple, such as the initial state of one boid. Draws count up the
+ *		   last counter word, so the values a boid gets do not depend on which rank or thread generates it.
+ */
+class PhiloxStream
+{
+public:
+
+	/**
+	 * \brief  Starts the stream of one id at one step.
+	 * \param  seed | Run seed, the key
+	 * \param  id | Boid (or group) id
+	 * \param  step | Simulation step, 0 for initial conditions
+	 */
+	PhiloxStream(uint64_t seed, uint32_t id, uint32_t step)
+	{
+		key_[0] = uint32_t(seed);
+		key_[1] = uint32_t(seed >> 32);
+		id_ = id;
+		step_ = step;
+	}
+
+	/**
+	 * \brief  Uniform float in [0, 1), from the top 24 bits of a random word.
+	 * \return  | Random value
+	 */
+	float Uniform()
+	{
+		if (used_ == 4)
+		{
+			block_[0] = id_;
+			block_[1] = step_;
+			block_[2] = 0;
+			block_[3] = draw_++;
+			Philox4x32(block_, key_);
+			used_ = 0;
+		}
+
+		return (block_[used_++] >> 8) * (1.0f / 16777216.0f);
+	}
+
+	/**
+	 * \brief  Uniform float in [low, high).
+	 * \param  low | Lower bound
+	 * \param  high | Upper bound
+	 * \return  | Random value
+	 */
+	float Uniform(float low, float high)
+	{
+		return low + (high - low) * Uniform();
+	}
+
+	/**
+	 * \brief  Standard normal float by the Box-Muller transform.
+	 * \return  | Random value
+	 */
+	float Gaussian()
+	{
+		float radius = sqrt(-2.0f * log(1.0f - Uniform()));
+		return radius * cos(6.28318531f * Uniform());
+	}
+
+private:
+
+	uint32_t key_[2];
+	uint32_t id_;
+	uint32_t step_;
+	uint32_t draw_ = 0;		//Blocks drawn so far
+	uint32_t block_[4];		//Current block of random words
+	int used_ = 4;			//Words of the block already returned
+};
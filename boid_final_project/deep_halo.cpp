@@ -0,0 +1,343 @@
+#include "pch.h"
+#include "deep_halo.h"
+#include "phase_profiler.h"
+#include <algorithm>
+
+/*! \file deep_halo.cpp
+	\brief Exchanging boids every few steps by redundantly updating a deep halo of ghost boids.
+*/
+
+using namespace std;
+using namespace Eigen;
+
+/**
+ * \brief  Sets up the halo of one rank. Call Mark once the boids are initialised.
+ * \param  depth | Steps between exchanges, 0 to exchange every step through the master as before, -1 to tune it
+ * \param  sight_range | Boid sight range, the longest one in a multi-species run
+ * \param  max_acceleration | Largest speed any boid can gain in a step, over every species in a multi-species run
+ * \param  start | First boid the rank owns
+ * \param  end | One past the last boid the rank owns
+ * \param  rank | MPI node rank
+ */
+template <int Dim>
+DeepHalo<Dim>::DeepHalo(int depth, float sight_range, float max_acceleration, int start, int end, int rank)
+	: automatic_(depth < 0), depth_(depth < 0 ? 1 : depth), sight_range_(sight_range), max_acceleration_(max_acceleration), start_(start), end_(end), rank_(rank)
+{
+}
+
+/**
+ * \brief  Whether boids are exchanged through the halo.
+ * \return  | True when enabled
+ */
+template <int Dim>
+bool DeepHalo<Dim>::IsEnabled() const
+{
+	return depth_ > 0;
+}
+
+/**
+ * \brief  Plans the substeps up to the next exchange from the freshly exchanged flock. Owned boids are updated in every
+ *		   substep, a ghost up to the substep after which no owned boid can be reached from it in time.
+ *		   Measures the fastest boid first, maximised over ranks so every rank sizes its halo cells alike.
+ * \param  boids | Boid vector, every boid up to date
+ */
+template <int Dim>
+void DeepHalo<Dim>::Mark(const vector<Boid> &boids)
+{
+	float speed_squared = 0;
+	for (int boid = start_; boid < end_; boid++)
+	{
+		speed_squared = max(speed_squared, boids[boid].GetVelocity().squaredNorm());
+	}
+	speed_ = sqrt(speed_squared);
+	MPI_Allreduce(MPI_IN_PLACE, &speed_, 1, MPI_FLOAT, MPI_MAX, compute_comm);
+
+	vector<int> levels;
+	Levels(boids, depth_, levels);
+
+	last_substep_.resize(boids.size());
+	mask_.resize(boids.size());
+	active_.resize(depth_);
+	for (vector<int> &active : active_)
+	{
+		active.clear(); //keeps its capacity between exchanges
+	}
+
+	for (int boid = 0; boid < boids.size(); boid++)
+	{
+		bool owned = boid >= start_ && boid < end_;
+		last_substep_[boid] = owned ? depth_ - 1 : min(depth_ - 2, depth_ - 1 - levels[boid]);
+
+		for (int substep = 0; substep <= last_substep_[boid]; substep++)
+		{
+			active_[substep].push_back(boid);
+		}
+	}
+
+	substep_ = 0;
+}
+
+/**
+ * \brief  Runs one substep: updates the owned boids and the ghosts still needed, then moves them in the grid directly,
+ *		   as on a single node, since no other rank will send the moves.
+ * \param  grid | Neighbour search structure
+ * \param  parameters | Behaviour parameters
+ * \param  tiled | Update cell by cell with the tiled kernel
+ * \param  boids | Boid vector
+ */
+template <int Dim>
+void DeepHalo<Dim>::Update(NeighbourSearchT<Dim> &grid, const BoidParameters &parameters, bool tiled, vector<Boid> &boids)
+{
+	double start_time = MPI_Wtime();
+	const vector<int> &active = active_[substep_];
+
+	if (tiled)
+	{
+		#pragma omp parallel for schedule(static)
+		for (int boid = 0; boid < boids.size(); boid++)
+		{
+			mask_[boid] = last_substep_[boid] >= substep_;
+		}
+		UpdateTiled(grid, parameters, &boids[0], &boids[0] + boids.size(), mask_.data());
+	}
+	else
+	{
+		PhaseProfiler *profiler = parameters.profiler;
+
+		#pragma omp parallel
+		{
+			#pragma omp for schedule(SCHEDULE) nowait
+			for (int i = 0; i < active.size(); i++)
+			{
+				if (profiler)
+				{
+					profiler->Enter(ProfilePhase::CellSetup);
+				}
+				grid.UpdateNearCells(boids[active[i]]);
+				boids[active[i]].Update(parameters);
+				if (profiler)
+				{
+					profiler->CountUpdates(1, boids[active[i]].GetCandidateCount());
+				}
+			}
+
+			if (profiler)
+			{
+				profiler->Leave();
+			}
+		}
+	}
+
+	if (parameters.synchronous)
+	{
+		#pragma omp parallel for schedule(static)
+		for (int i = 0; i < active.size(); i++)
+		{
+			boids[active[i]].Integrate();
+		}
+	}
+
+	int size = 1;
+	vector<int> unused;
+	if (parameters.profiler)
+	{
+		parameters.profiler->Enter(ProfilePhase::GridUpdate);
+	}
+	for (int boid : active)
+	{
+		grid.UpdateGrid(boids[boid], unused, size);
+	}
+	if (parameters.profiler)
+	{
+		parameters.profiler->Leave();
+	}
+
+	compute_time_ += MPI_Wtime() - start_time;
+	updates_ += active.size();
+	owned_updates_ += end_ - start_;
+	substep_++;
+}
+
+/**
+ * \brief  Whether the last substep before an exchange has been run.
+ * \return  | True when the boids must be exchanged
+ */
+template <int Dim>
+bool DeepHalo<Dim>::NeedsExchange() const
+{
+	return substep_ == depth_;
+}
+
+/**
+ * \brief  Brings the grid in line with the exchanged flock, tunes the depth at the end of the warm up and plans the next substeps.
+ * \param  grid | Neighbour search structure
+ * \param  boids | Boid vector, every boid up to date
+ * \param  exchange_time | Wall time the exchange took
+ */
+template <int Dim>
+void DeepHalo<Dim>::Synchronise(NeighbourSearchT<Dim> &grid, vector<Boid> &boids, double exchange_time)
+{
+	int size = 1;
+	vector<int> unused;
+	for (Boid &boid : boids)
+	{
+		grid.UpdateGrid(boid, unused, size);
+	}
+
+	exchanges_++;
+	exchange_time_ += exchange_time;
+
+	if (automatic_ && exchanges_ == DEEP_HALO_WARMUP)
+	{
+		Tune(boids);
+	}
+
+	Mark(boids);
+}
+
+/**
+ * \brief  Steps between exchanges.
+ * \return  | Halo depth
+ */
+template <int Dim>
+int DeepHalo<Dim>::GetDepth() const
+{
+	return depth_;
+}
+
+/**
+ * \brief  Exchanges made so far.
+ * \return  | Exchange count
+ */
+template <int Dim>
+int DeepHalo<Dim>::GetExchanges() const
+{
+	return exchanges_;
+}
+
+/**
+ * \brief  Ghost updates made per owned boid update, the redundant work the halo costs.
+ * \return  | Ghost fraction
+ */
+template <int Dim>
+double DeepHalo<Dim>::GetGhostFraction() const
+{
+	return owned_updates_ > 0 ? double(updates_ - owned_updates_) / owned_updates_ : 0;
+}
+
+/**
+ * \brief  Halo level of every boid for a given depth: the periodic Chebyshev distance in halo cells from its cell to the
+ *		   nearest cell holding an owned boid, capped at depth. Found by dilating the owned cells one level at a time.
+ * \param  boids | Boid vector
+ * \param  depth | Halo depth, sets the halo cell width
+ * \param  levels | Level of each boid
+ */
+template <int Dim>
+void DeepHalo<Dim>::Levels(const vector<Boid> &boids, int depth, vector<int> &levels) const
+{
+	float speed = speed_ + depth * max_acceleration_; //fastest any boid can go before the next exchange
+	int cell_num = max(1, int(LENGTH / (sight_range_ + 2 * depth * speed))); //cells are at least a halo cell wide
+	int cell_count = 1;
+	for (int i = 0; i < Dim; i++)
+	{
+		cell_count *= cell_num;
+	}
+
+	levels.assign(boids.size(), depth);
+	if (depth == 1)
+	{
+		return; //no ghosts, owned boids are updated whatever their level
+	}
+
+	vector<int> boid_cells(boids.size());
+	vector<int> cell_levels(cell_count, depth);
+
+	for (int boid = 0; boid < boids.size(); boid++)
+	{
+		typename Boid::VectorD position = boids[boid].GetPosition();
+		int cell = 0;
+		for (int i = 0; i < Dim; i++)
+		{
+			cell = cell * cell_num + min(max(int(position[i] * cell_num / LENGTH), 0), cell_num - 1);
+		}
+		boid_cells[boid] = cell;
+	}
+
+	for (int boid = start_; boid < end_; boid++)
+	{
+		cell_levels[boid_cells[boid]] = 0;
+	}
+
+	int stencil_size = Boid::STENCIL_SIZE;
+	for (int level = 1; level < depth; level++)
+	{
+		for (int cell = 0; cell < cell_count; cell++)
+		{
+			if (cell_levels[cell] != level - 1)
+			{
+				continue;
+			}
+
+			for (int offset = 0; offset < stencil_size; offset++)
+			{
+				int neighbour = 0;
+				for (int i = Dim - 1, remaining_cell = cell, remaining_offset = offset, scale = 1; i >= 0; i--)
+				{
+					int coord = (remaining_cell % cell_num + remaining_offset % 3 - 1 + cell_num) % cell_num;
+					neighbour += coord * scale;
+					remaining_cell /= cell_num;
+					remaining_offset /= 3;
+					scale *= cell_num;
+				}
+				cell_levels[neighbour] = min(cell_levels[neighbour], level);
+			}
+		}
+	}
+
+	for (int boid = 0; boid < boids.size(); boid++)
+	{
+		levels[boid] = cell_levels[boid_cells[boid]];
+	}
+}
+
+/**
+ * \brief  Picks the depth with the least estimated time per step, exchange time / depth plus the measured cost of a boid update
+ *		   times the updates each depth needs per step. Estimates are maximised over ranks, so every rank picks the same depth.
+ * \param  boids | Boid vector, every boid up to date
+ */
+template <int Dim>
+void DeepHalo<Dim>::Tune(const vector<Boid> &boids)
+{
+	double exchange_time = exchange_time_ / exchanges_;
+	double update_time = compute_time_ / max(updates_, 1LL);
+	vector<double> step_times(DEEP_HALO_MAX);
+	vector<int> levels;
+
+	for (int depth = 1; depth <= DEEP_HALO_MAX; depth++)
+	{
+		Levels(boids, depth, levels);
+
+		long long updates = 0;
+		for (int boid = 0; boid < boids.size(); boid++)
+		{
+			bool owned = boid >= start_ && boid < end_;
+			updates += owned ? depth : max(0, min(depth - 1, depth - levels[boid]));
+		}
+		step_times[depth - 1] = (exchange_time + update_time * updates) / depth;
+	}
+
+	MPI_Allreduce(MPI_IN_PLACE, step_times.data(), DEEP_HALO_MAX, MPI_DOUBLE, MPI_MAX, compute_comm);
+	depth_ = min_element(step_times.begin(), step_times.end()) - step_times.begin() + 1;
+
+	if (rank_ == MASTER)
+	{
+		printf("Halo tuning: exchange %e s, boid update %e s\n", exchange_time, update_time);
+		for (int depth = 1; depth <= DEEP_HALO_MAX; depth++)
+		{
+			printf("  depth %2d: estimated %e s per step%s\n", depth, step_times[depth - 1], depth == depth_ ? " <-" : "");
+		}
+	}
+}
+
+template class DeepHalo<2>;
+template class DeepHalo<3>;
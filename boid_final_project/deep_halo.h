@@ -0,0 +1,61 @@
+#pragma once
+#include "pch.h"
+#include "preprocessor.h"
+#include "boid.h"
+#include "neighbour_search.h"
+#include "tiled_kernel.h"
+#include "communication.h"
+#include "omp.h"
+#include <mpi.h>
+#include <vector>
+
+/**
+ * \brief  Communication avoiding exchange for multi-node runs. Between exchanges a rank advances its own boids for depth steps
+ *		   without hearing from the others, by also updating the ghost boids that can reach them in that time: at substep t
+ *		   every boid within (depth - 1 - t) halo cells of an owned boid, where a halo cell is sight range + 2 * depth * v wide,
+ *		   v being the fastest speed measured at the exchange plus depth steps of the largest acceleration. A ghost outside that
+ *		   region is further from any boid still being updated than either can close in the steps left.
+ *		   With depth set to auto the depth is picked after DEEP_HALO_WARMUP exchanges, from the measured exchange time and the
+ *		   measured cost of the extra ghost updates each depth would need.
+ */
+template <int Dim>
+class DeepHalo
+{
+public:
+	typedef BoidT<Dim> Boid;
+
+	DeepHalo(int depth, float sight_range, float max_acceleration, int start, int end, int rank);
+
+	bool IsEnabled() const;
+	void Mark(const vector<Boid> &boids);
+	void Update(NeighbourSearchT<Dim> &grid, const BoidParameters &parameters, bool tiled, vector<Boid> &boids);
+	bool NeedsExchange() const;
+	void Synchronise(NeighbourSearchT<Dim> &grid, vector<Boid> &boids, double exchange_time);
+
+	int GetDepth() const;
+	int GetExchanges() const;
+	double GetGhostFraction() const;
+
+private:
+
+	bool automatic_ = false;	//Depth is tuned after the warm up
+	int depth_ = 0;				//Steps between exchanges, 0 when disabled
+	int substep_ = 0;			//Steps since the last exchange
+	float sight_range_;
+	float max_acceleration_;	//Largest speed any boid gains in a step
+	float speed_ = 0;			//Fastest boid of the flock at the last exchange
+	int start_;					//Owned boids
+	int end_;
+	int rank_;
+	vector<int> last_substep_;	//Last substep each boid is updated in before the next exchange, -1 if never
+	vector<vector<int>> active_; //Boids updated in each substep
+	vector<char> mask_;			//Boids updated in the current substep, for the tiled kernel
+	int exchanges_ = 0;
+	long long updates_ = 0;		//Boid updates made, owned and ghost
+	long long owned_updates_ = 0;
+	double compute_time_ = 0;	//Measured over the warm up, for tuning
+	double exchange_time_ = 0;
+
+	void Levels(const vector<Boid> &boids, int depth, vector<int> &levels) const;
+	void Tune(const vector<Boid> &boids);
+};
@@ -0,0 +1,181 @@
+#include "pch.h"
+#include "ensemble.h"
+#include <fstream>
+#include <sstream>
+
+/*! \file ensemble.cpp
+	\brief Running many small independent simulations in one process for parameter sweeps.
+*/
+
+using namespace std;
+using namespace Eigen;
+
+/**
+ * \brief  Reads ensemble members from a sweep file. Each non empty line not starting with # holds
+ *		   boid_number cohesion_factor alignment_factor separation_factor sight_range seed
+ * \param  file_name | Path of the sweep file
+ * \param  defaults | Parameters for anything not given per member (interaction rule)
+ * \return  | Members in file order, empty if the file could not be read
+ */
+vector<EnsembleMember> ReadEnsemble(const string &file_name, const BoidParameters &defaults)
+{
+	vector<EnsembleMember> members;
+	ifstream file(file_name);
+	string line;
+
+	while (getline(file, line))
+	{
+		if (line.empty() || line[0] == '#')
+		{
+			continue;
+		}
+
+		istringstream values(line);
+		EnsembleMember member{};
+		member.parameters = defaults;
+
+		if (values >> member.boid_number >> member.parameters.cohesion_factor >> member.parameters.alignment_factor
+			>> member.parameters.separation_factor >> member.parameters.sight_range >> member.seed)
+		{
+			members.push_back(member);
+		}
+		else
+		{
+			printf("Skipping malformed ensemble line: %s\n", line.c_str());
+		}
+	}
+
+	return members;
+}
+
+/**
+ * \brief  Order parameter of a flock, the magnitude of the mean unit heading.
+ * \param  boids | Boids to measure
+ * \return  | Polarisation between 0 (disordered) and 1 (aligned), 0 for a member with no boids
+ */
+static float Polarisation(vector<Boid> &boids)
+{
+	Vector3f heading_sum = Vector3f::Zero();
+
+	for (Boid &boid : boids)
+	{
+		Vector3f velocity = boid.GetVelocity();
+		if (velocity.squaredNorm() > 0)
+		{
+			heading_sum += velocity.normalized();
+		}
+	}
+
+	return boids.empty() ? 0 : heading_sum.norm() / boids.size();
+}
+
+/**
+ * \brief  Runs one member to completion on the calling thread.
+ * \param  member | Member to run, results are written back into it
+ * \param  search | Neighbour search backend
+ * \param  scenario | Initial conditions, generated from the members seed
+ * \param  steps | Number of steps
+ */
+static void RunMember(EnsembleMember &member, SearchBackend search, Scenario scenario, int steps)
+{
+	int size = 1;
+
+	vector<Boid> boids(member.boid_number);
+	vector<int> grid_updates;
+
+	GenerateBoids(boids, 0, member.boid_number, scenario, member.seed);
+
+	unique_ptr<NeighbourSearch> grid = CreateNeighbourSearch(search, boids, member.parameters.sight_range);
+
+	double start_time = omp_get_wtime();
+	for (int step = 0; step < steps; step++)
+	{
+		for (int boid = 0; boid < member.boid_number; boid++)
+		{
+			grid->UpdateNearCells(boids[boid]);
+			boids[boid].Update(member.parameters);
+		}
+
+		if (member.parameters.synchronous)
+		{
+			for (int boid = 0; boid < member.boid_number; boid++)
+			{
+				boids[boid].Integrate();
+			}
+		}
+
+		for (int boid = 0; boid < member.boid_number; boid++)
+		{
+			grid->UpdateGrid(boids[boid], grid_updates, size);
+		}
+		grid->Rebuild();
+	}
+	member.time_taken = omp_get_wtime() - start_time;
+	member.polarisation = Polarisation(boids);
+}
+
+/**
+ * \brief  Main function for ensemble runs. Members are dealt round robin to MPI ranks, each rank runs its
+ *		   members concurrently, one per thread of its team, then results are reduced to the master for the summary.
+ * \param  rank | MPI node rank
+ * \param  size | Number of MPI ranks
+ * \param  options | Run time options, options.ensemble_file names the sweep file
+ */
+void run_ensemble(int rank, int size, const SimulationOptions &options)
+{
+	vector<EnsembleMember> members = ReadEnsemble(options.ensemble_file, options.parameters);
+	int member_number = members.size();
+	vector<double> results(2 * member_number, 0.0); //time taken and polarisation per member, zero on ranks that do not own it
+
+	double start_time = MPI_Wtime();
+
+	//Members differ in size, so each idle thread takes the next one
+	int local_number = member_number > rank ? (member_number - rank + size - 1) / size : 0;
+	#pragma omp parallel for schedule(dynamic, 1)
+	for (int index = 0; index < local_number; index++)
+	{
+		RunMember(members[rank + index * size], options.search, options.scenario, options.steps);
+	}
+
+	double time_taken = MPI_Wtime() - start_time;
+
+	for (int member = rank; member < member_number; member += size)
+	{
+		results[2 * member] = members[member].time_taken;
+		results[2 * member + 1] = members[member].polarisation;
+	}
+
+	vector<double> all_results(2 * member_number);
+	double total_time;
+	MPI_Reduce(results.data(), all_results.data(), 2 * member_number, MPI_DOUBLE, MPI_SUM, MASTER, MPI_COMM_WORLD);
+	MPI_Reduce(&time_taken, &total_time, 1, MPI_DOUBLE, MPI_MAX, MASTER, MPI_COMM_WORLD);
+
+	if (rank != MASTER)
+	{
+		return;
+	}
+
+	printf("*******Ensemble Completed*******\n");
+	printf(" %6s %7s %9s %9s %10s %7s %10s %9s %10s %12s\n", "Member", "Boids", "Cohesion", "Alignment", "Separation", "Sight", "Seed", "Time/s", "Steps/s", "Polarisation");
+	for (int member = 0; member < member_number; member++)
+	{
+		EnsembleMember &m = members[member];
+		double member_time = all_results[2 * member];
+		printf(" %6d %7d %9.3f %9.3f %10.3f %7.1f %10u %9.3f %10.1f %12.4f\n", member, m.boid_number, m.parameters.cohesion_factor,
+			m.parameters.alignment_factor, m.parameters.separation_factor, m.parameters.sight_range, m.seed,
+			member_time, options.steps / member_time, all_results[2 * member + 1]);
+	}
+	printf(" --------------------------------\n");
+	printf("|  Ensemble Members  |%10d|\n", member_number);
+	printf(" --------------------------------\n");
+	printf("|  Number of Steps   |%10d|\n", options.steps);
+	printf(" --------------------------------\n");
+	printf("|   Number of Nodes  |%10d|\n", size);
+	printf(" --------------------------------\n");
+	printf("|  Total Processors  |%10d|\n", size*omp_get_max_threads());
+	printf(" --------------------------------\n");
+	printf("|    Time taken/s    |%10f|\n", total_time);
+	printf(" --------------------------------\n");
+	printf("| Member steps/s     |%10.1f|\n", double(member_number) * options.steps / total_time);
+	printf(" --------------------------------\n");
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include "pch.h"
+#include "boid.h"
+#include "neighbour_search.h"
+#include "options.h"
+#include "Eigen/Dense"
+#include "omp.h"
+#include <mpi.h>
+#include <vector>
+#include <random>
+#include <string>
+#include <cstdio>
+
+/**
+ * \brief  One independent simulation of an ensemble run and its results.
+ */
+struct EnsembleMember
+{
+	int boid_number;
+	BoidParameters parameters;
+	unsigned int seed;
+	double time_taken;	//Wall time spent stepping the member
+	float polarisation; //Order parameter |mean heading| after the last step, 1 for a fully aligned flock
+};
+
+vector<EnsembleMember> ReadEnsemble(const string &file_name, const BoidParameters &defaults);
+
+void run_ensemble(int rank, int size, const SimulationOptions &options);
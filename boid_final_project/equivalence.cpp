@@ -0,0 +1,270 @@
+#include "pch.h"
+#include "equivalence.h"
+#include <algorithm>
+#include <cmath>
+
+/*! \file equivalence.cpp
+	\brief Checks that every backend, kernel, schedule, thread count and rank count evolves the same flock.
+*/
+
+using namespace std;
+using namespace Eigen;
+
+constexpr int PATHS_TAG = 9;	//Paths of a case from each of its ranks to the master
+
+/**
+ * \brief  Runs one case on the first case.ranks ranks of MPI_COMM_WORLD and collects its paths, in boid order, on the master.
+ *		   The other ranks wait, so every rank must call this for every case.
+ * \param  equivalence_case | Case to run
+ * \param  rank | MPI_COMM_WORLD rank
+ * \param  paths | Paths of every boid at every step, filled on the master
+ */
+template <int Dim>
+static void RunCase(const EquivalenceCase &equivalence_case, int rank, vector<Matrix<float, Dim, 1>> &paths)
+{
+	int ranks = equivalence_case.ranks;
+	int steps = equivalence_case.options.steps;
+	int boids_per_worker_node = BOID_NUMBER / ranks;
+	vector<Matrix<float, Dim, 1>> own_paths;
+
+	MPI_Comm_split(MPI_COMM_WORLD, rank < ranks ? 0 : 1, rank, &compute_comm);
+	omp_set_num_threads(equivalence_case.threads);
+
+	if (rank < ranks)
+	{
+		Simulation<Dim> simulation(equivalence_case.options, rank, ranks);
+		int start = simulation.GetStart();
+		int end = simulation.GetEnd();
+		int boid_number = end - start;
+		own_paths.resize(size_t(boid_number) * steps);
+
+		simulation.AddHook([&](int step, Simulation<Dim> &simulation)
+		{
+			const BoidT<Dim> *boids = simulation.GetOwnedBoids();
+			for (int boid = start; boid < end; boid++)
+			{
+				own_paths[MultiPathIndice(boid, step, boid_number, start)] = boids[boid - start].GetPosition();
+			}
+		});
+		simulation.Run(steps);
+	}
+
+	MPI_Comm_free(&compute_comm);
+	compute_comm = MPI_COMM_WORLD;
+	omp_set_num_threads(THREAD_NUM);
+
+	if (rank != MASTER)
+	{
+		if (rank < ranks)
+		{
+			SendChunked(own_paths.data(), own_paths.size() * Dim, MPI_FLOAT, MASTER, PATHS_TAG, MPI_COMM_WORLD);
+		}
+		return;
+	}
+
+	//Every rank's paths are step major over its own boids, interleave them into step major over all boids
+	paths.resize(size_t(BOID_NUMBER) * steps);
+	for (int node = 0; node < ranks; node++)
+	{
+		int start = node == MASTER ? (ranks - 1) * boids_per_worker_node : (node - 1) * boids_per_worker_node;
+		int boid_number = node == MASTER ? BOID_NUMBER - start : boids_per_worker_node;
+		vector<Matrix<float, Dim, 1>> node_paths(size_t(boid_number) * steps);
+
+		if (node == MASTER)
+		{
+			node_paths = own_paths;
+		}
+		else
+		{
+			ReceiveChunked(node_paths.data(), node_paths.size() * Dim, MPI_FLOAT, node, PATHS_TAG, MPI_COMM_WORLD);
+		}
+
+		for (int step = 0; step < steps; step++)
+		{
+			copy(node_paths.begin() + size_t(step) * boid_number, node_paths.begin() + size_t(step + 1) * boid_number, paths.begin() + PathIndice(start, step, BOID_NUMBER));
+		}
+	}
+}
+
+/**
+ * \brief  Distance along one axis between the same boid in two runs, using the minimum image across the periodic boundary.
+ * \param  position | Position in one run
+ * \param  reference | Position in the other
+ * \param  axis | Axis to compare
+ * \return  | Deviation along the axis
+ */
+template <int Dim>
+static double AxisDeviation(const Matrix<float, Dim, 1> &position, const Matrix<float, Dim, 1> &reference, int axis)
+{
+	double deviation = fabs(double(position[axis]) - reference[axis]);
+	return min(deviation, LENGTH - deviation);
+}
+
+/**
+ * \brief  Largest distance between the same boid in two runs at any step.
+ * \param  paths | Paths of one run
+ * \param  reference | Paths of the other
+ * \return  | Largest deviation along any axis
+ */
+template <int Dim>
+static double MaxDeviation(const vector<Matrix<float, Dim, 1>> &paths, const vector<Matrix<float, Dim, 1>> &reference)
+{
+	double max_deviation = 0;
+
+	for (size_t i = 0; i < paths.size(); i++)
+	{
+		for (int axis = 0; axis < Dim; axis++)
+		{
+			max_deviation = max(max_deviation, AxisDeviation(paths[i], reference[i], axis));
+		}
+	}
+
+	return max_deviation;
+}
+
+/**
+ * \brief  Counts the boids that are further than VALIDATE_TOLERANCE from themselves in the other run at some step.
+ * \param  paths | Paths of one run
+ * \param  reference | Paths of the other
+ * \return  | Number of boids past the tolerance
+ */
+template <int Dim>
+static int CountOutliers(const vector<Matrix<float, Dim, 1>> &paths, const vector<Matrix<float, Dim, 1>> &reference)
+{
+	vector<char> outlier(BOID_NUMBER, 0);
+
+	for (size_t i = 0; i < paths.size(); i++)
+	{
+		for (int axis = 0; axis < Dim; axis++)
+		{
+			outlier[i % BOID_NUMBER] |= AxisDeviation(paths[i], reference[i], axis) > VALIDATE_TOLERANCE;
+		}
+	}
+
+	return count(outlier.begin(), outlier.end(), 1);
+}
+
+/**
+ * \brief  Runs a fixed seed clustered flock for VALIDATE_STEPS synchronous steps in every way the simulation can be run and
+ *		   compares the paths of every boid at every step. Synchronous updates make the result independent of update order, so
+ *		   runs that only change the thread count or the schedule must match bit for bit. Other kernels, backends and rank counts,
+ *		   and the shared window, which gathers tiles from the window, visit neighbours in another order and must stay within
+ *		   VALIDATE_TOLERANCE, bar at most VALIDATE_OUTLIERS boids, which must still stay within VALIDATE_OUTLIER_TOLERANCE.
+ *		   Fixed point runs are checked the same way against a fixed point single node run.
+ *		   Multi-node cases use the first 2 to size ranks. The master prints a table of the cases.
+ * \param  rank | MPI_COMM_WORLD rank
+ * \param  size | Number of MPI ranks
+ * \param  options | Run time options, --seed picks the seed and --fast-math the accuracy of every case
+ * \return  | Boolean indicating if every case agreed with its reference, on the master
+ */
+template <int Dim>
+bool CheckEquivalence(int rank, int size, SimulationOptions options)
+{
+	options.steps = VALIDATE_STEPS;
+	options.scenario = Scenario::Clusters;
+	options.seed = options.seeded ? options.seed : VALIDATE_SEED;
+	options.parameters.synchronous = true;
+	options.save = SaveFormat::None;
+	options.analytics_interval = 0;
+	options.stream_interval = 0;
+	options.io_ranks = 0;
+
+	SimulationOptions tiled = options, cells = options, kd_tree = options, hashed = options, adaptive = options, dynamic = options;
+	tiled.tiled = true;
+	cells.search = SearchBackend::SortedCells;
+	kd_tree.search = SearchBackend::KdTree;
+	hashed.search = SearchBackend::Hashed;
+	adaptive.schedule = ScheduleMode::Adaptive;
+	dynamic.schedule = ScheduleMode::Dynamic;
+	SimulationOptions tiled_adaptive = tiled;
+	tiled_adaptive.schedule = ScheduleMode::Adaptive;
+	SimulationOptions fixed = options;
+	fixed.fixed_point = true;
+	fixed.search = SearchBackend::Grid;
+	SimulationOptions fixed_tiled = fixed;
+	fixed_tiled.tiled = true;
+
+	vector<EquivalenceCase> cases = {
+		{ "single node", options, 1, 1, 0, true },
+		{ "single node rerun", options, 1, 1, 0, true },
+		{ "threads, guided", options, 1, THREAD_NUM, 0, true },
+		{ "threads, dynamic", dynamic, 1, THREAD_NUM, 0, true },
+		{ "threads, adaptive", adaptive, 1, THREAD_NUM, 0, true },
+		{ "tiled SIMD kernel", tiled, 1, 1, 0, false },
+		{ "tiled, adaptive", tiled_adaptive, 1, THREAD_NUM, 5, true }
+	};
+	if (Dim == 3)
+	{
+		cases.push_back({ "sorted cells", cells, 1, THREAD_NUM, 0, false });
+		cases.push_back({ "k-d tree", kd_tree, 1, THREAD_NUM, 0, false });
+		cases.push_back({ "hashed grid", hashed, 1, THREAD_NUM, 0, false });
+	}
+
+	//Fixed point boids also see across the periodic boundary, so they are checked against their own single node run
+	int fixed_reference = cases.size();
+	cases.push_back({ "fixed point", fixed, 1, 1, fixed_reference, true });
+	cases.push_back({ "fixed point, threads", fixed, 1, THREAD_NUM, fixed_reference, true });
+	cases.push_back({ "fixed point, tiled", fixed_tiled, 1, THREAD_NUM, fixed_reference, false });
+
+	for (int ranks = 2; ranks <= size; ranks++)
+	{
+		SimulationOptions shared = options, halo = options, fixed_shared = fixed;
+		shared.shared_window = true;
+		halo.halo_depth = 2;
+		fixed_shared.shared_window = true;
+
+		int replicated = cases.size();
+		cases.push_back({ to_string(ranks) + " ranks", options, ranks, THREAD_NUM, 0, false });
+		cases.push_back({ to_string(ranks) + " ranks, shared window", shared, ranks, THREAD_NUM, replicated, false });
+		cases.push_back({ to_string(ranks) + " ranks, tiled", tiled, ranks, THREAD_NUM, 5, false });
+		cases.push_back({ to_string(ranks) + " ranks, halo 2", halo, ranks, THREAD_NUM, 0, false });
+		int fixed_replicated = cases.size();
+		cases.push_back({ to_string(ranks) + " ranks, fixed point", fixed, ranks, THREAD_NUM, fixed_reference, false });
+		cases.push_back({ to_string(ranks) + " ranks, fixed shared", fixed_shared, ranks, THREAD_NUM, fixed_replicated, false });
+	}
+
+	vector<vector<Matrix<float, Dim, 1>>> paths(cases.size());
+	for (int i = 0; i < cases.size(); i++)
+	{
+		RunCase(cases[i], rank, paths[i]);
+	}
+
+	if (rank != MASTER)
+	{
+		return true;
+	}
+
+	bool passed = true;
+
+	printf("Equivalence check: %d boids, %d steps, %dD, seed %llu\n", BOID_NUMBER, options.steps, Dim, (unsigned long long)options.seed);
+	printf(" ---------------------------------------------------------------------------------------\n");
+	printf("| %-28s | Ranks | Threads |  Against  | Max deviation | Outliers |\n", "Case");
+	printf(" ---------------------------------------------------------------------------------------\n");
+
+	for (int i = 1; i < cases.size(); i++)
+	{
+		const EquivalenceCase &equivalence_case = cases[i];
+		if (equivalence_case.reference == i)
+		{
+			continue; //a reference run, like case 0
+		}
+
+		double deviation = MaxDeviation(paths[i], paths[equivalence_case.reference]);
+		int outliers = CountOutliers(paths[i], paths[equivalence_case.reference]);
+		bool agrees = equivalence_case.bitwise ? paths[i] == paths[equivalence_case.reference] :
+			outliers <= VALIDATE_OUTLIERS && deviation <= VALIDATE_OUTLIER_TOLERANCE;
+		passed = passed && agrees;
+
+		printf("| %-28s | %5d | %7d | %2d %-6s |  %.4e  | %8d | %s\n", equivalence_case.name.c_str(), equivalence_case.ranks, equivalence_case.threads,
+			equivalence_case.reference, equivalence_case.bitwise ? "bits" : "within", deviation, outliers, agrees ? "ok" : "FAILED");
+	}
+
+	printf(" ---------------------------------------------------------------------------------------\n");
+	printf("Tolerance %e with at most %d outliers within %e, case 0 is the single node run on one thread and case %d the same in fixed point\n",
+		VALIDATE_TOLERANCE, VALIDATE_OUTLIERS, VALIDATE_OUTLIER_TOLERANCE, fixed_reference);
+
+	return passed;
+}
+
+template bool CheckEquivalence<2>(int, int, SimulationOptions);
+template bool CheckEquivalence<3>(int, int, SimulationOptions);
@@ -0,0 +1,26 @@
+#pragma once
+#include "pch.h"
+#include "preprocessor.h"
+#include "options.h"
+#include "simulation.h"
+#include "communication.h"
+#include "Eigen/Dense"
+#include <mpi.h>
+#include <string>
+#include <vector>
+
+/**
+ * \brief  One way of running the check flock, and what it must agree with.
+ */
+struct EquivalenceCase
+{
+	string name;
+	SimulationOptions options;
+	int ranks;				//Compute ranks, the first ranks of MPI_COMM_WORLD
+	int threads;			//OpenMP threads per rank
+	int reference;			//Case whose paths it is compared with
+	bool bitwise;			//Paths must match exactly, otherwise within VALIDATE_TOLERANCE
+};
+
+template <int Dim>
+bool CheckEquivalence(int rank, int size, SimulationOptions options);
@@ -0,0 +1,178 @@
+#include "pch.h"
+#include "fast_math.h"
+#include <cstdio>
+#include <algorithm>
+#include <vector>
+#include "omp.h"
+
+/*! \file fast_math.cpp
+	\brief Accuracy levels of the approximate reciprocal square root and their validation.
+*/
+
+/**
+ * \brief  Documented bound on the relative error of InverseSqrt at an accuracy level.
+ *		   Bounds sit just above the errors CheckFastMath measures so the check catches any regression.
+ * \param  accuracy | Accuracy level
+ * \return  | Maximum relative error
+ */
+float MaxRelativeError(SqrtAccuracy accuracy)
+{
+	switch (accuracy)
+	{
+	case SqrtAccuracy::Coarse:
+		return 3.5e-2f;
+	case SqrtAccuracy::Refined:
+		return 1.8e-3f;
+	case SqrtAccuracy::Precise:
+		return 5e-6f;
+	default:
+		return 2.5e-7f;
+	}
+}
+
+/**
+ * \brief  Converts a command line name into an accuracy level.
+ * \param  name | One of "exact", "coarse", "refined" or "precise"
+ * \param  accuracy | Set to the matching level if the name is recognised
+ * \return  | Boolean indicating if the name was recognised
+ */
+bool ParseSqrtAccuracy(const string &name, SqrtAccuracy &accuracy)
+{
+	if (name == "exact")
+	{
+		accuracy = SqrtAccuracy::Exact;
+	}
+	else if (name == "coarse")
+	{
+		accuracy = SqrtAccuracy::Coarse;
+	}
+	else if (name == "refined")
+	{
+		accuracy = SqrtAccuracy::Refined;
+	}
+	else if (name == "precise")
+	{
+		accuracy = SqrtAccuracy::Precise;
+	}
+	else
+	{
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * \brief  Name of an accuracy level for printing in the run summary.
+ * \param  accuracy | Level to name
+ * \return  | Printable name, matching what ParseSqrtAccuracy accepts
+ */
+const char* SqrtAccuracyName(SqrtAccuracy accuracy)
+{
+	switch (accuracy)
+	{
+	case SqrtAccuracy::Coarse:
+		return "coarse";
+	case SqrtAccuracy::Refined:
+		return "refined";
+	case SqrtAccuracy::Precise:
+		return "precise";
+	default:
+		return "exact";
+	}
+}
+
+/**
+ * \brief  Times InverseSqrt over an array in an omp simd loop, the form it takes in the tiled kernel.
+ * \param  values | Positive inputs
+ * \return  | Nanoseconds per reciprocal square root
+ */
+template <int NewtonSteps>
+static double TimeInverseSqrt(const vector<float> &values)
+{
+	const int repeats = 200;
+	const float *x = values.data();
+	int size = values.size();
+	float sum = 0;
+
+	double start_time = omp_get_wtime();
+	for (int repeat = 0; repeat < repeats; repeat++)
+	{
+		#pragma omp simd reduction(+:sum)
+		for (int i = 0; i < size; i++)
+		{
+			sum += InverseSqrt<NewtonSteps>(x[i]);
+		}
+	}
+	double end_time = omp_get_wtime();
+
+	volatile float sink = sum; //keeps the loop from being optimised away
+	(void)sink;
+
+	return 1e9 * (end_time - start_time) / (double(repeats) * size);
+}
+
+/**
+ * \brief  Times InverseSqrt at an accuracy level.
+ * \param  values | Positive inputs
+ * \param  accuracy | Accuracy level
+ * \return  | Nanoseconds per reciprocal square root
+ */
+static double TimeInverseSqrt(const vector<float> &values, SqrtAccuracy accuracy)
+{
+	switch (accuracy)
+	{
+	case SqrtAccuracy::Coarse:
+		return TimeInverseSqrt<0>(values);
+	case SqrtAccuracy::Refined:
+		return TimeInverseSqrt<1>(values);
+	case SqrtAccuracy::Precise:
+		return TimeInverseSqrt<2>(values);
+	default:
+		return TimeInverseSqrt<-1>(values);
+	}
+}
+
+/**
+ * \brief  Compares InverseSqrt at every accuracy level against a double precision reference for every float in [1, 4).
+ *		   The estimate scales exactly under x -> 4x, so this range covers every normal float.
+ *		   Also reports the cost of each level relative to the exact path.
+ * \return  | Boolean indicating if every level stayed within its documented bound
+ */
+bool CheckFastMath()
+{
+	const SqrtAccuracy levels[] = { SqrtAccuracy::Exact, SqrtAccuracy::Coarse, SqrtAccuracy::Refined, SqrtAccuracy::Precise };
+	bool passed = true;
+	vector<float> values(1 << 14);
+	for (int i = 0; i < values.size(); i++)
+	{
+		values[i] = 1.0f + 3.0f * i / values.size();
+	}
+	double exact_time = 0;
+
+	printf(" ----------------------------------------------------------------\n");
+	printf("| Accuracy | Max rel error |    Bound     |  ns/call  | Speedup |\n");
+	printf(" ----------------------------------------------------------------\n");
+
+	for (SqrtAccuracy accuracy : levels)
+	{
+		int newton_steps = NewtonSteps(accuracy);
+		double max_error = 0;
+
+		for (float x = 1.0f; x < 4.0f; x = nextafter(x, 4.0f))
+		{
+			double error = fabs(double(InverseSqrt(x, newton_steps)) * sqrt(double(x)) - 1.0);
+			max_error = max(max_error, error);
+		}
+
+		bool within = max_error <= MaxRelativeError(accuracy);
+		passed = passed && within;
+		double time = TimeInverseSqrt(values, accuracy);
+		exact_time = accuracy == SqrtAccuracy::Exact ? time : exact_time;
+		printf("| %8s |  %.4e   |  %.4e  | %9.3f | %7.2f | %s\n", SqrtAccuracyName(accuracy), max_error, MaxRelativeError(accuracy), time, exact_time / time, within ? "ok" : "FAILED");
+	}
+
+	printf(" ----------------------------------------------------------------\n");
+
+	return passed;
+}
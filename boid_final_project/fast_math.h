@@ -0,0 +1,90 @@
+#pragma once
+#include "pch.h"
+#include "preprocessor.h"
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <string>
+
+using namespace std;
+
+/**
+ * \brief  Accuracy of the reciprocal square roots used for neighbour distances and vector normalisation.
+ *		   The approximate levels start from the bit level estimate of 1/sqrt(x) and apply Newton steps to it.
+ *		   Maximum relative errors are measured over every float by CheckFastMath.
+ */
+enum class SqrtAccuracy
+{
+	Exact,	 //!< Library sqrt and divide.
+	Coarse,	 //!< Bit level estimate only, max relative error 3.44e-2.
+	Refined, //!< One Newton step, max relative error 1.76e-3.
+	Precise	 //!< Two Newton steps, max relative error 4.8e-6.
+};
+
+/**
+ * \brief  Number of Newton steps an accuracy level applies, -1 for the exact path.
+ * \param  accuracy | Accuracy level
+ * \return  | Newton steps
+ */
+inline int NewtonSteps(SqrtAccuracy accuracy)
+{
+	return int(accuracy) - 1;
+}
+
+/**
+ * \brief  Reciprocal square root with the Newton count fixed at compile time, so the function is branch free
+ *		   and vectorises inside omp simd loops on any instruction set.
+ * \param  x | Positive value
+ * \return  | 1/sqrt(x), exact when NewtonSteps is negative
+ */
+template <int NewtonSteps>
+inline float InverseSqrt(float x)
+{
+	if (NewtonSteps < 0)
+	{
+		return 1.0f / sqrt(x);
+	}
+
+	uint32_t bits;
+	memcpy(&bits, &x, sizeof(bits));
+	bits = RSQRT_MAGIC - (bits >> 1);
+
+	float estimate;
+	memcpy(&estimate, &bits, sizeof(estimate));
+
+	for (int step = 0; step < NewtonSteps; step++)
+	{
+		estimate = estimate * (1.5f - 0.5f * x * estimate * estimate);
+	}
+
+	return estimate;
+}
+
+/**
+ * \brief  Reciprocal square root with the Newton count chosen at run time, for scalar call sites.
+ * \param  x | Positive value
+ * \param  newton_steps | Newton refinements of the initial estimate, negative for the exact 1/sqrt(x)
+ * \return  | 1/sqrt(x)
+ */
+inline float InverseSqrt(float x, int newton_steps)
+{
+	switch (newton_steps)
+	{
+	case 0:
+		return InverseSqrt<0>(x);
+	case 1:
+		return InverseSqrt<1>(x);
+	case 2:
+		return InverseSqrt<2>(x);
+	default:
+		return InverseSqrt<-1>(x);
+	}
+}
+
+float MaxRelativeError(SqrtAccuracy accuracy);
+
+bool ParseSqrtAccuracy(const string &name, SqrtAccuracy &accuracy);
+
+const char* SqrtAccuracyName(SqrtAccuracy accuracy);
+
+bool CheckFastMath();
@@ -0,0 +1,327 @@
+#include "pch.h"
+#include "hashed_grid.h"
+
+/*! \file hashed_grid.cpp
+	\brief Implementation of the hashed sparse spatial grid
+*/
+
+/**
+ * \brief  Creates an empty table and hashes all boids into it.
+ * \param  boids | Boids to index. Referenced, not copied.
+ * \param  sight_range | Interaction cutoff the structure must cover
+ */
+HashedGrid::HashedGrid(vector<Boid>& boids, float sight_range) : boids_(boids)
+{
+	cell_num = max(int(floor(LENGTH / sight_range)), 1); // same sizing as SpatialGrid so 27 adjacent cells contain all boids within range
+	cell_length = float(LENGTH) / float(cell_num);
+	occupied_ = 0;
+	sorted_boids_.resize(boids.size());
+	boid_key_.resize(boids.size());
+	boid_cell_.resize(boids.size());
+	Resize(16);
+	Rebuild();
+}
+
+/**
+ * \brief  Looks up the 27 cells surrounding the boid. Empty cells are simply absent from the table and skipped.
+ * \param  boid | The boid to update
+ */
+void HashedGrid::UpdateNearCells(Boid & boid)
+{
+	Vector3f position = boid.GetPosition();
+	int coord[SYS_DIM];
+
+	for (int i = 0; i < SYS_DIM; i++)
+	{
+		coord[i] = floor(position[i] / cell_length);
+		coord[i] = coord[i] < cell_num ? coord[i] : cell_num - 1;
+	}
+
+	float stencil_distances[SYS_DIM][3];
+	GetStencilDistances(position, coord, cell_length, cell_num, stencil_distances);
+	boid.neighbouring_cells_buffer_.clear();
+
+	for (int x = -1; x < 2; x++)
+	{
+		for (int y = -1; y < 2; y++)
+		{
+			for (int z = -1; z < 2; z++)
+			{
+				if (IsStencilDuplicate(x, cell_num) || IsStencilDuplicate(y, cell_num) || IsStencilDuplicate(z, cell_num))
+				{
+					continue;
+				}
+
+				//Periodic boundary conditions, matching SpatialGrid::UpdateNearCells
+				int row_x = (coord[0] + x + cell_num) % cell_num;
+				int row_y = (coord[1] + y + cell_num) % cell_num;
+				int row_z = (coord[2] + z + cell_num) % cell_num;
+
+				const Slot* slot = Find(GetKey(row_x, row_y, row_z));
+
+				if (slot != nullptr)
+				{
+					float distance_squared = stencil_distances[0][x + 1] + stencil_distances[1][y + 1] + stencil_distances[2][z + 1];
+					boid.neighbouring_cells_buffer_.push_back({ sorted_boids_.data() + slot->begin, sorted_boids_.data() + slot->end, distance_squared });
+				}
+			}
+		}
+	}
+}
+
+/**
+ * \brief  Table is rebuilt from scratch each step so no incremental updates are tracked.
+ * \return  | Always false
+ */
+bool HashedGrid::UpdateGrid(Boid &, vector<int>&, int &)
+{
+	return false;
+}
+
+/**
+ * \brief  Table is rebuilt from scratch each step so updates from other nodes are ignored.
+ */
+void HashedGrid::UpdateGrid(Boid &, int, int)
+{
+}
+
+/**
+ * \brief  Hashes every boid into its cell, counting sorts the boid pointers by cell and records each cells range in its slot.
+ *		   Table is shrunk when occupancy has fallen well below capacity so memory tracks the occupied cell count.
+ */
+void HashedGrid::Rebuild()
+{
+	int boid_number = boids_.size();
+
+	uint64_t capacity = table_.size();
+
+	while (capacity > 16 && uint64_t(occupied_) * 16 < capacity)
+	{
+		capacity /= 2;
+	}
+
+	table_.assign(capacity, { EMPTY_KEY, 0, 0 });
+	SetCapacity(capacity);
+	occupied_ = 0;
+	cell_start_.clear();
+
+	#pragma omp parallel for schedule(static)
+	for (int boid = 0; boid < boid_number; boid++)
+	{
+		boid_key_[boid] = GetKey(boids_[boid].GetPosition());
+	}
+
+	for (int boid = 0; boid < boid_number; boid++)
+	{
+		boid_cell_[boid] = Insert(boid_key_[boid]);
+	}
+
+	cell_start_.resize(occupied_ + 1, 0);
+
+	for (int boid = 0; boid < boid_number; boid++)
+	{
+		cell_start_[boid_cell_[boid] + 1]++;
+	}
+	for (int cell = 1; cell < int(cell_start_.size()); cell++)
+	{
+		cell_start_[cell] += cell_start_[cell - 1];
+	}
+
+	for (Slot &slot : table_)
+	{
+		if (slot.key != EMPTY_KEY)
+		{
+			int cell = slot.begin;
+			slot.begin = cell_start_[cell];
+			slot.end = cell_start_[cell + 1];
+		}
+	}
+
+	for (int boid = 0; boid < boid_number; boid++)
+	{
+		sorted_boids_[cell_start_[boid_cell_[boid]]++] = &boids_[boid]; // cell_start_ consumed as insert position, slots already hold the ranges
+	}
+}
+
+/**
+ * \brief  Packs 3D cell co-ordinates into a single 64 bit key, 21 bits per axis.
+ * \param  x | Cell x co-ordinate
+ * \param  y | Cell y co-ordinate
+ * \param  z | Cell z co-ordinate
+ * \return  | Cell key
+ */
+uint64_t HashedGrid::GetKey(int x, int y, int z) const
+{
+	return (uint64_t(x) << 42) | (uint64_t(y) << 21) | uint64_t(z);
+}
+
+/**
+ * \brief  Works out the key of the cell containing a position.
+ * \param  position | Position to locate
+ * \return  | Cell key
+ */
+uint64_t HashedGrid::GetKey(const Vector3f & position) const
+{
+	int coord[SYS_DIM];
+
+	for (int i = 0; i < SYS_DIM; i++)
+	{
+		coord[i] = floor(position[i] / cell_length);
+		coord[i] = coord[i] < cell_num ? coord[i] : cell_num - 1; // position exactly LENGTH
+	}
+
+	return GetKey(coord[0], coord[1], coord[2]);
+}
+
+/**
+ * \brief  Home slot of a key by Fibonacci hashing: the whole packed key is multiplied by 2^64 over the golden ratio and
+ *		   the top log2(capacity) bits of the product, the best mixed, are the slot, so all three axes spread the cells over the table.
+ * \param  key | Cell key
+ * \return  | Home slot index
+ */
+uint64_t HashedGrid::GetSlot(uint64_t key) const
+{
+	return key * 0x9E3779B97F4A7C15ull >> shift_;
+}
+
+/**
+ * \brief  Inserts a key if absent, growing the table to keep the load factor at most one quarter so probe runs stay short.
+ * \param  key | Cell key
+ * \return  | Compact cell index of the key
+ */
+int HashedGrid::Insert(uint64_t key)
+{
+	if (uint64_t(occupied_ + 1) * 4 > table_.size())
+	{
+		Resize(table_.size() * 2);
+	}
+
+	for (uint64_t slot = GetSlot(key);; slot = (slot + 1) & mask_)
+	{
+		if (table_[slot].key == key)
+		{
+			return table_[slot].begin;
+		}
+		if (table_[slot].key == EMPTY_KEY)
+		{
+			table_[slot].key = key;
+			table_[slot].begin = occupied_;
+			return occupied_++;
+		}
+	}
+}
+
+/**
+ * \brief  Looks up a cell by key.
+ * \param  key | Cell key
+ * \return  | Slot of the cell, or nullptr if the cell is empty
+ */
+const HashedGrid::Slot* HashedGrid::Find(uint64_t key) const
+{
+	for (uint64_t slot = GetSlot(key);; slot = (slot + 1) & mask_)
+	{
+		if (table_[slot].key == key)
+		{
+			return &table_[slot];
+		}
+		if (table_[slot].key == EMPTY_KEY)
+		{
+			return nullptr;
+		}
+	}
+}
+
+/**
+ * \brief  Changes the table capacity and reinserts the occupied slots.
+ * \param  capacity | New capacity, a power of two
+ */
+void HashedGrid::Resize(uint64_t capacity)
+{
+	vector<Slot> old_table(capacity, { EMPTY_KEY, 0, 0 });
+	old_table.swap(table_);
+	SetCapacity(capacity);
+
+	for (const Slot &old_slot : old_table)
+	{
+		if (old_slot.key != EMPTY_KEY)
+		{
+			uint64_t slot = GetSlot(old_slot.key);
+			while (table_[slot].key != EMPTY_KEY)
+			{
+				slot = (slot + 1) & mask_;
+			}
+			table_[slot] = old_slot;
+		}
+	}
+}
+
+/**
+ * \brief  Sets the probe mask and the home slot shift for a new table capacity.
+ * \param  capacity | Table capacity, a power of two of at least 16
+ */
+void HashedGrid::SetCapacity(uint64_t capacity)
+{
+	mask_ = capacity - 1;
+	shift_ = 64;
+	while (capacity > 1)
+	{
+		capacity /= 2;
+		shift_--;
+	}
+}
+
+/**
+ * \brief  Number of table slots, for iterating over the occupied cells. Empty slots gather no residents.
+ * \return  | Slot count
+ */
+int HashedGrid::GetCellCount() const
+{
+	return table_.size();
+}
+
+/**
+ * \brief  Gives the boids resident in a slots cell and the occupied cells surrounding it.
+ * \param  cell | Table slot index
+ * \param  residents | Set to the boids in the cell, empty for an empty slot
+ * \param  neighbourhood | Filled with the occupied surrounding cells, including the cell itself
+ */
+void HashedGrid::GatherCell(int cell, CellSpan & residents, vector<CellSpan>& neighbourhood)
+{
+	const Slot &slot = table_[cell];
+	neighbourhood.clear();
+
+	if (slot.key == EMPTY_KEY)
+	{
+		residents = { nullptr, nullptr, 0 };
+		return;
+	}
+
+	uint64_t axis_mask = (uint64_t(1) << 21) - 1;
+	int coord[SYS_DIM] = { int(slot.key >> 42), int((slot.key >> 21) & axis_mask), int(slot.key & axis_mask) };
+	residents = { sorted_boids_.data() + slot.begin, sorted_boids_.data() + slot.end, 0 };
+
+	for (int x = -1; x < 2; x++)
+	{
+		for (int y = -1; y < 2; y++)
+		{
+			for (int z = -1; z < 2; z++)
+			{
+				if (IsStencilDuplicate(x, cell_num) || IsStencilDuplicate(y, cell_num) || IsStencilDuplicate(z, cell_num))
+				{
+					continue;
+				}
+
+				int row_x = (coord[0] + x + cell_num) % cell_num;
+				int row_y = (coord[1] + y + cell_num) % cell_num;
+				int row_z = (coord[2] + z + cell_num) % cell_num;
+
+				const Slot* near_slot = Find(GetKey(row_x, row_y, row_z));
+
+				if (near_slot != nullptr)
+				{
+					neighbourhood.push_back({ sorted_boids_.data() + near_slot->begin, sorted_boids_.data() + near_slot->end, 0 });
+				}
+			}
+		}
+	}
+}
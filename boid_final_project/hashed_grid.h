@@ -0,0 +1,59 @@
+#pragma once
+#include "boid.h"
+#include "neighbour_search.h"
+#include <vector>
+#include <cstdint>
+#include <math.h>
+
+/**
+ * \brief  Sparse spatial grid that only stores occupied cells, in an open addressing hash table keyed by 3D cell co-ordinate.
+ *		   Memory scales with the number of occupied cells rather than cell_num cubed, so the domain can grow while boids stay flocked.
+ *		   Rebuilt each step: boid pointers are counting sorted by cell so each table slot holds the contiguous range of its cell.
+ */
+class HashedGrid : public NeighbourSearch
+{
+public:
+	HashedGrid(vector<Boid> &boids, float sight_range);
+	~HashedGrid() = default;
+
+	void UpdateNearCells(Boid &boid) override;
+	bool UpdateGrid(Boid &boid, vector<int> &update_tracker, int &size) override;
+	void UpdateGrid(Boid &boid, int old_pos, int new_pos) override;
+	void Rebuild() override;
+	int GetCellCount() const override;
+	void GatherCell(int cell, CellSpan &residents, vector<CellSpan> &neighbourhood) override;
+
+private:
+
+	/**
+	 * \brief  Hash table slot, holding the key and the cells range of sorted_boids_ together so a lookup touches one cache line.
+	 */
+	struct Slot
+	{
+		uint64_t key;
+		int begin; //during a rebuild holds the compact cell index instead
+		int end;
+	};
+
+	static constexpr uint64_t EMPTY_KEY = ~uint64_t(0);
+
+	int cell_num;
+	float cell_length;
+	vector<Boid> &boids_;
+	vector<Slot> table_;		 //Power of two sized, linear probing
+	uint64_t mask_;
+	int shift_;					 //64 - log2 of the capacity, keeps the top bits of a hash as the home slot
+	int occupied_;				 //Number of occupied cells after the last rebuild
+	vector<Boid*> sorted_boids_; //Boid pointers ordered by compact cell index
+	vector<uint64_t> boid_key_;  //Cell key of each boid, reused between steps
+	vector<int> boid_cell_;		 //Compact cell index of each boid, reused between steps
+	vector<int> cell_start_;	 //Offset of each compact cell in sorted_boids_ during a rebuild
+
+	uint64_t GetKey(int x, int y, int z) const;
+	uint64_t GetKey(const Vector3f &position) const;
+	uint64_t GetSlot(uint64_t key) const;
+	int Insert(uint64_t key);
+	const Slot* Find(uint64_t key) const;
+	void Resize(uint64_t capacity);
+	void SetCapacity(uint64_t capacity);
+};
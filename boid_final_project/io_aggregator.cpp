@@ -0,0 +1,356 @@
+#include "pch.h"
+#include "io_aggregator.h"
+#include <chrono>
+#include <ctime>
+
+/*! \file io_aggregator.cpp
+	\brief Path output shipped to dedicated I/O server ranks during the run.
+*/
+
+using namespace std;
+using namespace Eigen;
+
+constexpr int FRAME_TAG = 7;	//Batches of frames from compute ranks to servers
+constexpr int STATS_TAG = 8;	//Server statistics to the master
+
+/**
+ * \brief  Sets up path output through I/O servers. On a compute rank this picks the server its boids go to.
+ * \param  options | Run time options, options.io_ranks servers at the end of MPI_COMM_WORLD, not used when paths are not saved
+ * \param  rank | MPI_COMM_WORLD rank
+ * \param  compute_size | Number of ranks running the simulation
+ */
+template <int Dim>
+IoAggregator<Dim>::IoAggregator(const SimulationOptions &options, int rank, int compute_size)
+	: io_ranks_(options.save == SaveFormat::None ? 0 : options.io_ranks), format_(options.save), steps_(options.steps), rank_(rank), compute_size_(compute_size), server_(0)
+{
+	if (!IsEnabled() || rank >= compute_size)
+	{
+		return;
+	}
+
+	int start, end;
+	RankRange(rank, compute_size, start, end);
+	boid_number_ = end - start;
+
+	vector<int> clients;
+	for (int server = 0; server < io_ranks_; server++)
+	{
+		Clients(server, clients);
+		if (find(clients.begin(), clients.end(), rank) != clients.end())
+		{
+			server_ = compute_size + server;
+		}
+	}
+}
+
+/**
+ * \brief  Whether paths go through I/O servers.
+ * \return  | True when enabled
+ */
+template <int Dim>
+bool IoAggregator<Dim>::IsEnabled() const
+{
+	return io_ranks_ > 0;
+}
+
+/**
+ * \brief  Called by a compute rank after every step. Every IO_BATCH steps, and after the last, the frames since the last
+ *		   batch are sent to the server without waiting. The send reads the path buffer in place, so it is never copied.
+ * \param  step | Step just completed
+ * \param  paths | Path buffer of this rank, one frame of its boids per step
+ */
+template <int Dim>
+void IoAggregator<Dim>::Ship(int step, vector<VectorD> &paths)
+{
+	if (!IsEnabled() || ((step + 1) % IO_BATCH != 0 && step != steps_ - 1))
+	{
+		return;
+	}
+
+	double start_time = MPI_Wtime();
+	int first_step = step / IO_BATCH * IO_BATCH;
+	int frame_number = step + 1 - first_step;
+
+	//Counted in frames, so a batch of a large rank never passes the int count of MPI
+	MPI_Datatype frame;
+	MPI_Type_contiguous(boid_number_ * Dim, MPI_FLOAT, &frame);
+	MPI_Type_commit(&frame);
+	requests_.push_back(MPI_REQUEST_NULL);
+	MPI_Isend(paths[size_t(first_step) * boid_number_].data(), frame_number, frame, server_, FRAME_TAG, MPI_COMM_WORLD, &requests_.back());
+	MPI_Type_free(&frame); //freed once the send completes
+
+	//Lets the MPI library progress earlier batches without blocking
+	int done;
+	MPI_Testall(requests_.size(), requests_.data(), &done, MPI_STATUSES_IGNORE);
+	wait_time_ += MPI_Wtime() - start_time;
+}
+
+/**
+ * \brief  Called by a compute rank after the last step. Waits for its batches to be delivered and, on the master, collects
+ *		   the servers statistics for the run summary.
+ */
+template <int Dim>
+void IoAggregator<Dim>::Finish()
+{
+	if (!IsEnabled())
+	{
+		return;
+	}
+
+	double start_time = MPI_Wtime();
+	MPI_Waitall(requests_.size(), requests_.data(), MPI_STATUSES_IGNORE);
+	wait_time_ += MPI_Wtime() - start_time;
+
+	if (rank_ != MASTER)
+	{
+		return;
+	}
+
+	for (int server = 0; server < io_ranks_; server++)
+	{
+		double stats[3];
+		MPI_Recv(stats, 3, MPI_DOUBLE, compute_size_ + server, STATS_TAG, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+		bytes_written_ += stats[0];
+		write_time_ = max(write_time_, stats[1]);
+		server_time_ = max(server_time_, stats[2]);
+	}
+}
+
+/**
+ * \brief  Main loop of a server rank. Receives each batch from all its ranks straight into the frame layout of its boid range,
+ *		   posting the receives of the next batch before writing the current one, and sends its statistics to the master.
+ */
+template <int Dim>
+void IoAggregator<Dim>::Serve()
+{
+	int server = rank_ - compute_size_;
+	vector<int> clients;
+	Clients(server, clients);
+
+	int first_boid = BOID_NUMBER, last_boid = 0;
+	for (int client : clients)
+	{
+		int start, end;
+		RankRange(client, compute_size_, start, end);
+		first_boid = min(first_boid, start);
+		last_boid = max(last_boid, end);
+	}
+	int boid_number = max(last_boid - first_boid, 0);
+	size_t frame_floats = size_t(boid_number) * Dim;
+	int batch_number = (steps_ + IO_BATCH - 1) / IO_BATCH;
+
+	double server_start = MPI_Wtime();
+	double write_time = 0;
+	double bytes = 0;
+	string name = "io-server-" + to_string(server);
+	ofstream file;
+
+	if (format_ == SaveFormat::Binary && boid_number > 0)
+	{
+		TrajectoryHeader header = {};
+		copy(TRAJECTORY_MAGIC, TRAJECTORY_MAGIC + sizeof(header.magic), header.magic);
+		header.version = TRAJECTORY_VERSION;
+		header.dimension = Dim;
+		header.boid_number = boid_number;
+		header.steps = steps_;
+		header.length = LENGTH;
+		header.first_boid = first_boid;
+
+		file.open(name + ".bin", ios::binary);
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	}
+	else if (boid_number > 0)
+	{
+		//Same header as WriteToFile, so data_joiner.py can join server files
+		auto now_time = chrono::system_clock::to_time_t(chrono::system_clock::now());
+		file.open(name + ".txt");
+		file << "Boid Simulation Output Results:" << endl;
+		file << "Time of Simulation: " << ctime(&now_time) << endl;
+		file << "Number of Boids: " << BOID_NUMBER << endl;
+		file << "Size of Simulation Area: " << LENGTH << endl;
+		file << "Number of Simulation Steps: " << steps_ << endl;
+		file << endl;
+	}
+
+	vector<float> buffers[2] = { vector<float>(size_t(IO_BATCH) * frame_floats), vector<float>(size_t(IO_BATCH) * frame_floats) };
+	vector<MPI_Request> requests[2];
+
+	if (boid_number > 0)
+	{
+		PostBatch(0, buffers[0].data(), clients, first_boid, frame_floats, requests[0]);
+	}
+
+	for (int batch = 0; batch < batch_number && boid_number > 0; batch++)
+	{
+		if (batch + 1 < batch_number)
+		{
+			PostBatch(batch + 1, buffers[(batch + 1) % 2].data(), clients, first_boid, frame_floats, requests[(batch + 1) % 2]);
+		}
+		MPI_Waitall(requests[batch % 2].size(), requests[batch % 2].data(), MPI_STATUSES_IGNORE);
+
+		int frame_number = min(IO_BATCH, steps_ - batch * IO_BATCH);
+		double start_time = MPI_Wtime();
+		if (format_ == SaveFormat::Binary)
+		{
+			file.write(reinterpret_cast<const char*>(buffers[batch % 2].data()), sizeof(float) * size_t(frame_number) * frame_floats);
+		}
+		else
+		{
+			WriteText(file, buffers[batch % 2].data(), frame_number, boid_number);
+		}
+		write_time += MPI_Wtime() - start_time;
+		bytes += sizeof(float) * double(frame_number) * frame_floats;
+	}
+
+	if (file.is_open())
+	{
+		double start_time = MPI_Wtime();
+		file.close();
+		write_time += MPI_Wtime() - start_time;
+	}
+
+	double stats[3] = { bytes, write_time, MPI_Wtime() - server_start };
+	MPI_Send(stats, 3, MPI_DOUBLE, MASTER, STATS_TAG, MPI_COMM_WORLD);
+}
+
+/**
+ * \brief  Number of I/O server ranks.
+ * \return  | Server count
+ */
+template <int Dim>
+int IoAggregator<Dim>::GetServerNumber() const
+{
+	return io_ranks_;
+}
+
+/**
+ * \brief  Position data received and written by all servers, known on the master after Finish.
+ * \return  | Bytes of positions
+ */
+template <int Dim>
+double IoAggregator<Dim>::GetBytesWritten() const
+{
+	return bytes_written_;
+}
+
+/**
+ * \brief  Longest time a server spent formatting and writing, known on the master after Finish.
+ * \return  | Time in seconds
+ */
+template <int Dim>
+double IoAggregator<Dim>::GetWriteTime() const
+{
+	return write_time_;
+}
+
+/**
+ * \brief  Longest server wall time from its first receive to its last write, known on the master after Finish.
+ * \return  | Time in seconds
+ */
+template <int Dim>
+double IoAggregator<Dim>::GetServerTime() const
+{
+	return server_time_;
+}
+
+/**
+ * \brief  Time this compute rank spent in Ship and Finish, its whole cost of output.
+ * \return  | Time in seconds
+ */
+template <int Dim>
+double IoAggregator<Dim>::GetWaitTime() const
+{
+	return wait_time_;
+}
+
+/**
+ * \brief  Boids updated by a compute rank, the same split as Simulation.
+ * \param  rank | Compute rank
+ * \param  compute_size | Number of compute ranks
+ * \param  start | First boid of the rank
+ * \param  end | One past the last boid of the rank
+ */
+template <int Dim>
+void IoAggregator<Dim>::RankRange(int rank, int compute_size, int &start, int &end)
+{
+	int boids_per_worker_node = BOID_NUMBER / compute_size;
+	start = rank == MASTER ? (compute_size - 1) * boids_per_worker_node : (rank - 1) * boids_per_worker_node;
+	end = rank == MASTER ? BOID_NUMBER : start + boids_per_worker_node;
+}
+
+/**
+ * \brief  Compute ranks a server serves, in boid order: the workers then the master, whose boids come last. Each server
+ *		   takes a contiguous run of them, so its boids form one range.
+ * \param  server | Server index, 0 to io_ranks - 1
+ * \param  clients | Compute ranks of the server
+ */
+template <int Dim>
+void IoAggregator<Dim>::Clients(int server, vector<int> &clients) const
+{
+	clients.clear();
+	for (int position = server * compute_size_ / io_ranks_; position < (server + 1) * compute_size_ / io_ranks_; position++)
+	{
+		clients.push_back(position == compute_size_ - 1 ? MASTER : position + 1);
+	}
+}
+
+/**
+ * \brief  Posts the receives of one batch. Each rank's frames land in its columns of the batch with a strided datatype.
+ * \param  batch | Batch index
+ * \param  frames | Batch buffer, IO_BATCH frames of the servers boid range
+ * \param  clients | Compute ranks of the server
+ * \param  first_boid | First boid of the servers range
+ * \param  frame_floats | Floats per frame
+ * \param  requests | Receive requests of the batch
+ */
+template <int Dim>
+void IoAggregator<Dim>::PostBatch(int batch, float *frames, const vector<int> &clients, int first_boid, size_t frame_floats, vector<MPI_Request> &requests)
+{
+	int frame_number = min(IO_BATCH, steps_ - batch * IO_BATCH);
+	requests.resize(clients.size());
+
+	for (int i = 0; i < clients.size(); i++)
+	{
+		int start, end;
+		RankRange(clients[i], compute_size_, start, end);
+
+		//The stride is in bytes, as a frame of the servers range can hold more floats than an int
+		MPI_Datatype row, columns;
+		MPI_Type_contiguous((end - start) * Dim, MPI_FLOAT, &row);
+		MPI_Type_create_hvector(frame_number, 1, MPI_Aint(frame_floats * sizeof(float)), row, &columns);
+		MPI_Type_commit(&columns);
+		MPI_Irecv(frames + size_t(start - first_boid) * Dim, 1, columns, clients[i], FRAME_TAG, MPI_COMM_WORLD, &requests[i]);
+		MPI_Type_free(&row);
+		MPI_Type_free(&columns); //freed once the receive completes
+	}
+}
+
+/**
+ * \brief  Formats frames in the text layout of WriteToFile, one line per step of x:y:z$ positions, and writes them as one block.
+ * \param  file | Open text file
+ * \param  frames | Frames of positions
+ * \param  frame_number | Number of frames
+ * \param  boid_number | Boids per frame
+ */
+template <int Dim>
+void IoAggregator<Dim>::WriteText(ofstream &file, const float *frames, int frame_number, int boid_number)
+{
+	ostringstream block;
+
+	for (int frame = 0; frame < frame_number; frame++)
+	{
+		for (int boid = 0; boid < boid_number; boid++)
+		{
+			for (int i = 0; i < Dim; i++)
+			{
+				block << frames[(size_t(frame) * boid_number + boid) * Dim + i] << (i == Dim - 1 ? "$" : ":");
+			}
+		}
+		block << "\n";
+	}
+
+	file << block.str();
+}
+
+template class IoAggregator<2>;
+template class IoAggregator<3>;
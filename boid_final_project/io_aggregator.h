@@ -0,0 +1,61 @@
+#pragma once
+#include "pch.h"
+#include "preprocessor.h"
+#include "boid.h"
+#include "options.h"
+#include "trajectory_format.h"
+#include "communication.h"
+#include "Eigen/Dense"
+#include <mpi.h>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+/**
+ * \brief  Path output through dedicated I/O server ranks. The last io_ranks ranks of MPI_COMM_WORLD run no simulation; each
+ *		   serves a contiguous range of the boids. Compute ranks ship every IO_BATCH frames of their paths with non blocking sends
+ *		   straight from the path buffer and never touch the file system. A server receives a batch from each of its ranks into
+ *		   the frame layout of its range, then writes the batch as one sequential block while the next batch is arriving.
+ *		   Each server writes io-server-S.txt or io-server-S.bin in the same layout as the per rank files.
+ */
+template <int Dim>
+class IoAggregator
+{
+public:
+	typedef Matrix<float, Dim, 1> VectorD;
+
+	IoAggregator(const SimulationOptions &options, int rank, int compute_size);
+
+	bool IsEnabled() const;
+	void Ship(int step, vector<VectorD> &paths);
+	void Finish();
+	void Serve();
+
+	int GetServerNumber() const;
+	double GetBytesWritten() const;
+	double GetWriteTime() const;
+	double GetServerTime() const;
+	double GetWaitTime() const;
+
+private:
+
+	int io_ranks_ = 0;			//0 when paths are written by each rank at the end
+	SaveFormat format_;
+	int steps_;
+	int rank_;
+	int compute_size_;
+	int server_;				//World rank of the server this compute rank ships to
+	int boid_number_ = 0;		//Boids this compute rank ships per frame
+	vector<MPI_Request> requests_;
+	double wait_time_ = 0;		//Time this compute rank spent shipping
+	double bytes_written_ = 0;	//Server statistics, summed over servers on the master
+	double write_time_ = 0;		//Longest server write time on the master
+	double server_time_ = 0;	//Longest server wall time on the master
+
+	static void RankRange(int rank, int compute_size, int &start, int &end);
+	void Clients(int server, vector<int> &clients) const;
+	void PostBatch(int batch, float *frames, const vector<int> &clients, int first_boid, size_t frame_floats, vector<MPI_Request> &requests);
+	void WriteText(ofstream &file, const float *frames, int frame_number, int boid_number);
+};
@@ -0,0 +1,230 @@
+#include "pch.h"
+#include "kd_tree.h"
+
+/*! \file kd_tree.cpp
+	\brief Implementation of the k-d tree neighbour search
+*/
+
+/**
+ * \brief  Sizes the tree so leaves hold at most KD_LEAF_SIZE boids and builds it.
+ * \param  boids | Boids to index. Referenced, not copied.
+ * \param  sight_range | Interaction cutoff the structure must cover
+ */
+KdTree::KdTree(vector<Boid>& boids, float sight_range) : boids_(boids)
+{
+	sight_range_sq_ = sight_range * sight_range;
+	depth_ = 0;
+	while ((int(boids.size()) >> depth_) > KD_LEAF_SIZE)
+	{
+		depth_++;
+	}
+
+	points_.resize(boids.size());
+	nodes_.resize((2 << depth_) - 1);
+	Rebuild();
+}
+
+/**
+ * \brief  Fixed radius query: hands the boid every leaf whose bounding box is within sight range.
+ *		   Distances are not periodic, matching the distance test in Boid::GetNearbyBoids.
+ * \param  boid | The boid to update
+ */
+void KdTree::UpdateNearCells(Boid & boid)
+{
+	Vector3f position = boid.GetPosition();
+	int stack[64];
+	int stack_size = 0;
+	stack[stack_size++] = 0;
+
+	boid.neighbouring_cells_buffer_.clear();
+
+	while (stack_size > 0)
+	{
+		int node = stack[--stack_size];
+		float distance_squared = BoxDistanceSquared(nodes_[node], position);
+
+		if (nodes_[node].begin == nodes_[node].end || distance_squared >= sight_range_sq_)
+		{
+			continue;
+		}
+
+		if (node >= (1 << depth_) - 1)
+		{
+			boid.neighbouring_cells_buffer_.push_back({ points_.data() + nodes_[node].begin, points_.data() + nodes_[node].end, distance_squared });
+		}
+		else
+		{
+			stack[stack_size++] = 2 * node + 2;
+			stack[stack_size++] = 2 * node + 1;
+		}
+	}
+}
+
+/**
+ * \brief  Tree is rebuilt from scratch each step so no incremental updates are tracked.
+ * \return  | Always false
+ */
+bool KdTree::UpdateGrid(Boid &, vector<int>&, int &)
+{
+	return false;
+}
+
+/**
+ * \brief  Tree is rebuilt from scratch each step so updates from other nodes are ignored.
+ */
+void KdTree::UpdateGrid(Boid &, int, int)
+{
+}
+
+/**
+ * \brief  Rebuilds the whole tree from current boid positions. The upper levels are split one level at a time with the
+ *		   nodes of a level shared out between threads, then the subtrees below KD_PARALLEL_DEPTH are built one per thread.
+ */
+void KdTree::Rebuild()
+{
+	for (int boid = 0; boid < int(boids_.size()); boid++)
+	{
+		points_[boid] = &boids_[boid];
+	}
+
+	nodes_[0].begin = 0;
+	nodes_[0].end = int(points_.size());
+
+	int parallel_depth = min(depth_, KD_PARALLEL_DEPTH);
+	for (int depth = 0; depth < parallel_depth; depth++)
+	{
+		int first = (1 << depth) - 1;
+		#pragma omp parallel for schedule(dynamic)
+		for (int node = first; node < 2 * first + 1; node++)
+		{
+			Split(node, depth);
+		}
+	}
+
+	int first = (1 << parallel_depth) - 1;
+	#pragma omp parallel for schedule(dynamic)
+	for (int node = first; node < 2 * first + 1; node++)
+	{
+		Build(node, parallel_depth);
+	}
+}
+
+/**
+ * \brief  Recursively builds a node and its subtree on the calling thread.
+ * \param  node | Heap index of the node, its range already set
+ * \param  depth | Depth of the node
+ */
+void KdTree::Build(int node, int depth)
+{
+	Split(node, depth);
+
+	if (depth < depth_)
+	{
+		Build(2 * node + 1, depth + 1);
+		Build(2 * node + 2, depth + 1);
+	}
+}
+
+/**
+ * \brief  Computes a node's bounding box then, unless it is a leaf, median splits its range along the widest axis
+ *		   and hands each half to a child.
+ * \param  node | Heap index of the node, its range already set
+ * \param  depth | Depth of the node
+ */
+void KdTree::Split(int node, int depth)
+{
+	Node &current = nodes_[node];
+	int begin = current.begin;
+	int end = current.end;
+	current.min = Vector3f::Constant(LENGTH);
+	current.max = Vector3f::Zero();
+
+	for (int i = begin; i < end; i++)
+	{
+		Vector3f position = points_[i]->GetPosition();
+		current.min = current.min.cwiseMin(position);
+		current.max = current.max.cwiseMax(position);
+	}
+
+	if (depth == depth_)
+	{
+		return;
+	}
+
+	int axis;
+	(current.max - current.min).maxCoeff(&axis);
+	int middle = begin + (end - begin) / 2;
+
+	nth_element(points_.begin() + begin, points_.begin() + middle, points_.begin() + end,
+		[axis](const Boid* a, const Boid* b) { return a->GetPosition()[axis] < b->GetPosition()[axis]; });
+
+	nodes_[2 * node + 1].begin = begin;
+	nodes_[2 * node + 1].end = middle;
+	nodes_[2 * node + 2].begin = middle;
+	nodes_[2 * node + 2].end = end;
+}
+
+/**
+ * \brief  Squared distance from a position to the closest point of a nodes bounding box.
+ * \param  node | Node to measure to
+ * \param  position | Query position
+ * \return  | Squared distance, zero if the position is inside the box
+ */
+float KdTree::BoxDistanceSquared(const Node & node, const Vector3f & position) const
+{
+	Vector3f below = (node.min - position).cwiseMax(0);
+	Vector3f above = (position - node.max).cwiseMax(0);
+	return (below + above).squaredNorm();
+}
+
+/**
+ * \brief  Number of leaves, for iterating over the tree leaf by leaf.
+ * \return  | Leaf count
+ */
+int KdTree::GetCellCount() const
+{
+	return 1 << depth_;
+}
+
+/**
+ * \brief  Gives the boids in a leaf and every leaf whose bounding box is within sight range of the leafs box.
+ * \param  cell | Leaf number, counted left to right
+ * \param  residents | Set to the boids in the leaf
+ * \param  neighbourhood | Filled with the leaves in range, including the leaf itself
+ */
+void KdTree::GatherCell(int cell, CellSpan & residents, vector<CellSpan>& neighbourhood)
+{
+	const Node &leaf = nodes_[(1 << depth_) - 1 + cell];
+	int stack[64];
+	int stack_size = 0;
+	stack[stack_size++] = 0;
+
+	residents = { points_.data() + leaf.begin, points_.data() + leaf.end, 0 };
+	neighbourhood.clear();
+
+	if (leaf.begin == leaf.end)
+	{
+		return;
+	}
+
+	while (stack_size > 0)
+	{
+		int node = stack[--stack_size];
+		Vector3f gap = (nodes_[node].min - leaf.max).cwiseMax(leaf.min - nodes_[node].max).cwiseMax(0);
+
+		if (nodes_[node].begin == nodes_[node].end || gap.squaredNorm() >= sight_range_sq_)
+		{
+			continue;
+		}
+
+		if (node >= (1 << depth_) - 1)
+		{
+			neighbourhood.push_back({ points_.data() + nodes_[node].begin, points_.data() + nodes_[node].end, 0 });
+		}
+		else
+		{
+			stack[stack_size++] = 2 * node + 2;
+			stack[stack_size++] = 2 * node + 1;
+		}
+	}
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include "boid.h"
+#include "neighbour_search.h"
+#include <vector>
+#include <algorithm>
+#include <math.h>
+
+/**
+ * \brief  Balanced k-d tree over boid positions, rebuilt in parallel each step and queried with a fixed radius.
+ *		   Nodes are stored in heap order so tasks building different subtrees never contend for storage.
+ *		   Leaves are contiguous ranges of the permuted boid pointer array and are handed to boids as CellSpans.
+ */
+class KdTree : public NeighbourSearch
+{
+public:
+	KdTree(vector<Boid> &boids, float sight_range);
+	~KdTree() = default;
+
+	void UpdateNearCells(Boid &boid) override;
+	bool UpdateGrid(Boid &boid, vector<int> &update_tracker, int &size) override;
+	void UpdateGrid(Boid &boid, int old_pos, int new_pos) override;
+	void Rebuild() override;
+	int GetCellCount() const override;
+	void GatherCell(int cell, CellSpan &residents, vector<CellSpan> &neighbourhood) override;
+
+private:
+
+	/**
+	 * \brief  Bounding box and range of the permuted boid array covered by a node.
+	 */
+	struct Node
+	{
+		Vector3f min;
+		Vector3f max;
+		int begin;
+		int end;
+	};
+
+	vector<Boid> &boids_;
+	vector<Boid*> points_; //Boid pointers permuted so each node covers a contiguous range
+	vector<Node> nodes_;   //Heap ordered, children of node i are 2i+1 and 2i+2
+	int depth_;			   //Depth of the leaves, all leaves sit at the same depth
+	float sight_range_sq_;
+
+	void Build(int node, int depth);
+	void Split(int node, int depth);
+	float BoxDistanceSquared(const Node &node, const Vector3f &position) const;
+};
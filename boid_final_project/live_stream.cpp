@@ -0,0 +1,269 @@
+#include "pch.h"
+#include "live_stream.h"
+#include <cstring>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+/*! \file live_stream.cpp
+	\brief Live frame streaming through a shared memory ring or a local socket.
+*/
+
+/**
+ * \brief  Sets up the stream on the master. Creates the shared memory region STREAM_NAME, or in socket mode a
+ *		   non blocking datagram socket that sends frames to the reader bound at socket_path.
+ * \param  interval | Publish every interval steps, 0 disables streaming
+ * \param  socket_path | Path of the readers local socket, empty to stream through shared memory
+ * \param  rank | MPI node rank
+ */
+template <int Dim>
+LiveStream<Dim>::LiveStream(int interval, const string &socket_path, int rank)
+{
+	if (interval <= 0 || rank != MASTER)
+	{
+		return;
+	}
+
+	interval_ = interval;
+	bool opened = socket_path.empty() ? OpenRegion(BOID_NUMBER) : OpenSocket(socket_path);
+	interval_ = opened ? interval_ : 0;
+}
+
+/**
+ * \brief  Tells any attached reader the run is over and releases the region or socket.
+ *		   The region name is removed, an attached reader keeps its mapping until it detaches.
+ */
+template <int Dim>
+LiveStream<Dim>::~LiveStream()
+{
+	if (header_)
+	{
+		header_->producer_alive.store(0, memory_order_release);
+	}
+
+#ifdef _WIN32
+	if (header_)
+	{
+		UnmapViewOfFile(header_);
+		CloseHandle(mapping_);
+	}
+#else
+	if (header_)
+	{
+		munmap(header_, region_bytes_);
+		shm_unlink(STREAM_NAME);
+	}
+	if (socket_ >= 0)
+	{
+		close(socket_);
+	}
+#endif
+}
+
+/**
+ * \brief  Creates and initialises the shared memory region.
+ * \param  boid_number | Positions in each frame
+ * \return  | True if the region is ready
+ */
+template <int Dim>
+bool LiveStream<Dim>::OpenRegion(int boid_number)
+{
+	region_bytes_ = StreamRegionBytes(Dim, boid_number, STREAM_SLOTS);
+	void *region = nullptr;
+
+#ifdef _WIN32
+	mapping_ = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, DWORD(uint64_t(region_bytes_) >> 32), DWORD(region_bytes_), STREAM_NAME);
+	if (mapping_ != NULL)
+	{
+		region = MapViewOfFile(mapping_, FILE_MAP_ALL_ACCESS, 0, 0, region_bytes_);
+	}
+#else
+	shm_unlink(STREAM_NAME); //a region left behind by a killed run is replaced rather than reused
+	int descriptor = shm_open(STREAM_NAME, O_CREAT | O_RDWR, 0644);
+	if (descriptor >= 0 && ftruncate(descriptor, region_bytes_) == 0)
+	{
+		region = mmap(nullptr, region_bytes_, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+		region = region == MAP_FAILED ? nullptr : region;
+	}
+	if (descriptor >= 0)
+	{
+		close(descriptor);
+	}
+#endif
+
+	if (!region)
+	{
+		printf("Could not create shared memory region %s, live streaming is off\n", STREAM_NAME);
+		return false;
+	}
+
+	header_ = new (region) StreamHeader();
+	memcpy(header_->magic, STREAM_MAGIC, sizeof(header_->magic));
+	header_->version = STREAM_VERSION;
+	header_->dimension = Dim;
+	header_->boid_number = boid_number;
+	header_->slot_count = STREAM_SLOTS;
+	header_->slot_bytes = StreamSlotBytes(Dim, boid_number);
+	header_->interval = interval_;
+	header_->length = LENGTH;
+	header_->write_index.store(0, memory_order_relaxed);
+	header_->read_index.store(0, memory_order_relaxed);
+	header_->dropped.store(0, memory_order_relaxed);
+	header_->reader_attached.store(0, memory_order_relaxed);
+	header_->producer_alive.store(1, memory_order_release);
+
+	return true;
+}
+
+/**
+ * \brief  Opens the non blocking datagram socket frames are sent from.
+ * \param  path | Path of the readers local socket
+ * \return  | True if the socket is ready
+ */
+template <int Dim>
+bool LiveStream<Dim>::OpenSocket(const string &path)
+{
+#ifdef _WIN32
+	printf("Socket streaming is not available on Windows, live streaming is off\n");
+	return false;
+#else
+	socket_ = socket(AF_UNIX, SOCK_DGRAM, 0);
+	if (socket_ < 0 || path.size() >= sizeof(socket_address_.sun_path))
+	{
+		printf("Could not open a socket to %s, live streaming is off\n", path.c_str());
+		return false;
+	}
+
+	fcntl(socket_, F_SETFL, fcntl(socket_, F_GETFL) | O_NONBLOCK);
+	memset(&socket_address_, 0, sizeof(socket_address_));
+	socket_address_.sun_family = AF_UNIX;
+	strcpy(socket_address_.sun_path, path.c_str());
+
+	datagram_.resize(sizeof(StreamFrameHeader) + sizeof(float) * Dim * BOID_NUMBER);
+	int buffer_bytes = datagram_.size() * STREAM_SLOTS;
+	setsockopt(socket_, SOL_SOCKET, SO_SNDBUF, &buffer_bytes, sizeof(buffer_bytes));
+
+	return true;
+#endif
+}
+
+/**
+ * \brief  Copies the boid positions into a frame as packed floats.
+ * \param  positions | Destination, boids.size() * Dim floats
+ * \param  boids | Full boid vector
+ */
+template <int Dim>
+void LiveStream<Dim>::WritePositions(float *positions, vector<Boid> &boids)
+{
+	int boid_number = boids.size();
+
+	#pragma omp parallel for schedule(static)
+	for (int boid = 0; boid < boid_number; boid++)
+	{
+		typename Boid::VectorD position = boids[boid].GetPosition();
+		for (int i = 0; i < Dim; i++)
+		{
+			positions[boid * Dim + i] = position[i];
+		}
+	}
+}
+
+/**
+ * \brief  Publishes a frame if this is a stream step. Never blocks: the frame is dropped if the attached
+ *		   reader still has every slot to read, or if the socket cannot take it right now.
+ * \param  step | Simulation step just completed
+ * \param  boids | Full boid vector, up to date on the master
+ */
+template <int Dim>
+void LiveStream<Dim>::Publish(int step, vector<Boid> &boids)
+{
+	if (interval_ <= 0 || step % interval_ != 0)
+	{
+		return;
+	}
+
+	double start_time = MPI_Wtime();
+
+	if (header_)
+	{
+		uint64_t write_index = header_->write_index.load(memory_order_relaxed);
+
+		//The reader publishes read_index before reader_attached, so an attached reader's index is never stale here
+		if (header_->reader_attached.load(memory_order_acquire) != 0 &&
+			write_index - header_->read_index.load(memory_order_acquire) >= uint64_t(header_->slot_count))
+		{
+			dropped_++;
+			header_->dropped.store(dropped_, memory_order_relaxed);
+		}
+		else
+		{
+			StreamFrameHeader *frame = StreamSlot(header_, write_index % header_->slot_count);
+			frame->step = step;
+			frame->boid_number = boids.size();
+			WritePositions(reinterpret_cast<float*>(frame + 1), boids);
+
+			header_->write_index.store(write_index + 1, memory_order_release);
+			published_++;
+		}
+	}
+#ifndef _WIN32
+	else
+	{
+		StreamFrameHeader *frame = reinterpret_cast<StreamFrameHeader*>(datagram_.data());
+		frame->step = step;
+		frame->boid_number = boids.size();
+		WritePositions(reinterpret_cast<float*>(frame + 1), boids);
+
+		//Fails straight away with no reader bound or a full receive queue
+		if (sendto(socket_, datagram_.data(), datagram_.size(), MSG_DONTWAIT, reinterpret_cast<sockaddr*>(&socket_address_), sizeof(socket_address_)) < 0)
+		{
+			dropped_++;
+		}
+		else
+		{
+			published_++;
+		}
+	}
+#endif
+
+	time_taken_ += MPI_Wtime() - start_time;
+}
+
+/**
+ * \brief  Frames handed to the reader.
+ * \return  | Frames published
+ */
+template <int Dim>
+int LiveStream<Dim>::GetPublished() const
+{
+	return published_;
+}
+
+/**
+ * \brief  Frames dropped because the reader could not keep up or was not listening.
+ * \return  | Frames dropped
+ */
+template <int Dim>
+int LiveStream<Dim>::GetDropped() const
+{
+	return dropped_;
+}
+
+/**
+ * \brief  Wall time spent publishing frames.
+ * \return  | Time in seconds
+ */
+template <int Dim>
+double LiveStream<Dim>::GetTimeTaken() const
+{
+	return time_taken_;
+}
+
+template class LiveStream<2>;
+template class LiveStream<3>;
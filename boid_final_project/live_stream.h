@@ -0,0 +1,56 @@
+#pragma once
+#include "pch.h"
+#include "preprocessor.h"
+#include "boid.h"
+#include "stream_format.h"
+#include "omp.h"
+#include <mpi.h>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
+/**
+ * \brief  Publishes every few steps a frame of all boid positions to a lock free ring in shared memory (or as datagrams to a
+ *		   local socket), so a visualiser can watch the run live and attach or detach at any time. The step never waits on
+ *		   the reader: frames that find the ring full, or the socket unable to take them, are dropped and counted.
+ *		   Only the master publishes, holding a full replicated copy of the flock.
+ */
+template <int Dim>
+class LiveStream
+{
+public:
+	typedef BoidT<Dim> Boid;
+
+	LiveStream(int interval, const string &socket_path, int rank);
+	~LiveStream();
+
+	void Publish(int step, vector<Boid> &boids);
+	int GetPublished() const;
+	int GetDropped() const;
+	double GetTimeTaken() const;
+
+private:
+
+	int interval_ = 0;			//Steps between frames, 0 when the stream is off on this rank
+	int published_ = 0;
+	int dropped_ = 0;
+	double time_taken_ = 0;		//Wall time spent publishing
+	StreamHeader *header_ = nullptr; //Mapped shared memory region, null in socket mode
+	size_t region_bytes_ = 0;
+	vector<char> datagram_;		//Frame staging buffer in socket mode
+
+#ifdef _WIN32
+	void *mapping_ = nullptr;	//File mapping handle
+#else
+	int socket_ = -1;
+	sockaddr_un socket_address_;
+#endif
+
+	void WritePositions(float *positions, vector<Boid> &boids);
+	bool OpenRegion(int boid_number);
+	bool OpenSocket(const string &path);
+};
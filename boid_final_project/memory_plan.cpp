@@ -0,0 +1,229 @@
+#include "pch.h"
+#include "memory_plan.h"
+#include "shared_world.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <tuple>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+/*! \file memory_plan.cpp
+	\brief Start up projection of each rank's memory, so a run that cannot fit is rejected before it allocates anything.
+*/
+
+using namespace std;
+using namespace Eigen;
+
+/**
+ * \brief  Physical memory of the node the process runs on.
+ * \return  | Bytes of physical memory
+ */
+static double PhysicalMemory()
+{
+#ifdef _WIN32
+	MEMORYSTATUSEX status;
+	status.dwLength = sizeof(status);
+	GlobalMemoryStatusEx(&status);
+	return double(status.ullTotalPhys);
+#else
+	return double(sysconf(_SC_PHYS_PAGES)) * sysconf(_SC_PAGE_SIZE);
+#endif
+}
+
+/**
+ * \brief  Projected peak memory of the rank.
+ * \return  | Bytes
+ */
+double MemoryPlan::Total() const
+{
+	return state + grid + buffers + output;
+}
+
+/**
+ * \brief  Projects the memory one rank will allocate from the sizes its structures are built with. Vectors that grow on demand,
+ *		   the nearby boid buffers and tiles, are counted at their starting size or for an evenly spread flock.
+ *		   With the shared window a rank holds only its own boids and its share of the window, plus a full copy of the flock
+ *		   and a search structure over it when analytics or the stream need every boid.
+ * \param  options | Run time options
+ * \param  rank | MPI node rank in MPI_COMM_WORLD
+ * \param  compute_size | Number of ranks running the simulation, ranks past it are I/O servers
+ * \param  ranks_on_node | Ranks sharing the node, which split its memory and its shared window
+ * \return  | Projected bytes by component and the bytes the rank may use
+ */
+template <int Dim>
+MemoryPlan PlanMemory(const SimulationOptions &options, int rank, int compute_size, int ranks_on_node)
+{
+	MemoryPlan plan;
+	double boid_number = BOID_NUMBER;
+	int boids_per_worker_node = BOID_NUMBER / compute_size;
+	double owned = compute_size == 1 ? BOID_NUMBER : rank == MASTER ? BOID_NUMBER - (compute_size - 1) * boids_per_worker_node : boids_per_worker_node;
+	double position_bytes = Dim * sizeof(float);
+	bool window = options.shared_window && compute_size > 1;
+	bool full_copy = window && (options.analytics_interval > 0 || (options.stream_interval > 0 && rank == MASTER));
+	double held = window ? owned + (full_copy ? boid_number : 0) : boid_number;
+
+	plan.available = options.memory_budget > 0 ? options.memory_budget * 1048576.0 : PhysicalMemory() * MEMORY_HEADROOM / ranks_on_node;
+
+	if (rank >= compute_size)
+	{
+		//A server holds two batches of the frames of its ranks, the one with the master also gets the remainder
+		double clients = ceil(double(compute_size) / options.io_ranks);
+		plan.output = 2.0 * IO_BATCH * (clients * boids_per_worker_node + BOID_NUMBER % compute_size) * position_bytes;
+		return plan;
+	}
+
+	//The nearby boid buffer starts at the size the boid constructor gives it and, under the metric rule, grows as GetNearbyBoids does
+	//to hold the boids in sight, estimated from the starting density. The mean density of a Gaussian cluster is its share of the flock
+	//over (2 sqrt(pi) spread)^Dim, and a boid in a cluster sees at most the rest of it
+	double neighbour_buffer = max(min(BOID_NUMBER / BUFFER_FRACTION, NEIGHBOUR_BUFFER_MAX), TOPOLOGICAL_NEIGHBOURS);
+	if (options.parameters.interaction == InteractionRule::Metric && !options.tiled && !options.parameters.species && !window)
+	{
+		const double pi = 3.14159265358979;
+		double sight = options.parameters.sight_range;
+		double sight_volume = Dim == 2 ? pi * sight * sight : 4.0 / 3.0 * pi * sight * sight * sight;
+		double region = options.scenario == Scenario::Uniform ? pow(double(LENGTH), Dim) : options.scenario == Scenario::Box ? pow(LENGTH / 2.0, Dim)
+			: SCENARIO_GROUPS * pow(2 * sqrt(pi) * SCENARIO_SPREAD, Dim);
+		double in_sight = min(options.scenario == Scenario::Uniform || options.scenario == Scenario::Box ? boid_number : boid_number / SCENARIO_GROUPS,
+			boid_number * sight_volume / region);
+		while (neighbour_buffer < in_sight)
+		{
+			neighbour_buffer = 2 * neighbour_buffer + 1;
+		}
+	}
+	plan.state = held * (sizeof(BoidT<Dim>) + Dim * sizeof(int) + BoidT<Dim>::STENCIL_SIZE * sizeof(CellSpanT<Dim>)
+		+ neighbour_buffer * sizeof(tuple<BoidT<Dim>*, float>));
+
+	double cell_num = max(floor(double(LENGTH) / options.parameters.sight_range), 1.0);
+	double cells = pow(cell_num, Dim);
+	switch (Dim == 2 ? SearchBackend::Grid : options.search)
+	{
+	case SearchBackend::SortedCells:
+		plan.grid = boid_number * (sizeof(void*) + sizeof(int)) + (cells + 1) * sizeof(int);
+		break;
+	case SearchBackend::KdTree:
+	{
+		int depth = 0;
+		while ((BOID_NUMBER >> depth) > KD_LEAF_SIZE)
+		{
+			depth++;
+		}
+		plan.grid = boid_number * sizeof(void*) + (2.0 * (1LL << depth) - 1) * (2 * sizeof(Vector3f) + 2 * sizeof(int));
+		break;
+	}
+	case SearchBackend::Hashed:
+		//The table is at worst an eighth full, just after it doubles
+		plan.grid = 8 * min(boid_number, cells) * (sizeof(uint64_t) + 2 * sizeof(int)) + boid_number * (sizeof(void*) + sizeof(uint64_t) + 2 * sizeof(int));
+		break;
+	default:
+		plan.grid = cells * sizeof(vector<void*>) + boid_number * sizeof(void*);
+	}
+	if (window && !full_copy)
+	{
+		plan.grid = 0; //neighbours are found through the window's cell list
+	}
+
+	if (window)
+	{
+		//The window is held once per node, and each rank lists the cells of its own boids
+		plan.buffers += double(SharedWorld<Dim>::WindowBytes(BOID_NUMBER, options.parameters.sight_range)) / ranks_on_node + owned * sizeof(int);
+	}
+	else if (compute_size > 1)
+	{
+		//Grid updates peak at three ints for every boid moving cell in one step
+		plan.buffers += 3 * boid_number * sizeof(int) + (boid_number + boids_per_worker_node) * 2 * position_bytes;
+	}
+	if (compute_size > 1 && options.halo_depth != 0 && !window)
+	{
+		double depth = options.halo_depth < 0 ? DEEP_HALO_MAX : options.halo_depth;
+		plan.buffers += boid_number * ((depth + 3) * sizeof(int) + sizeof(char)) + cells * sizeof(int);
+	}
+	if (options.tiled || options.parameters.species || window)
+	{
+		double tile_boids = min(boid_number, boid_number * BoidT<Dim>::STENCIL_SIZE / cells);
+		plan.buffers += omp_get_max_threads() * tile_boids * 2 * position_bytes;
+	}
+	if (options.schedule == ScheduleMode::Adaptive)
+	{
+		plan.buffers += owned * sizeof(int);
+	}
+
+	if (options.pipeline && Dim == 3 && compute_size == 1)
+	{
+		plan.output = boid_number * options.steps * position_bytes; //the pipelined step always records the paths
+	}
+	else if (options.save != SaveFormat::None)
+	{
+		plan.output = owned * options.steps * position_bytes;
+	}
+
+	return plan;
+}
+
+/**
+ * \brief  Projects every rank's memory, prints the largest projection of each component and the smallest allowance on the master,
+ *		   and agrees across MPI_COMM_WORLD whether the run fits. Call before the simulation allocates anything.
+ * \param  options | Run time options
+ * \param  rank | MPI node rank in MPI_COMM_WORLD
+ * \param  compute_size | Number of ranks running the simulation, ranks past it are I/O servers
+ * \return  | True on every rank when every rank fits its allowance
+ */
+bool CheckMemory(const SimulationOptions &options, int rank, int compute_size)
+{
+	MPI_Comm node_comm;
+	int ranks_on_node;
+	MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &node_comm);
+	MPI_Comm_size(node_comm, &ranks_on_node);
+	MPI_Comm_free(&node_comm);
+
+	MemoryPlan plan = options.dimension == 2 ? PlanMemory<2>(options, rank, compute_size, ranks_on_node) : PlanMemory<3>(options, rank, compute_size, ranks_on_node);
+	int fits = plan.Total() <= plan.available;
+
+	//The same run with every rank holding the whole flock, to show what the window saves
+	SimulationOptions replicated = options;
+	replicated.shared_window = false;
+	MemoryPlan replicated_plan = options.dimension == 2 ? PlanMemory<2>(replicated, rank, compute_size, ranks_on_node) : PlanMemory<3>(replicated, rank, compute_size, ranks_on_node);
+
+	double largest[6] = { plan.state, plan.grid, plan.buffers, plan.output, plan.Total(), replicated_plan.Total() };
+	MPI_Allreduce(MPI_IN_PLACE, largest, 6, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+	MPI_Allreduce(MPI_IN_PLACE, &plan.available, 1, MPI_DOUBLE, MPI_MIN, MPI_COMM_WORLD);
+	MPI_Allreduce(MPI_IN_PLACE, &fits, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+
+	if (rank == MASTER)
+	{
+		printf("Projected memory per rank, largest over ranks:\n");
+		printf(" --------------------------------\n");
+		printf("|     State/MB       |%10f|\n", largest[0] / 1048576.0);
+		printf(" --------------------------------\n");
+		printf("|      Grid/MB       |%10f|\n", largest[1] / 1048576.0);
+		printf(" --------------------------------\n");
+		printf("|    Buffers/MB      |%10f|\n", largest[2] / 1048576.0);
+		printf(" --------------------------------\n");
+		printf("|     Output/MB      |%10f|\n", largest[3] / 1048576.0);
+		printf(" --------------------------------\n");
+		printf("|     Total/MB       |%10f|\n", largest[4] / 1048576.0);
+		printf(" --------------------------------\n");
+		if (options.shared_window && compute_size > 1)
+		{
+			printf("|  Window saves/MB   |%10f|\n", (largest[5] - largest[4]) / 1048576.0);
+			printf(" --------------------------------\n");
+		}
+		printf("|   Available/MB     |%10f|\n", plan.available / 1048576.0);
+		printf(" --------------------------------\n");
+
+		if (!fits)
+		{
+			printf("The run does not fit in memory: reduce BOID_NUMBER, the sight range, --steps or saved output, spread the ranks over more nodes or raise --memory-budget\n");
+		}
+	}
+
+	return fits;
+}
+
+template MemoryPlan PlanMemory<2>(const SimulationOptions&, int, int, int);
+template MemoryPlan PlanMemory<3>(const SimulationOptions&, int, int, int);
@@ -0,0 +1,26 @@
+#pragma once
+#include "pch.h"
+#include "preprocessor.h"
+#include "boid.h"
+#include "options.h"
+#include "omp.h"
+#include <mpi.h>
+
+/**
+ * \brief  Projected peak memory of one rank in bytes, worked out from the options before anything is allocated.
+ */
+struct MemoryPlan
+{
+	double state = 0;		//Boids held by the rank, with their candidate and nearby boid buffers
+	double grid = 0;		//Neighbour search structure, none with the shared window unless the whole flock is copied out
+	double buffers = 0;		//Exchange, shared window share, halo, tile and scheduler buffers
+	double output = 0;		//Path buffer, or an I/O server's batch buffers
+	double available = 0;	//Memory the rank may use: --memory-budget, or its share of the node
+
+	double Total() const;
+};
+
+template <int Dim>
+MemoryPlan PlanMemory(const SimulationOptions &options, int rank, int compute_size, int ranks_on_node);
+
+bool CheckMemory(const SimulationOptions &options, int rank, int compute_size);
@@ -0,0 +1,143 @@
+#include "pch.h"
+#include "neighbour_search.h"
+#include "spatial_grid.h"
+#include "sorted_cell_list.h"
+#include "kd_tree.h"
+#include "hashed_grid.h"
+
+/*! \file neighbour_search.cpp
+	\brief Construction and naming of the neighbour search backends
+*/
+
+/**
+ * \brief  Builds the requested neighbour search backend over the given boids.
+ * \param  backend | Which backend to construct
+ * \param  boids | Boids the structure indexes. Must outlive the returned object.
+ * \param  sight_range | Interaction cutoff the structure must cover
+ * \return  | Owning pointer to the backend
+ */
+template <>
+unique_ptr<NeighbourSearch> CreateNeighbourSearch<3>(SearchBackend backend, vector<Boid>& boids, float sight_range)
+{
+	switch (backend)
+	{
+	case SearchBackend::SortedCells:
+		return make_unique<SortedCellList>(boids, sight_range);
+	case SearchBackend::KdTree:
+		return make_unique<KdTree>(boids, sight_range);
+	case SearchBackend::Hashed:
+		return make_unique<HashedGrid>(boids, sight_range);
+	default:
+		return make_unique<SpatialGrid>(boids, sight_range);
+	}
+}
+
+/**
+ * \brief  Builds a neighbour search backend over planar boids. Only the uniform grid is generic over the dimension,
+ *		   the other backends fall back to it with a note.
+ * \param  backend | Requested backend
+ * \param  boids | Boids the structure indexes. Must outlive the returned object.
+ * \param  sight_range | Interaction cutoff the structure must cover
+ * \return  | Owning pointer to the backend
+ */
+template <>
+unique_ptr<NeighbourSearchT<2>> CreateNeighbourSearch<2>(SearchBackend backend, vector<BoidT<2>>& boids, float sight_range)
+{
+	if (backend != SearchBackend::Grid)
+	{
+		printf("Search backend %s is 3D only, using grid for the 2D run\n", SearchBackendName(backend));
+	}
+
+	return make_unique<SpatialGridT<2>>(boids, sight_range);
+}
+
+/**
+ * \brief  Per axis squared distances from a position to the cells offset by -1, 0 and +1 from its own cell.
+ *		   Summing one entry per axis gives the CellSpan distance bound of a stencil cell. With two cells per axis the
+ *		   -1 cell is also the +1 cell, the one the stencil keeps, so it gets the nearer of the two bounds.
+ * \param  position | Position of the querying boid
+ * \param  grid_coord | Co-ordinates of the cell containing the position
+ * \param  cell_length | Side length of a cell
+ * \param  cell_num | Cells per axis
+ * \param  stencil_distances | Output, indexed [axis][offset + 1]
+ */
+template <int Dim>
+void NeighbourSearchT<Dim>::GetStencilDistances(const typename Boid::VectorD & position, const int * grid_coord, float cell_length, int cell_num, float stencil_distances[][3])
+{
+	for (int i = 0; i < Dim; i++)
+	{
+		float below = max(position[i] - grid_coord[i] * cell_length, 0.0f);
+		float above = max((grid_coord[i] + 1) * cell_length - position[i], 0.0f);
+		stencil_distances[i][0] = cell_num == 2 ? min(below * below, above * above) : below * below;
+		stencil_distances[i][1] = 0;
+		stencil_distances[i][2] = above * above;
+	}
+}
+
+/**
+ * \brief  Whether a stencil offset along one axis wraps onto a cell a lower offset already reached, so the cell is not visited twice.
+ *		   Happens when the sight range is over a third of LENGTH: with two cells per axis +1 is the -1 cell, with one both are the cell itself.
+ * \param  offset | Offset along the axis, -1, 0 or +1
+ * \param  cell_num | Cells per axis
+ * \return  | True if the offset should be skipped
+ */
+template <int Dim>
+bool NeighbourSearchT<Dim>::IsStencilDuplicate(int offset, int cell_num)
+{
+	return (offset == 1 && cell_num < 3) || (offset == -1 && cell_num < 2);
+}
+
+template class NeighbourSearchT<2>;
+template class NeighbourSearchT<3>;
+
+/**
+ * \brief  Converts a command line name into a backend.
+ * \param  name | One of "grid", "cells", "kdtree" or "hashed"
+ * \param  backend | Set to the matching backend if the name is recognised
+ * \return  | Boolean indicating if the name was recognised
+ */
+bool ParseSearchBackend(const string &name, SearchBackend &backend)
+{
+	if (name == "grid")
+	{
+		backend = SearchBackend::Grid;
+	}
+	else if (name == "cells")
+	{
+		backend = SearchBackend::SortedCells;
+	}
+	else if (name == "kdtree")
+	{
+		backend = SearchBackend::KdTree;
+	}
+	else if (name == "hashed")
+	{
+		backend = SearchBackend::Hashed;
+	}
+	else
+	{
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * \brief  Name of a backend for printing in the run summary.
+ * \param  backend | Backend to name
+ * \return  | Printable name, matching what ParseSearchBackend accepts
+ */
+const char* SearchBackendName(SearchBackend backend)
+{
+	switch (backend)
+	{
+	case SearchBackend::SortedCells:
+		return "cells";
+	case SearchBackend::KdTree:
+		return "kdtree";
+	case SearchBackend::Hashed:
+		return "hashed";
+	default:
+		return "grid";
+	}
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include "boid.h"
+#include <vector>
+#include <memory>
+#include <string>
+
+/**
+ * \brief  Available neighbour search backends, selectable at runtime.
+ */
+enum class SearchBackend
+{
+	Grid,		 //!< Uniform spatial grid of per-cell boid lists, updated incrementally.
+	SortedCells, //!< Cell list rebuilt each step by counting sort into one contiguous array.
+	KdTree,		 //!< Balanced k-d tree rebuilt in parallel each step, queried with a fixed radius.
+	Hashed		 //!< Sparse grid storing only occupied cells in an open addressing hash table, rebuilt each step.
+};
+
+/**
+ * \brief  Interface for the spatial data structures that supply a boid with its candidate neighbours.
+ *		   Incrementally updated structures implement UpdateGrid, structures rebuilt from scratch implement Rebuild.
+ *		   GetCellCount/GatherCell expose the structure cell by cell (grid cell, table slot or tree leaf) for the tiled kernel.
+ */
+template <int Dim>
+class NeighbourSearchT
+{
+public:
+	typedef BoidT<Dim> Boid;
+	typedef CellSpanT<Dim> CellSpan;
+
+	virtual ~NeighbourSearchT() = default;
+
+	virtual void UpdateNearCells(Boid &boid) = 0;
+	virtual bool UpdateGrid(Boid &boid, vector<int> &update_tracker, int &size) = 0;
+	virtual void UpdateGrid(Boid &boid, int old_pos, int new_pos) = 0;
+	virtual void Rebuild() = 0;
+
+	virtual int GetCellCount() const = 0;
+	virtual void GatherCell(int cell, CellSpan &residents, vector<CellSpan> &neighbourhood) = 0;
+
+protected:
+	static void GetStencilDistances(const typename Boid::VectorD &position, const int *grid_coord, float cell_length, int cell_num, float stencil_distances[][3]);
+	static bool IsStencilDuplicate(int offset, int cell_num);
+};
+
+typedef NeighbourSearchT<SYS_DIM> NeighbourSearch;
+
+template <int Dim>
+unique_ptr<NeighbourSearchT<Dim>> CreateNeighbourSearch(SearchBackend backend, vector<BoidT<Dim>> &boids, float sight_range);
+
+bool ParseSearchBackend(const string &name, SearchBackend &backend);
+
+const char* SearchBackendName(SearchBackend backend);
@@ -0,0 +1,463 @@
+#include "pch.h"
+#include "obstacle_field.h"
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cstdio>
+
+/*! \file obstacle_field.cpp
+	\brief Construction and sampling of the obstacle signed distance field.
+*/
+
+/**
+ * \brief  Closest point to p on the triangle abc, by the Voronoi region of p.
+ * \param  p | Query point
+ * \param  a | First corner
+ * \param  b | Second corner
+ * \param  c | Third corner
+ * \return  | Closest point on the triangle
+ */
+static Vector3f ClosestPointOnTriangle(const Vector3f &p, const Vector3f &a, const Vector3f &b, const Vector3f &c)
+{
+	Vector3f ab = b - a, ac = c - a, ap = p - a;
+	float d1 = ab.dot(ap), d2 = ac.dot(ap);
+	if (d1 <= 0 && d2 <= 0)
+	{
+		return a;
+	}
+
+	Vector3f bp = p - b;
+	float d3 = ab.dot(bp), d4 = ac.dot(bp);
+	if (d3 >= 0 && d4 <= d3)
+	{
+		return b;
+	}
+
+	float vc = d1 * d4 - d3 * d2;
+	if (vc <= 0 && d1 >= 0 && d3 <= 0)
+	{
+		return a + ab * (d1 / (d1 - d3));
+	}
+
+	Vector3f cp = p - c;
+	float d5 = ab.dot(cp), d6 = ac.dot(cp);
+	if (d6 >= 0 && d5 <= d6)
+	{
+		return c;
+	}
+
+	float vb = d5 * d2 - d1 * d6;
+	if (vb <= 0 && d2 >= 0 && d6 <= 0)
+	{
+		return a + ac * (d2 / (d2 - d6));
+	}
+
+	float va = d3 * d6 - d5 * d4;
+	if (va <= 0 && d4 - d3 >= 0 && d5 - d6 >= 0)
+	{
+		return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+	}
+
+	float denominator = 1 / (va + vb + vc);
+	return a + ab * (vb * denominator) + ac * (vc * denominator);
+}
+
+/**
+ * \brief  Signed distance from a point to a primitive over the first dimension coordinates.
+ * \param  primitive | Sphere or box
+ * \param  point | Query point, unused coordinates zero
+ * \param  dimension | Spatial dimensions
+ * \return  | Distance to the surface, negative inside
+ */
+static float PrimitiveDistance(const ObstaclePrimitive &primitive, const Vector3f &point, int dimension)
+{
+	Vector3f offset = point - primitive.centre;
+
+	if (primitive.shape == ObstaclePrimitive::Sphere)
+	{
+		float distance_sq = 0;
+		for (int i = 0; i < dimension; i++)
+		{
+			distance_sq += offset[i] * offset[i];
+		}
+		return sqrt(distance_sq) - primitive.size[0];
+	}
+
+	float outside_sq = 0, inside = -1e30f;
+	for (int i = 0; i < dimension; i++)
+	{
+		float excess = abs(offset[i]) - primitive.size[i];
+		outside_sq += excess > 0 ? excess * excess : 0;
+		inside = max(inside, excess);
+	}
+
+	return sqrt(outside_sq) + min(inside, 0.0f);
+}
+
+/**
+ * \brief  Reads an obstacle file and builds the field. One obstacle per line, coordinates in simulation units:
+ *		   "sphere x y [z] radius", "box x y [z] half_x half_y [half_z]" or "mesh FILE.obj" (3D only).
+ *		   Blank lines and lines starting with # are skipped.
+ * \param  file_name | Obstacle file
+ * \param  dimension | Spatial dimensions of the run
+ * \return  | True if the file was read and the field built
+ */
+bool ObstacleField::Load(const string &file_name, int dimension)
+{
+	ifstream file(file_name);
+	if (!file.is_open())
+	{
+		printf("Could not open obstacle file %s\n", file_name.c_str());
+		return false;
+	}
+
+	dimension_ = dimension;
+	string line;
+
+	while (getline(file, line))
+	{
+		stringstream values(line);
+		string shape;
+
+		if (!(values >> shape) || shape[0] == '#')
+		{
+			continue;
+		}
+
+		ObstaclePrimitive primitive;
+		primitive.centre = primitive.size = Vector3f::Zero();
+		bool read = true;
+
+		for (int i = 0; i < dimension_; i++)
+		{
+			read = read && (values >> primitive.centre[i]);
+		}
+
+		if (shape == "sphere" && read && (values >> primitive.size[0]))
+		{
+			primitive.shape = ObstaclePrimitive::Sphere;
+			primitives_.push_back(primitive);
+		}
+		else if (shape == "box" && read && (values >> primitive.size[0] >> primitive.size[1]) && (dimension_ == 2 || (values >> primitive.size[2])))
+		{
+			primitive.shape = ObstaclePrimitive::Box;
+			primitives_.push_back(primitive);
+		}
+		else if (shape == "mesh" && dimension_ == 3)
+		{
+			string mesh_name = line.substr(line.find("mesh") + 4);
+			mesh_name.erase(0, mesh_name.find_first_not_of(" \t"));
+			mesh_name.erase(mesh_name.find_last_not_of(" \t\r") + 1);
+
+			if (!LoadMesh(mesh_name))
+			{
+				return false;
+			}
+		}
+		else
+		{
+			printf("Skipping obstacle line: %s\n", line.c_str());
+		}
+	}
+
+	double start_time = omp_get_wtime();
+	Build();
+	build_time_ = omp_get_wtime() - start_time;
+
+	return true;
+}
+
+/**
+ * \brief  Reads the triangles of a Wavefront OBJ mesh. Polygon faces are split into triangle fans.
+ * \param  file_name | OBJ file
+ * \return  | True if the file was read
+ */
+bool ObstacleField::LoadMesh(const string &file_name)
+{
+	ifstream file(file_name);
+	if (!file.is_open())
+	{
+		printf("Could not open obstacle mesh %s\n", file_name.c_str());
+		return false;
+	}
+
+	vector<Vector3f> vertices;
+	string line;
+
+	while (getline(file, line))
+	{
+		stringstream values(line);
+		string type;
+		values >> type;
+
+		if (type == "v")
+		{
+			Vector3f vertex;
+			values >> vertex[0] >> vertex[1] >> vertex[2];
+			vertices.push_back(vertex);
+		}
+		else if (type == "f")
+		{
+			vector<int> face;
+			string corner;
+			while (values >> corner)
+			{
+				int index = stoi(corner.substr(0, corner.find('/'))); //drops texture and normal indexes
+				face.push_back(index > 0 ? index - 1 : int(vertices.size()) + index);
+			}
+			for (int i = 2; i < face.size(); i++)
+			{
+				triangles_.push_back(vertices[face[0]]);
+				triangles_.push_back(vertices[face[i - 1]]);
+				triangles_.push_back(vertices[face[i]]);
+			}
+		}
+	}
+
+	return true;
+}
+
+/**
+ * \brief  Position of a grid node.
+ * \param  node | Node index, x fastest
+ * \return  | Node position, z zero in a planar field
+ */
+Vector3f ObstacleField::NodePosition(int node) const
+{
+	Vector3f position = Vector3f::Zero();
+	for (int i = 0; i < dimension_; i++)
+	{
+		position[i] = float(node % node_num_) * OBSTACLE_SPACING;
+		node /= node_num_;
+	}
+	return position;
+}
+
+/**
+ * \brief  Samples the union of all obstacles at every node, then takes the gradient.
+ *		   Distances beyond OBSTACLE_RANGE plus two nodes are clamped, where avoidance has no effect anyway.
+ */
+void ObstacleField::Build()
+{
+	node_num_ = LENGTH / OBSTACLE_SPACING + 1;
+	int node_total = node_num_ * node_num_ * (dimension_ == 3 ? node_num_ : 1);
+	float band = OBSTACLE_RANGE + 2 * OBSTACLE_SPACING;
+	vector<float> distances(node_total, band);
+
+	#pragma omp parallel for schedule(static)
+	for (int node = 0; node < node_total; node++)
+	{
+		Vector3f position = NodePosition(node);
+		for (const ObstaclePrimitive &primitive : primitives_)
+		{
+			distances[node] = min(distances[node], PrimitiveDistance(primitive, position, dimension_));
+		}
+	}
+
+	if (!triangles_.empty())
+	{
+		BuildMeshDistances(distances);
+	}
+
+	BuildGradients(distances);
+}
+
+/**
+ * \brief  Merges the signed distance to the meshes into the node distances. The unsigned distance is found for nodes
+ *		   near each triangle only, and the sign from the parity of crossings along a ray in x through each row of nodes.
+ *		   Meshes should be closed for the inside to be well defined.
+ * \param  distances | Node distances to merge into
+ */
+void ObstacleField::BuildMeshDistances(vector<float> &distances)
+{
+	int triangle_num = triangles_.size() / 3;
+	float band = OBSTACLE_RANGE + 2 * OBSTACLE_SPACING;
+	vector<float> unsigned_distances(distances.size(), band);
+
+	//Each thread owns whole z planes so nodes are never written concurrently
+	#pragma omp parallel for schedule(dynamic)
+	for (int z = 0; z < node_num_; z++)
+	{
+		for (int triangle = 0; triangle < triangle_num; triangle++)
+		{
+			const Vector3f *corners = &triangles_[3 * triangle];
+			Vector3f low = corners[0].cwiseMin(corners[1]).cwiseMin(corners[2]).array() - band;
+			Vector3f high = corners[0].cwiseMax(corners[1]).cwiseMax(corners[2]).array() + band;
+
+			if (z * OBSTACLE_SPACING < low[2] || z * OBSTACLE_SPACING > high[2])
+			{
+				continue;
+			}
+
+			int first_x = max(int(ceil(low[0] / OBSTACLE_SPACING)), 0), last_x = min(int(high[0] / OBSTACLE_SPACING), node_num_ - 1);
+			int first_y = max(int(ceil(low[1] / OBSTACLE_SPACING)), 0), last_y = min(int(high[1] / OBSTACLE_SPACING), node_num_ - 1);
+
+			for (int y = first_y; y <= last_y; y++)
+			{
+				for (int x = first_x; x <= last_x; x++)
+				{
+					int node = x + node_num_ * (y + node_num_ * z);
+					Vector3f position(x * OBSTACLE_SPACING, y * OBSTACLE_SPACING, z * OBSTACLE_SPACING);
+					float distance = (ClosestPointOnTriangle(position, corners[0], corners[1], corners[2]) - position).norm();
+					unsigned_distances[node] = min(unsigned_distances[node], distance);
+				}
+			}
+		}
+	}
+
+	#pragma omp parallel
+	{
+		vector<float> crossings;
+
+		#pragma omp for schedule(dynamic)
+		for (int row = 0; row < node_num_ * node_num_; row++)
+		{
+			//Nudged off the node lattice so the ray does not pass exactly through mesh edges or vertices placed on it
+			float y = (row % node_num_) * OBSTACLE_SPACING + 1.3e-3f * OBSTACLE_SPACING;
+			float z = (row / node_num_) * OBSTACLE_SPACING + 1.7e-3f * OBSTACLE_SPACING;
+			crossings.resize(0);
+
+			for (int triangle = 0; triangle < triangle_num; triangle++)
+			{
+				const Vector3f &a = triangles_[3 * triangle], &b = triangles_[3 * triangle + 1], &c = triangles_[3 * triangle + 2];
+
+				//Barycentric coordinates of (y, z) in the triangle projected onto the yz plane
+				float area = (b[1] - a[1]) * (c[2] - a[2]) - (c[1] - a[1]) * (b[2] - a[2]);
+				if (area == 0)
+				{
+					continue;
+				}
+				float u = ((b[1] - y) * (c[2] - z) - (c[1] - y) * (b[2] - z)) / area;
+				float v = ((c[1] - y) * (a[2] - z) - (a[1] - y) * (c[2] - z)) / area;
+				float w = 1 - u - v;
+
+				if (u >= 0 && v >= 0 && w >= 0)
+				{
+					crossings.push_back(u * a[0] + v * b[0] + w * c[0]);
+				}
+			}
+
+			sort(crossings.begin(), crossings.end());
+
+			int crossed = 0;
+			for (int x = 0; x < node_num_; x++)
+			{
+				while (crossed < crossings.size() && crossings[crossed] < x * OBSTACLE_SPACING)
+				{
+					crossed++;
+				}
+
+				int node = x + node_num_ * row;
+				float distance = crossed % 2 == 1 ? -unsigned_distances[node] : unsigned_distances[node];
+				distances[node] = min(distances[node], distance);
+			}
+		}
+	}
+}
+
+/**
+ * \brief  Stores each nodes distance with its central difference gradient, one sided at the edges of the area.
+ * \param  distances | Node distances
+ */
+void ObstacleField::BuildGradients(const vector<float> &distances)
+{
+	int node_total = distances.size();
+	int stride = dimension_ + 1;
+	nodes_.assign(size_t(node_total) * stride, 0);
+
+	#pragma omp parallel for schedule(static)
+	for (int node = 0; node < node_total; node++)
+	{
+		nodes_[size_t(node) * stride] = distances[node];
+
+		int axis_stride = 1;
+		for (int i = 0; i < dimension_; i++)
+		{
+			int coord = node / axis_stride % node_num_;
+			int lower = coord > 0 ? node - axis_stride : node;
+			int upper = coord < node_num_ - 1 ? node + axis_stride : node;
+
+			nodes_[size_t(node) * stride + 1 + i] = (distances[upper] - distances[lower]) / (float(upper - lower) / axis_stride * OBSTACLE_SPACING);
+			axis_stride *= node_num_;
+		}
+	}
+}
+
+/**
+ * \brief  Interpolates the distance and gradient at a position from the surrounding nodes.
+ *		   Positions outside the area are clamped to its edge.
+ * \param  position | Query position
+ * \param  gradient | Output, interpolated gradient of the distance
+ * \return  | Interpolated distance to the nearest obstacle surface, negative inside
+ */
+template <int Dim>
+float ObstacleField::Sample(const Matrix<float, Dim, 1> &position, Matrix<float, Dim, 1> &gradient) const
+{
+	float fraction[Dim];
+	int axis_stride[Dim];
+	int base = 0, stride = 1;
+
+	for (int i = 0; i < Dim; i++)
+	{
+		float coord = min(max(position[i] / OBSTACLE_SPACING, 0.0f), float(node_num_ - 1));
+		int cell = min(int(coord), node_num_ - 2);
+		fraction[i] = coord - cell;
+		axis_stride[i] = stride;
+		base += cell * stride;
+		stride *= node_num_;
+	}
+
+	float sample[Dim + 1] = {};
+
+	for (int corner = 0; corner < (1 << Dim); corner++)
+	{
+		float weight = 1;
+		int node = base;
+
+		for (int i = 0; i < Dim; i++)
+		{
+			bool upper = (corner >> i) & 1;
+			weight *= upper ? fraction[i] : 1 - fraction[i];
+			node += upper ? axis_stride[i] : 0;
+		}
+
+		const float *values = &nodes_[size_t(node) * (Dim + 1)];
+		for (int k = 0; k <= Dim; k++)
+		{
+			sample[k] += weight * values[k];
+		}
+	}
+
+	gradient = Map<Matrix<float, Dim, 1>>(sample + 1);
+	return sample[0];
+}
+
+/**
+ * \brief  Number of sphere and box obstacles.
+ * \return  | Primitive count
+ */
+int ObstacleField::GetPrimitiveNumber() const
+{
+	return primitives_.size();
+}
+
+/**
+ * \brief  Number of mesh triangles.
+ * \return  | Triangle count
+ */
+int ObstacleField::GetTriangleNumber() const
+{
+	return triangles_.size() / 3;
+}
+
+/**
+ * \brief  Wall time taken to build the field.
+ * \return  | Time in seconds
+ */
+double ObstacleField::GetBuildTime() const
+{
+	return build_time_;
+}
+
+template float ObstacleField::Sample<2>(const Matrix<float, 2, 1>&, Matrix<float, 2, 1>&) const;
+template float ObstacleField::Sample<3>(const Matrix<float, 3, 1>&, Matrix<float, 3, 1>&) const;
@@ -0,0 +1,57 @@
+#pragma once
+#include "pch.h"
+#include "preprocessor.h"
+#include "Eigen/Dense"
+#include "omp.h"
+#include <string>
+#include <vector>
+
+using namespace Eigen;
+using namespace std;
+
+/**
+ * \brief  Simple solid the obstacle field is built from. Only the first dimension coordinates are used in a planar run.
+ */
+struct ObstaclePrimitive
+{
+	enum Shape { Sphere, Box } shape;
+	Vector3f centre;
+	Vector3f size; //radius in x for a sphere, half extents for a box
+};
+
+/**
+ * \brief  Static obstacles as a signed distance field and its gradient sampled on a regular grid over the simulation area.
+ *		   Built once at load time from primitives and triangle meshes, so avoidance costs each boid a single interpolated
+ *		   lookup per step however many obstacles there are. Distances are negative inside an obstacle and the gradient
+ *		   points away from the nearest surface.
+ */
+class ObstacleField
+{
+public:
+	ObstacleField() = default;
+	~ObstacleField() = default;
+
+	bool Load(const string &file_name, int dimension);
+
+	template <int Dim>
+	float Sample(const Matrix<float, Dim, 1> &position, Matrix<float, Dim, 1> &gradient) const;
+
+	int GetPrimitiveNumber() const;
+	int GetTriangleNumber() const;
+	double GetBuildTime() const;
+
+private:
+
+	int dimension_ = 3;
+	int node_num_ = 0;	//nodes per axis
+	vector<float> nodes_; //distance then gradient, dimension_ + 1 floats per node, x fastest
+	vector<ObstaclePrimitive> primitives_;
+	vector<Vector3f> triangles_; //three corners per triangle
+	double build_time_ = 0;
+
+	bool LoadMesh(const string &file_name);
+	void Build();
+	void BuildMeshDistances(vector<float> &distances);
+	void BuildGradients(const vector<float> &distances);
+	Vector3f NodePosition(int node) const;
+};
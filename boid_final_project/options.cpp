@@ -0,0 +1,193 @@
+#include "pch.h"
+#include "options.h"
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+
+/*! \file options.cpp
+	\brief Command line parsing of run time options
+*/
+
+/**
+ * \brief  Reads run time options from the command line. Unrecognised arguments are reported and ignored.
+ * \param  argc | Argument count as passed to main
+ * \param  argv | Argument values as passed to main
+ * \return  | Parsed options
+ */
+SimulationOptions ParseOptions(int argc, char* argv[])
+{
+	SimulationOptions options;
+
+	for (int i = 1; i < argc; i++)
+	{
+		string argument = argv[i];
+
+		if (argument == "--search" && i + 1 < argc)
+		{
+			if (!ParseSearchBackend(argv[++i], options.search))
+			{
+				printf("Unknown search backend %s, expected grid, cells, kdtree or hashed\n", argv[i]);
+			}
+		}
+		else if (argument == "--neighbours" && i + 1 < argc)
+		{
+			string rule = argv[++i];
+
+			if (rule == "metric")
+			{
+				options.parameters.interaction = InteractionRule::Metric;
+			}
+			else if (rule == "topological")
+			{
+				options.parameters.interaction = InteractionRule::Topological;
+			}
+			else
+			{
+				printf("Unknown interaction rule %s, expected metric or topological\n", argv[i]);
+			}
+		}
+		else if (argument == "--fast-math" && i + 1 < argc)
+		{
+			if (!ParseSqrtAccuracy(argv[++i], options.parameters.accuracy))
+			{
+				printf("Unknown sqrt accuracy %s, expected exact, coarse, refined or precise\n", argv[i]);
+			}
+		}
+		else if (argument == "--save" && i + 1 < argc)
+		{
+			string format = argv[++i];
+
+			if (format == "none")
+			{
+				options.save = SaveFormat::None;
+			}
+			else if (format == "text")
+			{
+				options.save = SaveFormat::Text;
+			}
+			else if (format == "binary")
+			{
+				options.save = SaveFormat::Binary;
+			}
+			else
+			{
+				printf("Unknown save format %s, expected none, text or binary\n", argv[i]);
+			}
+		}
+		else if (argument == "--analytics" && i + 1 < argc)
+		{
+			options.analytics_interval = max(atoi(argv[++i]), 0);
+		}
+		else if (argument == "--stream" && i + 1 < argc)
+		{
+			options.stream_interval = max(atoi(argv[++i]), 0);
+		}
+		else if (argument == "--species" && i + 1 < argc)
+		{
+			options.species_file = argv[++i];
+		}
+		else if (argument == "--obstacles" && i + 1 < argc)
+		{
+			options.obstacle_file = argv[++i];
+		}
+		else if (argument == "--stream-socket" && i + 1 < argc)
+		{
+			options.stream_socket = argv[++i];
+		}
+		else if (argument == "--check-fast-math")
+		{
+			options.check_fast_math = true;
+		}
+		else if (argument == "--check-equivalence")
+		{
+			options.check_equivalence = true;
+		}
+		else if (argument == "--steps" && i + 1 < argc)
+		{
+			options.steps = max(stoi(argv[++i]), 1);
+		}
+		else if (argument == "--synchronous")
+		{
+			options.parameters.synchronous = true;
+		}
+		else if (argument == "--tiled")
+		{
+			options.tiled = true;
+		}
+		else if (argument == "--schedule" && i + 1 < argc)
+		{
+			if (!ParseScheduleMode(argv[++i], options.schedule))
+			{
+				printf("Unknown schedule %s, expected guided, dynamic or adaptive\n", argv[i]);
+			}
+		}
+		else if (argument == "--numa")
+		{
+			options.numa = true;
+		}
+		else if (argument == "--scenario" && i + 1 < argc)
+		{
+			if (!ParseScenario(argv[++i], options.scenario))
+			{
+				printf("Unknown scenario %s, expected uniform, box, clusters or flocks\n", argv[i]);
+			}
+		}
+		else if (argument == "--seed" && i + 1 < argc)
+		{
+			options.seed = stoull(argv[++i]);
+			options.seeded = true;
+		}
+		else if (argument == "--halo" && i + 1 < argc)
+		{
+			string depth = argv[++i];
+			options.halo_depth = depth == "auto" ? -1 : max(stoi(depth), 0);
+		}
+		else if (argument == "--shared-window")
+		{
+			options.shared_window = true;
+		}
+		else if (argument == "--io-ranks" && i + 1 < argc)
+		{
+			options.io_ranks = max(stoi(argv[++i]), 0);
+		}
+		else if (argument == "--fixed-point")
+		{
+			options.fixed_point = true;
+		}
+		else if (argument == "--profile")
+		{
+			options.profile = true;
+		}
+		else if (argument == "--memory-budget" && i + 1 < argc)
+		{
+			options.memory_budget = max(stod(argv[++i]), 0.0);
+		}
+		else if (argument == "--pipeline")
+		{
+			options.pipeline = true;
+		}
+		else if (argument == "--ensemble" && i + 1 < argc)
+		{
+			options.ensemble_file = argv[++i];
+		}
+		else if (argument == "--dim" && i + 1 < argc)
+		{
+			string dimension = argv[++i];
+
+			if (dimension == "2" || dimension == "3")
+			{
+				options.dimension = stoi(dimension);
+			}
+			else
+			{
+				printf("Unsupported dimension %s, expected 2 or 3\n", argv[i]);
+			}
+		}
+		else
+		{
+			printf("Ignoring unrecognised argument %s\n", argv[i]);
+		}
+	}
+
+	return options;
+}
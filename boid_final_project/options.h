@@ -0,0 +1,51 @@
+#pragma once
+#include "neighbour_search.h"
+#include "scenario.h"
+#include "scheduler.h"
+#include <string>
+
+/**
+ * \brief  Format the boid paths are saved in at the end of a run.
+ */
+enum class SaveFormat
+{
+	None,	//!< Paths are not saved.
+	Text,	//!< Human readable text, one line per step, read by correlation.py and data_joiner.py.
+	Binary	//!< Header and packed float frames, memory mapped by the trajectory analyzer.
+};
+
+/**
+ * \brief  Run time options read from the command line. Defaults reproduce the compile time configuration.
+ */
+struct SimulationOptions
+{
+	SearchBackend search = SearchBackend::Grid;			 //!< Neighbour search backend, --search grid|cells|kdtree|hashed
+	BoidParameters parameters;							 //!< Behaviour parameters, interaction rule set by --neighbours metric|topological, sqrt accuracy by --fast-math, synchronous updates by --synchronous
+	bool tiled = false;									 //!< Update boids cell by cell against a shared gathered neighbourhood, --tiled
+	ScheduleMode schedule = ScheduleMode::Guided;		 //!< Thread schedule of the update loops, --schedule guided|dynamic|adaptive
+	bool numa = false;									 //!< Pin ranks and threads to NUMA domains and first touch boid storage in parallel, --numa
+	int halo_depth = 0;									 //!< Exchange boids every K steps through a deep halo of ghost boids, --halo K|auto. 0 exchanges every step, -1 tunes K
+	bool shared_window = false;							 //!< Share one copy of the flock per node through an MPI-3 window, --shared-window
+	int io_ranks = 0;									 //!< Ranks at the end of MPI_COMM_WORLD that only write the paths, --io-ranks N. 0 writes them from every rank at the end
+	bool pipeline = false;								 //!< Run single node steps as a task dependency graph, --pipeline
+	string ensemble_file;								 //!< Sweep file for an ensemble run, --ensemble FILE. Empty for a normal run
+	Scenario scenario = Scenario::Box;					 //!< Initial conditions, --scenario uniform|box|clusters|flocks
+	uint64_t seed = 0;									 //!< Seed of the initial conditions, --seed N
+	bool seeded = false;								 //!< Whether --seed was given, otherwise a seed is drawn at start up and printed
+	int dimension = SYS_DIM;							 //!< Number of spatial dimensions, --dim 2|3
+	SaveFormat save = SAVE ? SaveFormat::Text : SaveFormat::None; //!< Path output, --save none|text|binary
+	int analytics_interval = 0;							 //!< Sample in situ flock statistics every K steps, --analytics K. 0 disables
+	int stream_interval = 0;							 //!< Publish a live frame every K steps, --stream K. 0 disables
+	string species_file;								 //!< Species of a multi-species run, --species FILE. Empty for a single species
+	string obstacle_file;								 //!< Obstacles to build the distance field from, --obstacles FILE. Empty for open space
+	string stream_socket;								 //!< Stream to the reader bound at this local socket instead of shared memory, --stream-socket PATH
+	bool check_fast_math = false;						 //!< Validate the fast math error bounds and exit, --check-fast-math
+	bool check_equivalence = false;						 //!< Run a fixed seed flock through every backend, compare the paths and exit, --check-equivalence
+	int steps = STEPS;									 //!< Number of simulation steps, --steps N
+	int boid_number = BOID_NUMBER;						 //!< Number of boids the engine runs, set by embedding programs such as the Python bindings
+	bool fixed_point = false;							 //!< Keep positions as 32 bit fixed point over the box, wrapping round it by integer overflow, --fixed-point
+	bool profile = false;								 //!< Read hardware counters per thread around each phase of the step, --profile
+	double memory_budget = 0;							 //!< Memory each rank may use in MB, --memory-budget MB. 0 takes its share of the node's physical memory
+};
+
+SimulationOptions ParseOptions(int argc, char* argv[]);
@@ -0,0 +1,417 @@
+#include "pch.h"
+#include "phase_profiler.h"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/*! \file phase_profiler.cpp
+	\brief Per thread hardware counter profiling of the step phases through perf_event_open.
+*/
+
+using namespace std;
+
+static const char *PHASE_NAMES[PROFILE_PHASES] = { "cell_setup", "gather", "steering", "grid_update", "serialization" };
+static const char *COUNTER_NAMES[PROFILE_COUNTERS] = { "cpu_time_ns", "cycles", "instructions", "l1_misses", "llc_misses", "branch_misses" };
+
+enum
+{
+	CPU_TIME, CYCLES, INSTRUCTIONS, L1_MISSES, LLC_MISSES, BRANCH_MISSES
+};
+
+#ifdef __linux__
+/**
+ * \brief  Opens one user space counter of the calling thread on any cpu.
+ * \param  type | perf event type
+ * \param  config | perf event config
+ * \param  group | Group leader descriptor, -1 to open a leader
+ * \return  | Descriptor, -1 when the kernel refuses the counter
+ */
+static int OpenCounter(uint32_t type, uint64_t config, int group)
+{
+	perf_event_attr attr = {};
+	attr.size = sizeof(attr);
+	attr.type = type;
+	attr.config = config;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+	return syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+#endif
+
+/**
+ * \brief  Whether a counter was opened on every profiled thread, so its totals cover the whole run.
+ * \param  counter | Counter index
+ * \return  | True when available
+ */
+bool ProfileTotals::IsAvailable(int counter) const
+{
+	return threads > 0 && opened[counter] == threads;
+}
+
+/**
+ * \brief  Sets up one slot per OpenMP thread. Counters are opened by each thread when it first enters a phase.
+ * \param  enabled | Profile the run, --profile. A disabled profiler ignores every call
+ */
+PhaseProfiler::PhaseProfiler(bool enabled) : enabled_(enabled)
+{
+	if (enabled_)
+	{
+		threads_.resize(omp_get_max_threads());
+	}
+}
+
+/**
+ * \brief  Closes every thread's counters.
+ */
+PhaseProfiler::~PhaseProfiler()
+{
+#ifdef __linux__
+	for (ThreadCounters &thread : threads_)
+	{
+		for (int counter = 0; counter < PROFILE_COUNTERS && thread.group >= 0; counter++)
+		{
+			if (thread.descriptors[counter] >= 0)
+			{
+				close(thread.descriptors[counter]);
+			}
+		}
+	}
+#endif
+}
+
+/**
+ * \brief  Whether the run is profiled.
+ * \return  | True when enabled
+ */
+bool PhaseProfiler::IsEnabled() const
+{
+	return enabled_;
+}
+
+/**
+ * \brief  Charges the calling thread's counts since its last read to the phase it was in and starts counting for a new phase.
+ * \param  phase | Phase the thread is entering
+ */
+void PhaseProfiler::Enter(ProfilePhase phase)
+{
+	if (enabled_)
+	{
+		Switch(int(phase));
+	}
+}
+
+/**
+ * \brief  Charges the calling thread's counts to the phase it was in and stops charging, so waits between phases are not counted.
+ */
+void PhaseProfiler::Leave()
+{
+	if (enabled_)
+	{
+		Switch(-1);
+	}
+}
+
+/**
+ * \brief  Records boid updates made by the calling thread and the candidates they were tested against.
+ * \param  updates | Boid updates
+ * \param  interactions | Neighbour candidates scanned by those updates
+ */
+void PhaseProfiler::CountUpdates(int updates, long long interactions)
+{
+	if (!enabled_)
+	{
+		return;
+	}
+
+	int thread = omp_get_thread_num();
+	if (thread < threads_.size())
+	{
+		threads_[thread].totals.updates += updates;
+		threads_[thread].totals.interactions += interactions;
+	}
+}
+
+/**
+ * \brief  Counts of every thread of this rank.
+ * \return  | Totals, summed over threads
+ */
+ProfileTotals PhaseProfiler::GetTotals() const
+{
+	ProfileTotals totals;
+
+	for (const ThreadCounters &thread : threads_)
+	{
+		if (thread.group == -2)
+		{
+			continue;
+		}
+
+		for (int phase = 0; phase < PROFILE_PHASES; phase++)
+		{
+			totals.time[phase] += thread.totals.time[phase];
+			for (int counter = 0; counter < PROFILE_COUNTERS; counter++)
+			{
+				totals.counters[phase][counter] += thread.totals.counters[phase][counter];
+			}
+		}
+		for (int counter = 0; counter < PROFILE_COUNTERS; counter++)
+		{
+			totals.opened[counter] += thread.slots[counter] >= 0;
+		}
+		totals.interactions += thread.totals.interactions;
+		totals.updates += thread.totals.updates;
+		totals.threads++;
+	}
+
+	return totals;
+}
+
+/**
+ * \brief  Opens the calling thread's counter group. The CPU time leader is a software event, so hardware counters the machine
+ *		   lacks, as under most hypervisors, are dropped one by one without losing the rest.
+ * \param  thread | The calling thread's counters
+ */
+void PhaseProfiler::Open(ThreadCounters &thread)
+{
+	thread.group = -1;
+	thread.slot_number = 0;
+	for (int counter = 0; counter < PROFILE_COUNTERS; counter++)
+	{
+		thread.descriptors[counter] = -1;
+		thread.slots[counter] = -1;
+	}
+
+#ifdef __linux__
+	const uint32_t types[PROFILE_COUNTERS] = { PERF_TYPE_SOFTWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE };
+	const uint64_t configs[PROFILE_COUNTERS] = { PERF_COUNT_SW_TASK_CLOCK, PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+		PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16), PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES };
+
+	for (int counter = 0; counter < PROFILE_COUNTERS; counter++)
+	{
+		thread.descriptors[counter] = OpenCounter(types[counter], configs[counter], thread.group);
+		if (thread.descriptors[counter] >= 0)
+		{
+			thread.slots[counter] = thread.slot_number++;
+		}
+		if (counter == CPU_TIME)
+		{
+			thread.group = thread.descriptors[counter];
+			if (thread.group < 0)
+			{
+				return;
+			}
+		}
+	}
+#endif
+}
+
+/**
+ * \brief  Reads the calling thread's group and charges the deltas since the last read to its current phase, then moves it to a new one.
+ * \param  phase | Phase index to charge from now on, -1 for none
+ */
+void PhaseProfiler::Switch(int phase)
+{
+	int thread_number = omp_get_thread_num();
+	if (thread_number >= threads_.size())
+	{
+		return;
+	}
+
+	ThreadCounters &thread = threads_[thread_number];
+	if (thread.group == -2)
+	{
+		Open(thread);
+	}
+
+	double now = omp_get_wtime();
+	uint64_t values[PROFILE_COUNTERS] = {};
+	uint64_t enabled = 0, running = 0;
+
+#ifdef __linux__
+	uint64_t buffer[3 + PROFILE_COUNTERS]; //counter number, time enabled, time running, then the values in the order opened
+	if (thread.group >= 0 && read(thread.group, buffer, sizeof(buffer)) > 0)
+	{
+		enabled = buffer[1];
+		running = buffer[2];
+		for (int counter = 0; counter < PROFILE_COUNTERS; counter++)
+		{
+			values[counter] = thread.slots[counter] >= 0 ? buffer[3 + thread.slots[counter]] : 0;
+		}
+	}
+#endif
+
+	if (thread.phase >= 0)
+	{
+		//Counters are only running part of the time when the kernel multiplexes them, scale up to the time enabled
+		double scale = running > thread.last_running ? double(enabled - thread.last_enabled) / (running - thread.last_running) : 1;
+		thread.totals.time[thread.phase] += now - thread.last_time;
+		for (int counter = 0; counter < PROFILE_COUNTERS; counter++)
+		{
+			thread.totals.counters[thread.phase][counter] += scale * (values[counter] - thread.last_values[counter]);
+		}
+	}
+
+	thread.phase = phase;
+	thread.last_time = now;
+	thread.last_enabled = enabled;
+	thread.last_running = running;
+	copy(values, values + PROFILE_COUNTERS, thread.last_values);
+}
+
+/**
+ * \brief  Derived metrics of one phase, or of the whole step when phase is -1: CPU time, IPC, L1, last level and branch misses per interaction
+ *		   and bytes moved from memory per boid update. Negative where a counter they need was unavailable.
+ * \param  totals | Profile totals
+ * \param  phase | Phase index, -1 for all phases
+ * \param  metrics | Output, 6 values
+ */
+static void ProfileMetrics(const ProfileTotals &totals, int phase, double metrics[6])
+{
+	double counters[PROFILE_COUNTERS] = {};
+	for (int i = 0; i < PROFILE_PHASES; i++)
+	{
+		for (int counter = 0; counter < PROFILE_COUNTERS && (phase < 0 || phase == i); counter++)
+		{
+			counters[counter] += totals.counters[i][counter];
+		}
+	}
+
+	double interactions = max(totals.interactions, 1.0);
+	metrics[0] = totals.IsAvailable(CPU_TIME) ? counters[CPU_TIME] * 1e-9 : -1;
+	metrics[1] = totals.IsAvailable(CYCLES) && totals.IsAvailable(INSTRUCTIONS) ? counters[INSTRUCTIONS] / max(counters[CYCLES], 1.0) : -1;
+	metrics[2] = totals.IsAvailable(L1_MISSES) ? counters[L1_MISSES] / interactions : -1;
+	metrics[3] = totals.IsAvailable(LLC_MISSES) ? counters[LLC_MISSES] / interactions : -1;
+	metrics[4] = totals.IsAvailable(BRANCH_MISSES) ? counters[BRANCH_MISSES] / interactions : -1;
+	metrics[5] = totals.IsAvailable(LLC_MISSES) ? counters[LLC_MISSES] * PROFILE_LINE_BYTES / max(totals.updates, 1.0) : -1;
+}
+
+/**
+ * \brief  Prints the profile rows of the run summary and a table of the metrics of each phase. Misses are per interaction, a candidate
+ *		   tested by a boid update, and bytes are last level misses times PROFILE_LINE_BYTES per boid update, both over the whole step.
+ * \param  totals | Profile totals, reduced over ranks
+ */
+void PrintProfile(const ProfileTotals &totals)
+{
+	double metrics[6];
+	ProfileMetrics(totals, -1, metrics);
+
+	printf("|  Profiled threads  |%10d|\n", int(totals.threads));
+	printf(" --------------------------------\n");
+	printf("|  Interactions/upd  |%10.1f|\n", totals.interactions / max(totals.updates, 1.0));
+	printf(" --------------------------------\n");
+	const char *labels[5] = { "|        IPC         |", "| L1 miss/interact.  |", "| LLC miss/interact. |", "|Branch miss/interact|", "|  Bytes/boid update |" };
+	for (int i = 0; i < 5; i++)
+	{
+		if (metrics[i + 1] < 0)
+		{
+			printf("%s%10s|\n", labels[i], "n/a");
+		}
+		else
+		{
+			printf("%s%10.4f|\n", labels[i], metrics[i + 1]);
+		}
+		printf(" --------------------------------\n");
+	}
+
+	printf("Phase profile, summed over ranks and threads:\n");
+	printf("  %-14s %10s %10s %8s %12s %12s %12s %12s\n", "phase", "wall/s", "cpu/s", "IPC", "L1/interact", "LLC/interact", "br/interact", "bytes/update");
+	for (int phase = 0; phase < PROFILE_PHASES; phase++)
+	{
+		ProfileMetrics(totals, phase, metrics);
+		printf("  %-14s %10.4f", PHASE_NAMES[phase], totals.time[phase]);
+		for (int i = 0; i < 6; i++)
+		{
+			int width = i == 0 ? 10 : i == 1 ? 8 : 12;
+			if (metrics[i] < 0)
+			{
+				printf(" %*s", width, "n/a");
+			}
+			else
+			{
+				printf(" %*.4f", width, metrics[i]);
+			}
+		}
+		printf("\n");
+	}
+	if (!totals.IsAvailable(CYCLES))
+	{
+		printf("Hardware counters unavailable, check perf_event_paranoid and that the machine exposes a PMU\n");
+	}
+}
+
+/**
+ * \brief  Writes a JSON object of one derived metric value, null when unavailable.
+ * \param  file | Open file
+ * \param  name | Key
+ * \param  value | Metric, negative when unavailable
+ * \param  last | Whether this is the last key of its object
+ */
+static void WriteMetric(ofstream &file, const char *name, double value, bool last)
+{
+	file << "\"" << name << "\": ";
+	if (value < 0)
+	{
+		file << "null";
+	}
+	else
+	{
+		file << value;
+	}
+	file << (last ? "" : ", ");
+}
+
+/**
+ * \brief  Writes the profile as a benchmark JSON file: raw counts and derived metrics for each phase and for the whole step.
+ *		   Counts of unavailable counters are null.
+ * \param  name | What to name the file, without extension
+ * \param  totals | Profile totals, reduced over ranks
+ * \param  ranks | Ranks the totals were summed over
+ */
+void WriteProfile(const string &name, const ProfileTotals &totals, int ranks)
+{
+	ofstream file(name + ".json");
+	file.precision(10);
+	double metrics[6];
+
+	file << "{\n";
+	file << "  \"ranks\": " << ranks << ",\n";
+	file << "  \"threads\": " << totals.threads << ",\n";
+	file << "  \"boid_updates\": " << totals.updates << ",\n";
+	file << "  \"interactions\": " << totals.interactions << ",\n";
+	file << "  \"phases\": {\n";
+	for (int phase = -1; phase < PROFILE_PHASES; phase++)
+	{
+		file << "    \"" << (phase < 0 ? "total" : PHASE_NAMES[phase]) << "\": { ";
+		double time = 0;
+		for (int i = 0; i < PROFILE_PHASES; i++)
+		{
+			time += phase < 0 || phase == i ? totals.time[i] : 0;
+		}
+		file << "\"wall_time\": " << time << ", ";
+		for (int counter = 0; counter < PROFILE_COUNTERS; counter++)
+		{
+			double count = 0;
+			for (int i = 0; i < PROFILE_PHASES; i++)
+			{
+				count += phase < 0 || phase == i ? totals.counters[i][counter] : 0;
+			}
+			WriteMetric(file, COUNTER_NAMES[counter], totals.IsAvailable(counter) ? count : -1, false);
+		}
+		ProfileMetrics(totals, phase, metrics);
+		WriteMetric(file, "ipc", metrics[1], false);
+		WriteMetric(file, "l1_misses_per_interaction", metrics[2], false);
+		WriteMetric(file, "llc_misses_per_interaction", metrics[3], false);
+		WriteMetric(file, "branch_misses_per_interaction", metrics[4], false);
+		WriteMetric(file, "bytes_per_boid_update", metrics[5], true);
+		file << " }" << (phase == PROFILE_PHASES - 1 ? "\n" : ",\n");
+	}
+	file << "  }\n";
+	file << "}\n";
+}
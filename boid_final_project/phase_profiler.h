@@ -0,0 +1,86 @@
+#pragma once
+#include "pch.h"
+#include "preprocessor.h"
+#include "omp.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/**
+ * \brief  Phases of a step the profiler attributes counts to.
+ */
+enum class ProfilePhase
+{
+	CellSetup,		//!< Looking up the cells or leaves around a boid, or a cell's neighbourhood for the tiled kernel.
+	Gather,			//!< Scanning candidates into the nearby boid buffer, or copying them into a tile.
+	Steering,		//!< Steering sums, forces and integration.
+	GridUpdate,		//!< Moving boids between cells and rebuilding the search structure.
+	Serialization	//!< Packing, sending and unpacking boids and grid moves between ranks.
+};
+
+constexpr int PROFILE_PHASES = 5;
+constexpr int PROFILE_COUNTERS = 6; //CPU time, cycles, instructions, L1 data read misses, last level cache misses, branch mispredictions
+
+/**
+ * \brief  Counts of a profiled run, summed over threads and, once reduced, over ranks. Only doubles, so ranks sum it as one MPI_DOUBLE array.
+ */
+struct ProfileTotals
+{
+	double time[PROFILE_PHASES] = {};						//Wall time in each phase, summed over threads
+	double counters[PROFILE_PHASES][PROFILE_COUNTERS] = {}; //Counter deltas in each phase, scaled up when the kernel multiplexed them
+	double interactions = 0;								//Neighbour candidates the updated boids were tested against
+	double updates = 0;										//Boid updates
+	double opened[PROFILE_COUNTERS] = {};					//Threads each counter could be opened on
+	double threads = 0;										//Threads that profiled
+
+	bool IsAvailable(int counter) const;
+};
+
+/**
+ * \brief  Hardware counter profile of the step phases. Each thread opens its own perf_event_open group the first time it enters a phase:
+ *		   CPU time as the leader, then cycles, instructions, L1 data read misses, last level cache misses and branch mispredictions,
+ *		   all user space only. Entering a phase reads the group in one system call and charges the counts since the last read to
+ *		   the phase the thread was in, so phases may interleave at boid granularity. Counters the kernel or hardware refuse are left out
+ *		   and reported as unavailable; without perf_event_open (not Linux, or a restrictive perf_event_paranoid) only wall time is profiled.
+ */
+class PhaseProfiler
+{
+public:
+	PhaseProfiler(bool enabled);
+	~PhaseProfiler();
+
+	bool IsEnabled() const;
+	void Enter(ProfilePhase phase);
+	void Leave();
+	void CountUpdates(int updates, long long interactions);
+	ProfileTotals GetTotals() const;
+
+private:
+
+	struct ThreadCounters
+	{
+		int group = -2;						//Group leader descriptor, -2 until the thread first profiles, -1 when perf_event_open failed
+		int descriptors[PROFILE_COUNTERS];	//-1 for counters that could not be opened
+		int slots[PROFILE_COUNTERS];		//Position of each counter in a group read, -1 when not opened
+		int slot_number = 0;
+		int phase = -1;						//Phase the counts since the last read belong to, -1 between phases
+		double last_time = 0;
+		uint64_t last_enabled = 0;
+		uint64_t last_running = 0;
+		uint64_t last_values[PROFILE_COUNTERS] = {};
+		ProfileTotals totals;
+		char padding[64];					//Keeps neighbouring threads' counts off this cache line
+	};
+
+	bool enabled_;
+	vector<ThreadCounters> threads_;
+
+	void Open(ThreadCounters &thread);
+	void Switch(int phase);
+};
+
+void PrintProfile(const ProfileTotals &totals);
+
+void WriteProfile(const string &name, const ProfileTotals &totals, int ranks);
@@ -0,0 +1,180 @@
+#include "pch.h"
+#include "pipeline.h"
+
+/*! \file pipeline.cpp
+	\brief Single node simulation expressed as a task dependency graph instead of barrier separated phases.
+*/
+
+using namespace std;
+using namespace Eigen;
+
+/**
+ * \brief  Kinds of task in the step graph, used to index the busy time accounting.
+ */
+enum PipelineTask
+{
+	COMPUTE_TASK,
+	OUTPUT_TASK,
+	GRID_TASK,
+	TASK_KINDS
+};
+
+/**
+ * \brief   Runs the same flock through the engine's barrier separated step, the boid update, then the serial grid update,
+ *			then the output of every position, and times it for comparison with the task graph.
+ * \param   options | Run time options
+ * \param   paths | Filled with the boid positions of every step
+ * \return  | Wall time of the steps
+ */
+static double TimeBarrierSteps(SimulationOptions options, vector<Vector3f> &paths)
+{
+	options.tiled = false; //the task graph runs the plain kernel
+	options.profile = false;
+
+	Simulation<3> simulation(options);
+	simulation.AddHook([&](int step, Simulation<3> &simulation)
+	{
+		const vector<Boid> &boids = simulation.GetBoids();
+
+		#pragma omp parallel for schedule(static)
+		for (int boid = 0; boid < BOID_NUMBER; boid++)
+		{
+			paths[PathIndice(boid, step, BOID_NUMBER)] = boids[boid].GetPosition();
+		}
+	});
+
+	double start_time = MPI_Wtime();
+	simulation.Run(options.steps);
+	return MPI_Wtime() - start_time;
+}
+
+/**
+ * \brief   Main function for executing the simulation on a single node as a task graph.
+ *			Each step is split into per block compute tasks, per block output tasks and one grid task, linked by
+ *			depend clauses on the first boid of each block and on the search structure. Steps are chained by them alone,
+ *			so output of a block overlaps the compute of other blocks, the grid rebuild and the next step, and no step
+ *			ends with a barrier. The same flock is first run and timed with the barrier step for comparison.
+ * \param   options | Run time options
+ * \return  | Boid positions for each step of the simulation
+ */
+vector<Vector3f> run_pipelined(const SimulationOptions &options)
+{
+	vector<Vector3f> paths(BOID_NUMBER*size_t(options.steps));
+	double barrier_time = TimeBarrierSteps(options, paths); //paths are overwritten by the task graph run
+
+	double setup_start = MPI_Wtime();
+	int size = 1;
+
+	vector<Boid> boids(BOID_NUMBER);
+	vector<int> grid_updates;
+
+	if (options.numa)
+	{
+		FirstTouchBoids(boids, 0, BOID_NUMBER);
+	}
+
+	GenerateBoids(boids, 0, BOID_NUMBER, options.scenario, options.seed);
+
+	unique_ptr<NeighbourSearch> grid_owner = CreateNeighbourSearch(options.search, boids, options.parameters.sight_range);
+	NeighbourSearch *grid = grid_owner.get();
+
+	int block_number = (BOID_NUMBER + PIPELINE_BLOCK - 1) / PIPELINE_BLOCK;
+	int thread_number = omp_get_max_threads();
+	Boid *flock = boids.data(); //a block's first boid stands for the block in depend clauses, the search structure for itself
+	vector<double> busy_time(thread_number * TASK_KINDS, 0.0); //per thread, per task kind
+
+	double start_time = MPI_Wtime();
+
+	#pragma omp parallel
+	#pragma omp single
+	for (int step = 0; step < options.steps; step++)
+	{
+		for (int block = 0; block < block_number; block++)
+		{
+			#pragma omp task firstprivate(block) shared(busy_time, options) depend(in: *grid) depend(inout: flock[block * PIPELINE_BLOCK])
+			{
+				double task_start = omp_get_wtime();
+				int end = min(BOID_NUMBER, (block + 1) * PIPELINE_BLOCK);
+				for (int boid = block * PIPELINE_BLOCK; boid < end; boid++)
+				{
+					grid->UpdateNearCells(flock[boid]);
+					flock[boid].Update(options.parameters);
+				}
+				busy_time[omp_get_thread_num() * TASK_KINDS + COMPUTE_TASK] += omp_get_wtime() - task_start;
+			}
+		}
+
+		for (int block = 0; block < block_number; block++)
+		{
+			#pragma omp task firstprivate(block, step) shared(busy_time, paths) depend(in: flock[block * PIPELINE_BLOCK])
+			{
+				double task_start = omp_get_wtime();
+				int end = min(BOID_NUMBER, (block + 1) * PIPELINE_BLOCK);
+				for (int boid = block * PIPELINE_BLOCK; boid < end; boid++)
+				{
+					paths[PathIndice(boid, step, BOID_NUMBER)] = flock[boid].GetPosition();
+				}
+				busy_time[omp_get_thread_num() * TASK_KINDS + OUTPUT_TASK] += omp_get_wtime() - task_start;
+			}
+		}
+
+		//Grid task writes the search structure every compute task of this step reads, so it waits for all of them,
+		//and must finish before any compute of the next step, which is all that orders the steps,
+		//output of this step still runs alongside the next
+		#pragma omp task shared(busy_time, grid_updates, size) depend(out: *grid)
+		{
+			double task_start = omp_get_wtime();
+			for (int boid = 0; boid < BOID_NUMBER; boid++)
+			{
+				grid->UpdateGrid(flock[boid], grid_updates, size);
+			}
+			grid->Rebuild();
+			busy_time[omp_get_thread_num() * TASK_KINDS + GRID_TASK] += omp_get_wtime() - task_start;
+		}
+	}
+
+	double end_time = MPI_Wtime();
+
+	double work[TASK_KINDS] = {};
+	for (int thread = 0; thread < thread_number; thread++)
+	{
+		for (int kind = 0; kind < TASK_KINDS; kind++)
+		{
+			work[kind] += busy_time[thread * TASK_KINDS + kind];
+		}
+	}
+
+	double wall_time = end_time - start_time;
+	double total_work = work[COMPUTE_TASK] + work[OUTPUT_TASK] + work[GRID_TASK];
+
+	printf("*******Simulation Completed******\n");
+	printf(" --------------------------------\n");
+	printf("|  Number of Boids   |%10d|\n", BOID_NUMBER);
+	printf(" --------------------------------\n");
+	printf("|  Number of Steps   |%10d|\n", options.steps);
+	printf(" -------------------------------\n");
+	printf("|   Number of Nodes  |%10d|\n", size);
+	printf(" -------------------------------\n");
+	printf("|Number of Processors|%10d|\n", thread_number);
+	printf(" --------------------------------\n");
+	printf("|   Search Backend   |%10s|\n", SearchBackendName(options.search));
+	printf(" --------------------------------\n");
+	printf("|      Scenario      |%10s|\n", ScenarioName(options.scenario));
+	printf(" --------------------------------\n");
+	printf("|        Seed        |%10llu|\n", (unsigned long long)options.seed);
+	printf(" --------------------------------\n");
+	printf("|  Startup time/s    |%10f|\n", start_time - setup_start);
+	printf(" --------------------------------\n");
+	printf("|    Time taken/s    |%10f|\n", wall_time);
+	printf(" --------------------------------\n");
+	printf("|  Compute work/s    |%10f|\n", work[COMPUTE_TASK]);
+	printf("|  Output work/s     |%10f|\n", work[OUTPUT_TASK]);
+	printf("|  Grid work/s       |%10f|\n", work[GRID_TASK]);
+	printf(" --------------------------------\n");
+	printf("|  Thread idle/s     |%10f|\n", thread_number * wall_time - total_work);
+	printf("| Barrier steps/s    |%10f|\n", barrier_time);
+	printf("|  Time saved/%%      |%10.2f|\n", 100.0 * (barrier_time - wall_time) / barrier_time);
+	printf(" --------------------------------\n");
+
+	return paths;
+}
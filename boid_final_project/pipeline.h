@@ -0,0 +1,16 @@
+#pragma once
+#include "pch.h"
+#include "preprocessor.h"
+#include "boid.h"
+#include "neighbour_search.h"
+#include "options.h"
+#include "topology.h"
+#include "simulation.h"
+#include "Eigen/Dense"
+#include <mpi.h>
+#include <random>
+#include <vector>
+#include <cstdio>
+#include "omp.h"
+
+vector<Vector3f> run_pipelined(const SimulationOptions &options);
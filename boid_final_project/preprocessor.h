@@ -29,6 +29,12 @@ constexpr auto SAVE = false;
  */
 constexpr auto BUFFER_FRACTION = 4 ;
 
+/**
+ * \brief  Cap on the nearby boids buffer a boid starts with. BOID_NUMBER/BUFFER_FRACTION entries per boid grows with the square
+ *		   of the flock, so large flocks start at this size and a boid's buffer doubles only when its neighbours overfill it.
+ */
+constexpr auto NEIGHBOUR_BUFFER_MAX = 1024;
+
 /**
  * \brief   Spatial Dimensions of the system.
  */
@@ -51,6 +57,12 @@ constexpr auto SIGHT_RANGE = 100;
  */
 constexpr auto SIGHT_RANGE_SQ = SIGHT_RANGE * SIGHT_RANGE;
 
+/**
+ * \brief  Number of nearest neighbours a boid interacts with under the topological interaction rule.
+ *		   7 follows field observations of starling flocks.
+ */
+constexpr auto TOPOLOGICAL_NEIGHBOURS = 7;
+
 /**
  * \brief  Number of boids in the simulation 
  */
@@ -92,17 +104,152 @@ constexpr auto ALIGNMENT_FACTOR = 1;
 constexpr auto SEPARATION_FACTOR = 1.05;
 
 /**
- * \brief  Type of OpenMP thread distribution to split work for thread team 
+ * \brief  Maximum number of boids in a k-d tree leaf.
+ *		   Smaller leaves prune more candidates per query but deepen the tree.
+ */
+constexpr auto KD_LEAF_SIZE = 16;
+
+/**
+ * \brief  Depth down to which the k-d tree is split level by level across threads, below it each subtree is built by one thread.
+ */
+constexpr auto KD_PARALLEL_DEPTH = 6;
+
+/**
+ * \brief  Boids per block in the pipelined step. Each block gets its own compute and output task every step.
+ */
+constexpr auto PIPELINE_BLOCK = 128;
+
+/**
+ * \brief  Bins of the in situ neighbour count histogram. The last bin counts every boid with at least ANALYTICS_BINS - 1 neighbours.
+ */
+constexpr auto ANALYTICS_BINS = 16;
+
+/**
+ * \brief  Boid whose distance to every other boid is traced by the in situ analytics.
+ */
+constexpr auto ANALYTICS_TRACE_BOID = 100;
+
+/**
+ * \brief  Magic constant of the bit level reciprocal square root estimate used by the fast math path.
+ */
+constexpr unsigned int RSQRT_MAGIC = 0x5f3759df;
+
+/**
+ * \brief  Name of the shared memory region live frames are streamed through.
+ */
+constexpr auto STREAM_NAME = "/boid-stream";
+
+/**
+ * \brief  Frames the live stream ring holds. A reader may fall this many frames behind before frames are dropped.
+ */
+constexpr auto STREAM_SLOTS = 8;
+
+/**
+ * \brief  Node spacing of the precomputed obstacle distance field. LENGTH / OBSTACLE_SPACING + 1 nodes per axis.
+ */
+constexpr auto OBSTACLE_SPACING = 10;
+
+/**
+ * \brief  Distance from an obstacle surface within which boids steer away from it.
+ *		   Mesh distances are only computed out to this range plus two nodes, beyond it the field is clamped.
+ */
+constexpr auto OBSTACLE_RANGE = 50;
+
+/**
+ * \brief  Weighting factor for obstacle avoidance acceleration component.
+ */
+constexpr auto AVOIDANCE_FACTOR = 2;
+
+/**
+ * \brief  Steps and seed of the --check-equivalence flock, the largest deviation allowed between runs that visit neighbours
+ *		   in a different order, how many boids may pass it and how far those may be off. Rounding differences grow chaotically once
+ *		   flocks form, so the check runs few steps, over which they stay around 1e-4. A neighbour at the very edge of sight can round
+ *		   onto either side of it, which moves that boid and a few around it by up to about 1e-2, while a missed neighbour cell
+ *		   shifts most of the flock by far more.
+ */
+constexpr auto VALIDATE_STEPS = 10;
+constexpr auto VALIDATE_SEED = 20240229ULL;
+constexpr auto VALIDATE_TOLERANCE = 1e-3;
+constexpr auto VALIDATE_OUTLIERS = 20;
+constexpr auto VALIDATE_OUTLIER_TOLERANCE = 5e-2;
+
+/**
+ * \brief  Frames a compute rank ships to its I/O server per message, and a server writes per block.
+ */
+constexpr auto IO_BATCH = 16;
+
+/**
+ * \brief  Most elements passed to a single MPI call. MPI counts are int, so larger transfers are split into calls of this many elements.
+ */
+constexpr auto MPI_CHUNK = 1 << 30;
+
+/**
+ * \brief  Share of a node's physical memory the start up planner lets the ranks on it use, the rest is left to MPI and the system.
+ */
+constexpr auto MEMORY_HEADROOM = 0.9;
+
+/**
+ * \brief  Bytes a last level cache miss brings in from memory, one cache line, for the profiled bytes per boid update.
+ */
+constexpr auto PROFILE_LINE_BYTES = 64;
+
+/**
+ * \brief  Conversions between box lengths and fixed point coordinates, which map [0, LENGTH) onto the full 32 bit unsigned range
+ *		   so wrapping round the box is integer overflow. One unit of the last place is LENGTH / 2^32 everywhere in the box.
+ */
+constexpr double FIXED_RANGE = 4294967296.0;
+constexpr float LENGTH_TO_FIXED = float(FIXED_RANGE / LENGTH);
+constexpr float FIXED_TO_LENGTH = float(LENGTH / FIXED_RANGE);
+
+/**
+ * \brief  Exchanges a tuned deep halo run makes at depth 1 to measure exchange and update times before picking its depth.
+ */
+constexpr auto DEEP_HALO_WARMUP = 4;
+
+/**
+ * \brief  Largest depth a tuned deep halo may pick.
+ */
+constexpr auto DEEP_HALO_MAX = 8;
+
+/**
+ * \brief  Number of clusters or flocks the clusters and flocks scenarios start from.
+ */
+constexpr auto SCENARIO_GROUPS = 8;
+
+/**
+ * \brief  Standard deviation of boid positions about their cluster or flock centre.
+ */
+constexpr auto SCENARIO_SPREAD = 40;
+
+/**
+ * \brief  Speed of a pre-formed flock as a fraction of MAX_SPEED, and the standard deviation of each boids velocity about it.
+ */
+constexpr auto SCENARIO_FLOCK_SPEED = 0.5;
+constexpr auto SCENARIO_FLOCK_NOISE = 0.1;
+
+/**
+ * \brief  Type of OpenMP thread distribution to split work for thread team. The boid and cell update loops take --schedule instead.
  */
 #define SCHEDULE guided
 
 /**
- * \brief  Multi-dimensional indexing of 1D paths vector 
+ * \brief  Boids or cells handed out at a time by the dynamic schedule.
+ */
+constexpr auto SCHEDULE_DYNAMIC_CHUNK = 16;
+
+/**
+ * \brief  Chunks per thread the adaptive schedule cuts a loop into, and the steps between rebuilding them from measured costs.
+ */
+constexpr auto SCHEDULE_CHUNKS = 4;
+constexpr auto SCHEDULE_INTERVAL = 8;
+
+/**
+ * \brief  Multi-dimensional indexing of 1D paths vector. 64 bit, steps * boids passes 2^31 on long runs of large flocks.
  * \param  boid | Boid index
  * \param  step | Step index
  * \param  boid_number | Number of boids stored in the vector
  */
-#define PathIndice(boid,step,boid_number) step*boid_number+boid
+#define PathIndice(boid,step,boid_number) (size_t(step)*(boid_number)+(boid))
 
 /**
  * \brief  Multi-dimensional indexing of 1D paths vector for a selection of boids (ie a nodes share of the work).
@@ -111,4 +258,4 @@ constexpr auto SEPARATION_FACTOR = 1.05;
  * \param  boid_number | Number of boids stored in the vector
  * \param  start | Boid index for the start of the section of the vector the node is responsible for.
  */
-#define MultiPathIndice(boid,step,boid_number,start) step*boid_number+(boid-start)
\ No newline at end of file
+#define MultiPathIndice(boid,step,boid_number,start) (size_t(step)*(boid_number)+((boid)-(start)))
\ No newline at end of file
@@ -0,0 +1,131 @@
+#include "pch.h"
+#include "scenario.h"
+
+/*! \file scenario.cpp
+	\brief Initial conditions generated in parallel from a counter based random stream.
+*/
+
+using namespace std;
+using namespace Eigen;
+
+/**
+ * \brief  Sets the position and velocity of a range of boids. Each boid draws from its own stream keyed by the seed and its
+ *		   index, and each group centre and heading from the stream of its group index at step GROUP_STEP, so any rank or thread
+ *		   can generate any boid and a seed reproduces the same flock whatever the number of ranks and threads.
+ * \param  boids | Boid vector
+ * \param  start | First boid to generate
+ * \param  end | One past the last boid to generate
+ * \param  scenario | Initial conditions
+ * \param  seed | Run seed
+ * \param  first | Index of the boid held at boids[0], for vectors holding only part of the flock
+ */
+template <int Dim>
+void GenerateBoids(vector<BoidT<Dim>> &boids, int start, int end, Scenario scenario, uint64_t seed, int first)
+{
+	typedef typename BoidT<Dim>::VectorD VectorD;
+	const uint32_t GROUP_STEP = 0xFFFFFFFF; //reserved step, boid streams use step 0
+
+	vector<VectorD> centres(SCENARIO_GROUPS);
+	vector<VectorD> headings(SCENARIO_GROUPS);
+	for (int group = 0; group < SCENARIO_GROUPS; group++)
+	{
+		PhiloxStream random(seed, group, GROUP_STEP);
+		for (int i = 0; i < Dim; i++)
+		{
+			centres[group][i] = random.Uniform(0, LENGTH);
+			headings[group][i] = random.Gaussian();
+		}
+		headings[group] *= float(SCENARIO_FLOCK_SPEED * MAX_SPEED) / headings[group].norm();
+	}
+
+	#pragma omp parallel for schedule(static)
+	for (int boid = start; boid < end; boid++)
+	{
+		PhiloxStream random(seed, boid, 0);
+		int group = boid % SCENARIO_GROUPS;
+		VectorD position, velocity;
+
+		for (int i = 0; i < Dim; i++)
+		{
+			switch (scenario)
+			{
+			case Scenario::Uniform:
+				position[i] = random.Uniform(0, LENGTH);
+				velocity[i] = random.Uniform(-MAX_SPEED, MAX_SPEED);
+				break;
+			case Scenario::Clusters:
+				position[i] = centres[group][i] + SCENARIO_SPREAD * random.Gaussian();
+				velocity[i] = random.Uniform(-MAX_SPEED, MAX_SPEED);
+				break;
+			case Scenario::Flocks:
+				position[i] = centres[group][i] + SCENARIO_SPREAD * random.Gaussian();
+				velocity[i] = headings[group][i] + SCENARIO_FLOCK_NOISE * MAX_SPEED * random.Gaussian();
+				break;
+			default:
+				position[i] = random.Uniform(LENGTH / 4, 3 * LENGTH / 4);
+				velocity[i] = random.Uniform(-MAX_SPEED, MAX_SPEED);
+				break;
+			}
+
+			//Clusters near an edge wrap round like the boids do
+			position[i] = fmod(fmod(position[i], float(LENGTH)) + LENGTH, float(LENGTH));
+		}
+
+		boids[boid - first].SetState(position, velocity);
+	}
+}
+
+/**
+ * \brief  Reads a scenario name from the command line.
+ * \param  name | uniform, box, clusters or flocks
+ * \param  scenario | Set to the named scenario
+ * \return  | False if the name is not recognised
+ */
+bool ParseScenario(const string &name, Scenario &scenario)
+{
+	if (name == "uniform")
+	{
+		scenario = Scenario::Uniform;
+	}
+	else if (name == "box")
+	{
+		scenario = Scenario::Box;
+	}
+	else if (name == "clusters")
+	{
+		scenario = Scenario::Clusters;
+	}
+	else if (name == "flocks")
+	{
+		scenario = Scenario::Flocks;
+	}
+	else
+	{
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * \brief  Name of a scenario for printing in the run summary.
+ * \param  scenario | Scenario to name
+ * \return  | Printable name, matching what ParseScenario accepts
+ */
+const char* ScenarioName(Scenario scenario)
+{
+	switch (scenario)
+	{
+	case Scenario::Uniform:
+		return "uniform";
+	case Scenario::Clusters:
+		return "clusters";
+	case Scenario::Flocks:
+		return "flocks";
+	default:
+		return "box";
+	}
+}
+
+template void GenerateBoids<2>(vector<BoidT<2>>&, int, int, Scenario, uint64_t, int);
+template void GenerateBoids<3>(vector<BoidT<3>>&, int, int, Scenario, uint64_t, int);
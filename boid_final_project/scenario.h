@@ -0,0 +1,26 @@
+#pragma once
+#include "pch.h"
+#include "preprocessor.h"
+#include "boid.h"
+#include "counter_rng.h"
+#include "omp.h"
+#include <vector>
+#include <string>
+
+/**
+ * \brief  Initial conditions a run starts from, selectable at runtime.
+ */
+enum class Scenario
+{
+	Uniform,	//!< Positions uniform over the whole domain.
+	Box,		//!< Positions uniform over the middle half of the domain on every axis, the original start.
+	Clusters,	//!< SCENARIO_GROUPS Gaussian clusters of spread SCENARIO_SPREAD with random velocities.
+	Flocks		//!< SCENARIO_GROUPS Gaussian clusters each already heading one way, with a little velocity noise.
+};
+
+template <int Dim>
+void GenerateBoids(vector<BoidT<Dim>> &boids, int start, int end, Scenario scenario, uint64_t seed, int first = 0);
+
+bool ParseScenario(const string &name, Scenario &scenario);
+
+const char* ScenarioName(Scenario scenario);
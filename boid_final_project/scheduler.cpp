@@ -0,0 +1,168 @@
+#include "pch.h"
+#include "scheduler.h"
+#include <algorithm>
+
+/*! \file scheduler.cpp
+	\brief Cost balanced scheduling of the update loops from the costs measured in the step before.
+*/
+
+using namespace std;
+
+/**
+ * \brief  Sets up the scheduler of one loop.
+ * \param  mode | Scheduling mode
+ */
+LoopScheduler::LoopScheduler(ScheduleMode mode) : mode_(mode)
+{
+}
+
+/**
+ * \brief  Scheduling mode.
+ * \return  | Mode from the command line
+ */
+ScheduleMode LoopScheduler::GetMode() const
+{
+	return mode_;
+}
+
+/**
+ * \brief  Share of the threads time in the loop spent waiting at its closing barrier for the slowest thread.
+ * \return  | Idle fraction
+ */
+double LoopScheduler::GetIdleFraction() const
+{
+	return loop_time_ > 0 ? idle_time_ / (loop_time_ * max(int(finish_times_.size()), 1)) : 0;
+}
+
+/**
+ * \brief  Wall time spent in the loop.
+ * \return  | Time in seconds
+ */
+double LoopScheduler::GetLoopTime() const
+{
+	return loop_time_;
+}
+
+/**
+ * \brief  Times the adaptive chunks were rebuilt from measured costs.
+ * \return  | Rebuild count
+ */
+int LoopScheduler::GetRebuilds() const
+{
+	return rebuilds_;
+}
+
+/**
+ * \brief  Run by one thread before the loop. Sizes the cost and finish time buffers, and in adaptive mode rebuilds
+ *		   the chunks every SCHEDULE_INTERVAL loops or when the range changes.
+ * \param  begin | First item
+ * \param  end | One past the last item
+ */
+void LoopScheduler::Plan(int begin, int end)
+{
+	finish_times_.resize(omp_get_num_threads());
+	bool moved = begin != begin_ || end != end_;
+
+	if (moved)
+	{
+		//Unknown costs count the same, so the first chunks split the items evenly
+		begin_ = begin;
+		end_ = end;
+		costs_.assign(end - begin, 0);
+	}
+
+	if (mode_ == ScheduleMode::Adaptive && (moved || calls_ % SCHEDULE_INTERVAL == 0))
+	{
+		Build();
+	}
+
+	calls_++;
+	start_time_ = omp_get_wtime();
+}
+
+/**
+ * \brief  Cuts the range into chunks of equal total cost. An item costs one more than measured, so a run of items that
+ *		   cost nothing still spreads over the chunks.
+ */
+void LoopScheduler::Build()
+{
+	int chunk_number = max(1, int(finish_times_.size()) * SCHEDULE_CHUNKS);
+	long long total = 0;
+	for (int cost : costs_)
+	{
+		total += cost + 1;
+	}
+
+	chunk_starts_.assign(1, begin_);
+	long long sum = 0;
+	for (int i = 0; i < costs_.size() && chunk_starts_.size() < chunk_number; i++)
+	{
+		sum += costs_[i] + 1;
+		if (sum * chunk_number >= total * (long long)chunk_starts_.size())
+		{
+			chunk_starts_.push_back(begin_ + i + 1);
+		}
+	}
+	chunk_starts_.push_back(end_);
+
+	rebuilds_++;
+}
+
+/**
+ * \brief  Run by one thread after the loop. Adds how long each thread waited for the last one to finish.
+ */
+void LoopScheduler::Account()
+{
+	double last = *max_element(finish_times_.begin(), finish_times_.end());
+	for (double finish_time : finish_times_)
+	{
+		idle_time_ += last - finish_time;
+	}
+	loop_time_ += last - start_time_;
+}
+
+/**
+ * \brief  Reads a scheduling mode from the command line.
+ * \param  name | guided, dynamic or adaptive
+ * \param  mode | Set to the named mode
+ * \return  | False if the name is not recognised
+ */
+bool ParseScheduleMode(const string &name, ScheduleMode &mode)
+{
+	if (name == "guided")
+	{
+		mode = ScheduleMode::Guided;
+	}
+	else if (name == "dynamic")
+	{
+		mode = ScheduleMode::Dynamic;
+	}
+	else if (name == "adaptive")
+	{
+		mode = ScheduleMode::Adaptive;
+	}
+	else
+	{
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * \brief  Name of a scheduling mode for printing in the run summary.
+ * \param  mode | Mode to name
+ * \return  | Printable name, matching what ParseScheduleMode accepts
+ */
+const char* ScheduleModeName(ScheduleMode mode)
+{
+	switch (mode)
+	{
+	case ScheduleMode::Dynamic:
+		return "dynamic";
+	case ScheduleMode::Adaptive:
+		return "adaptive";
+	default:
+		return "guided";
+	}
+}
@@ -0,0 +1,118 @@
+#pragma once
+#include "pch.h"
+#include "preprocessor.h"
+#include "omp.h"
+#include <vector>
+#include <string>
+
+using namespace std;
+
+/**
+ * \brief  How the threads split the boid and cell update loops, selectable at runtime.
+ */
+enum class ScheduleMode
+{
+	Guided,		//!< schedule(guided), the compile time SCHEDULE.
+	Dynamic,	//!< schedule(dynamic, SCHEDULE_DYNAMIC_CHUNK).
+	Adaptive	//!< Chunks of equal measured cost, rebuilt every SCHEDULE_INTERVAL steps from the costs of the step before.
+};
+
+/**
+ * \brief  Scheduler of one update loop. The loop body returns the cost of each item, the neighbour candidates a boid scanned
+ *		   or the interactions of a cell, and the scheduler keeps the costs of the last step. In adaptive mode the range is cut into
+ *		   SCHEDULE_CHUNKS chunks per thread of equal total cost, which threads take dynamically, so a chunk inside a dense cluster
+ *		   holds fewer boids than one in open space. Each thread's finish time is recorded so the time threads spent idle at the
+ *		   loops closing barrier can be compared between modes.
+ *		   ForEach must be called by every thread of a parallel region, with the same range.
+ */
+class LoopScheduler
+{
+public:
+
+	LoopScheduler(ScheduleMode mode);
+
+	template <typename Body>
+	void ForEach(int begin, int end, Body body);
+
+	ScheduleMode GetMode() const;
+	double GetIdleFraction() const;
+	double GetLoopTime() const;
+	int GetRebuilds() const;
+
+private:
+
+	ScheduleMode mode_;
+	int begin_ = 0;				//Range the costs and chunks were recorded for
+	int end_ = 0;
+	int calls_ = 0;				//Loops run since the chunks were last built
+	int rebuilds_ = 0;
+	vector<int> costs_;			//Cost of each item of the range in the last loop
+	vector<int> chunk_starts_;	//Chunk boundaries, one more than the number of chunks
+	vector<double> finish_times_; //Time each thread left the loop
+	double start_time_ = 0;
+	double loop_time_ = 0;		//Wall time in the loop, summed over calls
+	double idle_time_ = 0;		//Time threads waited for the slowest one, summed over threads and calls
+
+	void Plan(int begin, int end);
+	void Build();
+	void Account();
+};
+
+/**
+ * \brief  Runs body(i) for every i in [begin, end) over the threads of the enclosing parallel region, and stores its cost.
+ * \param  begin | First item
+ * \param  end | One past the last item
+ * \param  body | Callable taking an item and returning its cost
+ */
+template <typename Body>
+void LoopScheduler::ForEach(int begin, int end, Body body)
+{
+	#pragma omp single
+	{
+		Plan(begin, end);
+	}
+
+	int *costs = costs_.data() - begin;
+
+	if (mode_ == ScheduleMode::Adaptive)
+	{
+		int chunk_number = chunk_starts_.size() - 1;
+
+		#pragma omp for schedule(dynamic, 1) nowait
+		for (int chunk = 0; chunk < chunk_number; chunk++)
+		{
+			for (int i = chunk_starts_[chunk]; i < chunk_starts_[chunk + 1]; i++)
+			{
+				costs[i] = body(i);
+			}
+		}
+	}
+	else if (mode_ == ScheduleMode::Dynamic)
+	{
+		#pragma omp for schedule(dynamic, SCHEDULE_DYNAMIC_CHUNK) nowait
+		for (int i = begin; i < end; i++)
+		{
+			costs[i] = body(i);
+		}
+	}
+	else
+	{
+		#pragma omp for schedule(guided) nowait
+		for (int i = begin; i < end; i++)
+		{
+			costs[i] = body(i);
+		}
+	}
+
+	finish_times_[omp_get_thread_num()] = omp_get_wtime();
+
+	#pragma omp barrier
+	#pragma omp single
+	{
+		Account();
+	}
+}
+
+bool ParseScheduleMode(const string &name, ScheduleMode &mode);
+
+const char* ScheduleModeName(ScheduleMode mode);
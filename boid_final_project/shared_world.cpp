@@ -0,0 +1,609 @@
+#include "pch.h"
+#include "shared_world.h"
+#include "species.h"
+#include "phase_profiler.h"
+#include <algorithm>
+#include <cstring>
+
+/*! \file shared_world.cpp
+	\brief One copy of the flock per node in an MPI-3 shared memory window, read in place by every rank's update.
+*/
+
+using namespace std;
+using namespace Eigen;
+
+/**
+ * \brief  Groups the ranks by node, allocates the node's window on its leader and describes which boids each node owns,
+ *		   so leaders can broadcast a whole node's state in one call. Does nothing when disabled or on a single rank.
+ * \param  enabled | Whether to share the world state, --shared-window
+ * \param  boid_number | Number of boids in the flock
+ * \param  sight_range | Interaction cutoff, the longest one in a multi-species run, cells are at least this long
+ * \param  rank | MPI node rank
+ * \param  size | Number of MPI ranks
+ */
+template <int Dim>
+SharedWorld<Dim>::SharedWorld(bool enabled, int boid_number, float sight_range, int rank, int size) : boid_number_(boid_number)
+{
+	if (!enabled || size == 1)
+	{
+		return;
+	}
+
+	RankRange(rank, size, start_, end_);
+	cell_num_ = CellNumber(sight_range);
+	cell_count_ = 1;
+	for (int i = 0; i < Dim; i++)
+	{
+		cell_count_ *= cell_num_;
+	}
+
+	MPI_Comm_split_type(compute_comm, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &node_comm_);
+	MPI_Comm_rank(node_comm_, &node_rank_);
+	MPI_Comm_size(node_comm_, &node_size_);
+	MPI_Comm_split(compute_comm, node_rank_ == 0 ? 0 : MPI_UNDEFINED, rank, &leader_comm_);
+
+	int leader_rank = 0;
+	if (leader_comm_ != MPI_COMM_NULL)
+	{
+		MPI_Comm_rank(leader_comm_, &leader_rank);
+	}
+	MPI_Bcast(&leader_rank, 1, MPI_INT, 0, node_comm_);
+
+	vector<int> node_of_rank(size);
+	MPI_Allgather(&leader_rank, 1, MPI_INT, &node_of_rank[0], 1, MPI_INT, compute_comm);
+	node_number_ = *max_element(node_of_rank.begin(), node_of_rank.end()) + 1;
+
+	//Only the leader contributes memory, the rest map the leaders segment
+	MPI_Aint bytes = node_rank_ == 0 ? MPI_Aint(WindowBytes(boid_number_, sight_range)) : 0;
+	int displacement_unit;
+	float *base;
+	MPI_Win_allocate_shared(bytes, sizeof(float), MPI_INFO_NULL, node_comm_, &base, &window_);
+	MPI_Win_shared_query(window_, 0, &bytes, &displacement_unit, &base);
+	MPI_Win_lock_all(MPI_MODE_NOCHECK, window_);
+
+	size_t buffer_words = size_t(boid_number_) * STATE_ARRAYS;
+	buffers_[0] = base;
+	buffers_[1] = base + buffer_words;
+	cell_start_ = reinterpret_cast<int*>(base + 2 * buffer_words);
+	cell_boids_ = cell_start_ + cell_count_ + 1;
+
+	//One block per state array per owner on the node. Displacements are in bytes from the buffer, so none overflows an int
+	node_boids_.resize(node_number_);
+	for (int node = 0; node < node_number_; node++)
+	{
+		vector<int> lengths;
+		vector<MPI_Aint> displacements;
+		vector<MPI_Datatype> types;
+		for (int owner = 0; owner < size; owner++)
+		{
+			int start, end;
+			RankRange(owner, size, start, end);
+			if (node_of_rank[owner] != node || end == start)
+			{
+				continue;
+			}
+			for (int array = 0; array < STATE_ARRAYS; array++)
+			{
+				lengths.push_back(end - start);
+				displacements.push_back((MPI_Aint(array) * boid_number_ + start) * sizeof(float));
+				types.push_back(array == CELL_ARRAY ? MPI_INT : MPI_FLOAT);
+			}
+		}
+		MPI_Type_create_struct(lengths.size(), lengths.data(), displacements.data(), types.data(), &node_boids_[node]);
+		MPI_Type_commit(&node_boids_[node]);
+	}
+}
+
+/**
+ * \brief  Releases the window, the node state types and the node and leader communicators.
+ */
+template <int Dim>
+SharedWorld<Dim>::~SharedWorld()
+{
+	if (window_ != MPI_WIN_NULL)
+	{
+		MPI_Win_unlock_all(window_);
+		MPI_Win_free(&window_);
+	}
+	for (MPI_Datatype &type : node_boids_)
+	{
+		MPI_Type_free(&type);
+	}
+	if (leader_comm_ != MPI_COMM_NULL)
+	{
+		MPI_Comm_free(&leader_comm_);
+	}
+	if (node_comm_ != MPI_COMM_NULL)
+	{
+		MPI_Comm_free(&node_comm_);
+	}
+}
+
+/**
+ * \brief  Whether the world state is shared, false on a single rank.
+ * \return  | True when the window is in use
+ */
+template <int Dim>
+bool SharedWorld<Dim>::IsEnabled() const
+{
+	return window_ != MPI_WIN_NULL;
+}
+
+/**
+ * \brief  Updates this rank's boids cell by cell from the last exchanged state. Each cell holding one of them has its
+ *		   neighbourhood gathered straight out of the window into a tile, as the tiled kernel does, and its residents owned
+ *		   by this rank stream over it. Under the topological rule each resident takes the k nearest of the tile instead.
+ * \param  parameters | Behaviour parameters
+ * \param  boids | This rank's boids, from the first it owns
+ * \param  scheduler | Scheduler of the cell loop, a cell costs its updated residents times its tile size
+ */
+template <int Dim>
+void SharedWorld<Dim>::Update(const BoidParameters &parameters, vector<Boid> &boids, LoopScheduler &scheduler)
+{
+	bool fixed_point = !boids.empty() && boids.front().IsFixedPoint();
+	bool topological = parameters.interaction == InteractionRule::Topological;
+	float sight_range_sq = parameters.sight_range * parameters.sight_range;
+	PhaseProfiler *profiler = parameters.profiler;
+
+	#pragma omp parallel
+	{
+		NeighbourTileT<Dim> tile, nearest;
+		vector<pair<float, int>> candidates;
+		int neighbours[Boid::STENCIL_SIZE];
+		tile.fixed_point = nearest.fixed_point = fixed_point;
+
+		scheduler.ForEach(0, int(owned_cells_.size()), [&](int i)
+		{
+			if (profiler)
+			{
+				profiler->Enter(ProfilePhase::CellSetup);
+			}
+
+			//Boids are in index order within a cell, so this rank's residents are one run of it
+			int cell = owned_cells_[i];
+			const int *cell_begin = cell_boids_ + cell_start_[cell];
+			const int *cell_end = cell_boids_ + cell_start_[cell + 1];
+			const int *first = lower_bound(cell_begin, cell_end, start_);
+			const int *last = lower_bound(first, cell_end, end_);
+			int neighbour_number = Neighbourhood(cell, neighbours);
+
+			if (profiler)
+			{
+				profiler->Enter(ProfilePhase::Gather);
+			}
+
+			GatherTile(neighbours, neighbour_number, tile, parameters.species);
+
+			if (profiler)
+			{
+				profiler->Enter(ProfilePhase::Steering);
+			}
+
+			for (const int *boid = first; boid != last; boid++)
+			{
+				Boid &resident = boids[*boid - start_];
+				if (topological)
+				{
+					SelectNearest(resident, tile, sight_range_sq, nearest, candidates);
+					resident.UpdateFromTile(nearest, parameters);
+				}
+				else
+				{
+					resident.UpdateFromTile(tile, parameters);
+				}
+			}
+
+			int updated = last - first;
+			if (profiler)
+			{
+				profiler->CountUpdates(updated, (long long)updated * tile.size);
+				profiler->Leave(); //before the closing barrier, so waiting threads are not charged
+			}
+			return updated * tile.size;
+		});
+	}
+}
+
+/**
+ * \brief  Replaces the per step send to the master and broadcast back. This rank writes the state and cell of its boids
+ *		   into the window, each leader broadcasts its node's part to the other leaders in place and sorts the whole flock into
+ *		   cells, once for its node. Ranks on one node move no data through MPI at all.
+ * \param  boids | This rank's boids, from the first it owns
+ */
+template <int Dim>
+void SharedWorld<Dim>::Exchange(const vector<Boid> &boids)
+{
+	double start_time = MPI_Wtime();
+	int *cells = reinterpret_cast<int*>(Array(current_, CELL_ARRAY));
+	owned_cells_.resize(boids.size());
+
+	#pragma omp parallel for schedule(static)
+	for (int i = 0; i < boids.size(); i++)
+	{
+		int boid = start_ + i;
+		float memory[2 * Dim];
+		boids[i].Serialize(memory);
+		for (int axis = 0; axis < 2 * Dim; axis++)
+		{
+			Array(current_, axis)[boid] = memory[axis];
+		}
+		cells[boid] = owned_cells_[i] = CellOf(boids[i].GetPosition());
+	}
+
+	sort(owned_cells_.begin(), owned_cells_.end());
+	owned_cells_.erase(unique(owned_cells_.begin(), owned_cells_.end()), owned_cells_.end());
+	Synchronise();
+
+	if (leader_comm_ != MPI_COMM_NULL)
+	{
+		if (node_number_ > 1)
+		{
+			for (int node = 0; node < node_number_; node++)
+			{
+				MPI_Bcast(buffers_[current_], 1, node_boids_[node], node, leader_comm_);
+			}
+		}
+		SortCells(cells);
+	}
+	Synchronise();
+
+	current_ ^= 1;
+	time_taken_ += MPI_Wtime() - start_time;
+}
+
+/**
+ * \brief  Deserializes the whole flock as of the last exchange, for output and analytics that need every boid.
+ * \param  boids | Boid vector to write, one per boid of the flock
+ */
+template <int Dim>
+void SharedWorld<Dim>::Load(vector<Boid> &boids) const
+{
+	#pragma omp parallel for schedule(static)
+	for (int boid = 0; boid < boids.size(); boid++)
+	{
+		float memory[2 * Dim];
+		for (int axis = 0; axis < 2 * Dim; axis++)
+		{
+			memory[axis] = Array(current_ ^ 1, axis)[boid];
+		}
+		boids[boid].DeSerialize(memory);
+	}
+}
+
+/**
+ * \brief  Number of nodes the run spans.
+ * \return  | Node count
+ */
+template <int Dim>
+int SharedWorld<Dim>::GetNodeNumber() const
+{
+	return node_number_;
+}
+
+/**
+ * \brief  Number of ranks sharing this node's window.
+ * \return  | Ranks on this node
+ */
+template <int Dim>
+int SharedWorld<Dim>::GetNodeSize() const
+{
+	return node_size_;
+}
+
+/**
+ * \brief  Size of this node's window, held once for all its ranks.
+ * \return  | Window size in bytes, 0 when disabled
+ */
+template <int Dim>
+size_t SharedWorld<Dim>::GetWindowBytes() const
+{
+	return IsEnabled() ? (2 * size_t(boid_number_) * STATE_ARRAYS + cell_count_ + 1 + boid_number_) * sizeof(float) : 0;
+}
+
+/**
+ * \brief  Wall time spent in Exchange.
+ * \return  | Time in seconds
+ */
+template <int Dim>
+double SharedWorld<Dim>::GetTimeTaken() const
+{
+	return time_taken_;
+}
+
+/**
+ * \brief  Size of a node's window: two copies of the state arrays and one cell list.
+ * \param  boid_number | Number of boids in the flock
+ * \param  sight_range | Interaction cutoff, sets the number of cells
+ * \return  | Window size in bytes
+ */
+template <int Dim>
+size_t SharedWorld<Dim>::WindowBytes(int boid_number, float sight_range)
+{
+	size_t cell_count = 1;
+	for (int i = 0; i < Dim; i++)
+	{
+		cell_count *= CellNumber(sight_range);
+	}
+	return (2 * size_t(boid_number) * STATE_ARRAYS + cell_count + 1 + boid_number) * sizeof(float);
+}
+
+/**
+ * \brief  Cells per axis of the window's cell list, each at least a sight range long so the 3^Dim stencil holds every neighbour.
+ * \param  sight_range | Interaction cutoff
+ * \return  | Cells per axis
+ */
+template <int Dim>
+int SharedWorld<Dim>::CellNumber(float sight_range)
+{
+	return max(int(floor(LENGTH / sight_range)), 1);
+}
+
+/**
+ * \brief  One state array of a window buffer: positions per axis, or the fixed point bits of them, then velocities per axis,
+ *		   then the cell of every boid as integers.
+ * \param  buffer | Buffer index, current_ is written by the next exchange and the other holds the last one
+ * \param  array | Array index, below Dim for positions, below 2 * Dim for velocities, CELL_ARRAY for cells
+ * \return  | Start of the array, one entry per boid
+ */
+template <int Dim>
+float* SharedWorld<Dim>::Array(int buffer, int array) const
+{
+	return buffers_[buffer] + size_t(array) * boid_number_;
+}
+
+/**
+ * \brief  Cell holding a position, with the cells indexed row major.
+ * \param  position | Boid position
+ * \return  | Cell index
+ */
+template <int Dim>
+int SharedWorld<Dim>::CellOf(const typename Boid::VectorD &position) const
+{
+	int cell = 0;
+	for (int i = 0; i < Dim; i++)
+	{
+		cell = cell * cell_num_ + min(max(int(position[i] * cell_num_ / LENGTH), 0), cell_num_ - 1);
+	}
+	return cell;
+}
+
+/**
+ * \brief  The periodically wrapped 3^Dim cells around a cell, ascending and each only once when the stencil wraps onto itself.
+ * \param  cell | Centre cell
+ * \param  neighbours | Filled with the neighbourhood, room for STENCIL_SIZE cells
+ * \return  | Number of cells in the neighbourhood
+ */
+template <int Dim>
+int SharedWorld<Dim>::Neighbourhood(int cell, int *neighbours) const
+{
+	int coord[Dim];
+	for (int i = Dim - 1, remaining = cell; i >= 0; i--, remaining /= cell_num_)
+	{
+		coord[i] = remaining % cell_num_;
+	}
+
+	for (int stencil = 0; stencil < Boid::STENCIL_SIZE; stencil++)
+	{
+		int neighbour = 0;
+		for (int i = 0, scale = Boid::STENCIL_SIZE / 3; i < Dim; i++, scale /= 3)
+		{
+			neighbour = neighbour * cell_num_ + (coord[i] + stencil / scale % 3 - 1 + cell_num_) % cell_num_;
+		}
+		neighbours[stencil] = neighbour;
+	}
+
+	sort(neighbours, neighbours + Boid::STENCIL_SIZE);
+	return unique(neighbours, neighbours + Boid::STENCIL_SIZE) - neighbours;
+}
+
+/**
+ * \brief  Copies the state of every boid in a neighbourhood out of the last exchanged window buffer into a tile.
+ *		   With more than one species the tile is counting sorted into one contiguous run per species, each boid's species
+ *		   found from its index.
+ * \param  neighbours | Cells to gather
+ * \param  neighbour_number | Number of cells
+ * \param  tile | Tile to fill, grown if needed and reused between cells
+ * \param  species | Species table, null for a single species
+ */
+template <int Dim>
+void SharedWorld<Dim>::GatherTile(const int *neighbours, int neighbour_number, NeighbourTileT<Dim> &tile, const SpeciesTable *species) const
+{
+	int species_number = species ? species->Count() : 1;
+	int buffer = current_ ^ 1;
+	int size = 0;
+	for (int n = 0; n < neighbour_number; n++)
+	{
+		size += cell_start_[neighbours[n] + 1] - cell_start_[neighbours[n]];
+	}
+
+	if (tile.velocity[0].size() < size)
+	{
+		for (int i = 0; i < Dim; i++)
+		{
+			tile.position[i].resize(size);
+			tile.velocity[i].resize(size);
+			tile.fixed_position[i].resize(size);
+		}
+	}
+
+	//Counting sort by species, as the tiled kernel gathers
+	vector<int> &offset = tile.species_offset;
+	offset.assign(species_number + 1, 0);
+
+	if (species_number > 1)
+	{
+		for (int n = 0; n < neighbour_number; n++)
+		{
+			for (int entry = cell_start_[neighbours[n]]; entry < cell_start_[neighbours[n] + 1]; entry++)
+			{
+				offset[species->SpeciesOf(cell_boids_[entry]) + 1]++;
+			}
+		}
+	}
+	else
+	{
+		offset[1] = size;
+	}
+
+	for (int s = 1; s <= species_number; s++)
+	{
+		offset[s] += offset[s - 1];
+	}
+
+	for (int n = 0; n < neighbour_number; n++)
+	{
+		for (int entry = cell_start_[neighbours[n]]; entry < cell_start_[neighbours[n] + 1]; entry++)
+		{
+			int boid = cell_boids_[entry];
+			int j = offset[species_number > 1 ? species->SpeciesOf(boid) : 0]++;
+			for (int i = 0; i < Dim; i++)
+			{
+				if (tile.fixed_point)
+				{
+					memcpy(&tile.fixed_position[i][j], &Array(buffer, i)[boid], sizeof(float));
+				}
+				else
+				{
+					tile.position[i][j] = Array(buffer, i)[boid];
+				}
+				tile.velocity[i][j] = Array(buffer, Dim + i)[boid];
+			}
+		}
+	}
+
+	for (int s = species_number; s > 0; s--)
+	{
+		offset[s] = offset[s - 1];
+	}
+	offset[0] = 0;
+
+	tile.size = size;
+}
+
+/**
+ * \brief  Copies the TOPOLOGICAL_NEIGHBOURS nearest boids of a tile within sight range of a boid into a smaller tile,
+ *		   in tile order so species runs stay contiguous. Ties go to the boid earlier in the tile.
+ * \param  boid | Boid whose neighbours are selected
+ * \param  tile | Neighbourhood of the boid's cell
+ * \param  sight_range_sq | Squared cutoff range
+ * \param  nearest | Tile to fill, grown if needed
+ * \param  candidates | Scratch for the squared distances and tile entries of the boids in range
+ */
+template <int Dim>
+void SharedWorld<Dim>::SelectNearest(const Boid &boid, const NeighbourTileT<Dim> &tile, float sight_range_sq, NeighbourTileT<Dim> &nearest, vector<pair<float, int>> &candidates) const
+{
+	typename Boid::VectorD position = boid.GetPosition();
+	const uint32_t *fixed_position = boid.GetFixedPosition();
+	candidates.clear();
+
+	for (int j = 0; j < tile.size; j++)
+	{
+		float distance_squared = 0;
+		for (int i = 0; i < Dim; i++)
+		{
+			float offset = tile.fixed_point ? int32_t(tile.fixed_position[i][j] - fixed_position[i]) * FIXED_TO_LENGTH : tile.position[i][j] - position[i];
+			distance_squared += offset * offset;
+		}
+		if (distance_squared != 0 && distance_squared < sight_range_sq)
+		{
+			candidates.push_back(make_pair(distance_squared, j));
+		}
+	}
+
+	int size = min(int(candidates.size()), TOPOLOGICAL_NEIGHBOURS);
+	if (candidates.size() > size)
+	{
+		nth_element(candidates.begin(), candidates.begin() + size, candidates.end());
+	}
+	sort(candidates.begin(), candidates.begin() + size, [](const pair<float, int> &a, const pair<float, int> &b) { return a.second < b.second; });
+
+	if (nearest.velocity[0].size() < size)
+	{
+		for (int i = 0; i < Dim; i++)
+		{
+			nearest.position[i].resize(TOPOLOGICAL_NEIGHBOURS);
+			nearest.velocity[i].resize(TOPOLOGICAL_NEIGHBOURS);
+			nearest.fixed_position[i].resize(TOPOLOGICAL_NEIGHBOURS);
+		}
+	}
+
+	for (int k = 0; k < size; k++)
+	{
+		int j = candidates[k].second;
+		for (int i = 0; i < Dim; i++)
+		{
+			nearest.position[i][k] = tile.position[i][j];
+			nearest.velocity[i][k] = tile.velocity[i][j];
+			nearest.fixed_position[i][k] = tile.fixed_position[i][j];
+		}
+	}
+
+	//A species run starts at the first selected boid at or past its start in the tile
+	nearest.species_offset.resize(tile.species_offset.size());
+	for (int s = 0; s < tile.species_offset.size(); s++)
+	{
+		nearest.species_offset[s] = lower_bound(candidates.begin(), candidates.begin() + size, tile.species_offset[s],
+			[](const pair<float, int> &candidate, int start) { return candidate.second < start; }) - candidates.begin();
+	}
+	nearest.size = size;
+}
+
+/**
+ * \brief  Counting sorts the whole flock into the node's cell list from the cell array of the buffer just exchanged.
+ *		   Boids are visited in index order, so each cell lists its boids in index order. Run by the leader alone.
+ * \param  cells | Cell of every boid
+ */
+template <int Dim>
+void SharedWorld<Dim>::SortCells(const int *cells)
+{
+	fill(cell_start_, cell_start_ + cell_count_ + 1, 0);
+	for (int boid = 0; boid < boid_number_; boid++)
+	{
+		cell_start_[cells[boid] + 1]++;
+	}
+	for (int cell = 1; cell <= cell_count_; cell++)
+	{
+		cell_start_[cell] += cell_start_[cell - 1];
+	}
+
+	//Starts are used as fill cursors, which leaves each at the start of the next cell, then shifted back
+	for (int boid = 0; boid < boid_number_; boid++)
+	{
+		cell_boids_[cell_start_[cells[boid]]++] = boid;
+	}
+	for (int cell = cell_count_; cell > 0; cell--)
+	{
+		cell_start_[cell] = cell_start_[cell - 1];
+	}
+	cell_start_[0] = 0;
+}
+
+/**
+ * \brief  Makes every write to the window by ranks on this node visible to the others, then waits for all of them.
+ */
+template <int Dim>
+void SharedWorld<Dim>::Synchronise()
+{
+	MPI_Win_sync(window_);
+	MPI_Barrier(node_comm_);
+	MPI_Win_sync(window_);
+}
+
+/**
+ * \brief  Boids updated by a rank, the same split as Simulation: workers take equal ranges in rank order
+ *		   and the master takes the remainder at the end.
+ * \param  rank | MPI rank
+ * \param  size | Number of MPI ranks
+ * \param  start | First boid of the rank
+ * \param  end | One past the last boid of the rank
+ */
+template <int Dim>
+void SharedWorld<Dim>::RankRange(int rank, int size, int &start, int &end) const
+{
+	int boids_per_worker_node = boid_number_ / size;
+	start = rank == MASTER ? (size - 1) * boids_per_worker_node : (rank - 1) * boids_per_worker_node;
+	end = rank == MASTER ? boid_number_ : start + boids_per_worker_node;
+}
+
+template class SharedWorld<2>;
+template class SharedWorld<3>;
@@ -0,0 +1,75 @@
+#pragma once
+#include "pch.h"
+#include "preprocessor.h"
+#include "boid.h"
+#include "scheduler.h"
+#include "communication.h"
+#include "omp.h"
+#include <mpi.h>
+#include <utility>
+#include <vector>
+
+/**
+ * \brief  World state of a multi-node run held once per node in an MPI-3 shared memory window, instead of once per rank.
+ *		   The window holds the flock as structure of arrays, one array per axis of positions and of velocities and the cell
+ *		   of every boid, and a cell list of the whole flock. Each rank writes its own boids into the window, one leader rank
+ *		   per node exchanges the node's boids with the other leaders and builds the cell list once for the node, and every
+ *		   rank updates its own boids from tiles gathered out of the window, which it only reads. A rank keeps boid objects for
+ *		   its own boids alone and no search structure. The state is double buffered so a rank can write the next step
+ *		   while slower ranks on its node still read the last one.
+ */
+template <int Dim>
+class SharedWorld
+{
+public:
+	typedef BoidT<Dim> Boid;
+
+	SharedWorld(bool enabled, int boid_number, float sight_range, int rank, int size);
+	~SharedWorld();
+
+	bool IsEnabled() const;
+	void Update(const BoidParameters &parameters, vector<Boid> &boids, LoopScheduler &scheduler);
+	void Exchange(const vector<Boid> &boids);
+	void Load(vector<Boid> &boids) const;
+
+	int GetNodeNumber() const;
+	int GetNodeSize() const;
+	size_t GetWindowBytes() const;
+	double GetTimeTaken() const;
+
+	static size_t WindowBytes(int boid_number, float sight_range);
+
+private:
+
+	static constexpr int CELL_ARRAY = 2 * Dim;		//State arrays of a buffer: positions, velocities, then cells
+	static constexpr int STATE_ARRAYS = 2 * Dim + 1;
+
+	int boid_number_;
+	int start_ = 0;							//Boids this rank owns
+	int end_ = 0;
+	int node_rank_ = 0;
+	int node_size_ = 1;
+	int node_number_ = 1;
+	int cell_num_ = 1;						//Cells per axis of the cell list
+	int cell_count_ = 1;
+	MPI_Comm node_comm_ = MPI_COMM_NULL;	//Ranks sharing this node's memory
+	MPI_Comm leader_comm_ = MPI_COMM_NULL;	//Node rank 0 of every node, null on the other ranks
+	MPI_Win window_ = MPI_WIN_NULL;
+	float *buffers_[2] = {};				//Two copies of the state arrays, in the window
+	int *cell_start_ = nullptr;				//First entry of each cell in cell_boids_, cell count + 1 entries, in the window
+	int *cell_boids_ = nullptr;				//Every boid sorted by cell, in index order within a cell, in the window
+	int current_ = 0;						//Buffer written by the next exchange, the other holds the last one
+	vector<int> owned_cells_;				//Cells holding this rank's boids, ascending
+	vector<MPI_Datatype> node_boids_;		//State of the boids owned by each node's ranks, indexed by leader rank
+	double time_taken_ = 0;					//Wall time spent exchanging
+
+	static int CellNumber(float sight_range);
+	float* Array(int buffer, int array) const;
+	int CellOf(const typename Boid::VectorD &position) const;
+	int Neighbourhood(int cell, int *neighbours) const;
+	void GatherTile(const int *neighbours, int neighbour_number, NeighbourTileT<Dim> &tile, const SpeciesTable *species) const;
+	void SelectNearest(const Boid &boid, const NeighbourTileT<Dim> &tile, float sight_range_sq, NeighbourTileT<Dim> &nearest, vector<pair<float, int>> &candidates) const;
+	void SortCells(const int *cells);
+	void Synchronise();
+	void RankRange(int rank, int size, int &start, int &end) const;
+};
@@ -0,0 +1,653 @@
+#include "pch.h"
+#include "simulation.h"
+
+/*! \file simulation.cpp
+	\brief The simulation engine, stepped by the executable, the validation runs or an embedding program.
+*/
+
+using namespace std;
+using namespace Eigen;
+
+/**
+ * \brief  Largest speed any boid can gain in a step. Every steering force is capped at the max force before it is weighted,
+ *		   so the bound is the max force times the summed weights, the largest over species in a multi-species run.
+ * \param  parameters | Behaviour parameters, with the obstacle field and species table if any
+ * \return  | Bound on the acceleration of one step
+ */
+static float MaxAcceleration(const BoidParameters &parameters)
+{
+	float avoidance = parameters.obstacles ? fabs(parameters.avoidance_factor) : 0;
+
+	if (!parameters.species)
+	{
+		return parameters.max_force * (fabs(parameters.cohesion_factor) + fabs(parameters.alignment_factor) + fabs(parameters.separation_factor) + avoidance);
+	}
+
+	const SpeciesTable &species = *parameters.species;
+	float acceleration = 0;
+	for (int observer = 0; observer < species.Count(); observer++)
+	{
+		float weight = avoidance;
+		for (int target = 0; target < species.Count(); target++)
+		{
+			weight += species.Response(observer, target).cwiseAbs().sum();
+		}
+		acceleration = max(acceleration, species.parameters[observer].max_force * weight);
+	}
+
+	return acceleration;
+}
+
+/**
+ * \brief  Sets up one rank: generates the flock, assigns species, builds the neighbour search structure and plans the halo.
+ *		   With the shared window the rank generates and keeps only its own boids and writes them to the window instead, and
+ *		   the halo is not used. Every rank of a multi-node run must construct its simulation together.
+ * \param  options | Run time options, copied. Obstacle and species tables are referenced and must outlive the simulation
+ * \param  rank | Rank in compute_comm, MASTER for a single node
+ * \param  size | Number of ranks running the simulation, 1 for a single node
+ */
+template <int Dim>
+Simulation<Dim>::Simulation(const SimulationOptions &options, int rank, int size)
+	: options_(options), rank_(rank), size_(size), boids_per_worker_node_(options.boid_number / size),
+	start_index_(size == 1 ? 0 : rank == MASTER ? (size - 1) * boids_per_worker_node_ : (rank - 1) * boids_per_worker_node_),
+	end_index_(rank == MASTER ? options.boid_number : start_index_ + boids_per_worker_node_), setup_time_(MPI_Wtime()),
+	world_(options.shared_window, options.boid_number, options.parameters.sight_range, rank, size),
+	boids_(world_.IsEnabled() ? end_index_ - start_index_ : options.boid_number),
+	halo_(size == 1 || world_.IsEnabled() ? 0 : options.halo_depth, options.parameters.sight_range,
+		MaxAcceleration(options.parameters), start_index_, end_index_, rank), scheduler_(options.schedule),
+	profiler_(options.profile)
+{
+	if (profiler_.IsEnabled())
+	{
+		options_.parameters.profiler = &profiler_;
+	}
+
+	if (size_ > 1 && !world_.IsEnabled())
+	{
+		boid_memory_.resize(size_t(options_.boid_number) * 2 * Dim);
+		node_boid_memory_.resize(size_t(boids_per_worker_node_) * 2 * Dim);
+	}
+
+	if (options_.numa)
+	{
+		FirstTouchBoids(boids_, world_.IsEnabled() ? 0 : start_index_, world_.IsEnabled() ? int(boids_.size()) : end_index_);
+	}
+
+	if (options_.fixed_point && options_.parameters.sight_range > LENGTH / 4.0f)
+	{
+		//At least 4 power of two cells per axis keep every neighbour in sight well within half the box, where the wrapped difference picks its nearest image
+		if (rank_ == MASTER)
+		{
+			printf("Fixed point coordinates need at least 4 cells per axis, a sight range of at most LENGTH / 4, using float positions\n");
+		}
+		options_.fixed_point = false;
+	}
+
+	if (options_.fixed_point)
+	{
+		//Before generation and the first exchange, so every copy of every boid is read and written in fixed point
+		for (Boid &boid : boids_)
+		{
+			boid.SetFixedPoint();
+		}
+	}
+
+	if (world_.IsEnabled())
+	{
+		//Each rank generates only its own boids and the window hands them to the others
+		GenerateBoids(boids_, start_index_, end_index_, options_.scenario, options_.seed, start_index_);
+		if (options_.parameters.species)
+		{
+			AssignSpecies(boids_, *options_.parameters.species, start_index_);
+		}
+		world_.Exchange(boids_);
+		setup_time_ = MPI_Wtime() - setup_time_;
+		return;
+	}
+
+	//Every rank generates the whole flock itself, so it is never broadcast
+	GenerateBoids(boids_, 0, options_.boid_number, options_.scenario, options_.seed);
+
+	if (options_.parameters.species)
+	{
+		AssignSpecies(boids_, *options_.parameters.species);
+	}
+
+	grid_ = CreateNeighbourSearch<Dim>(options_.search, boids_, options_.parameters.sight_range);
+
+	if (halo_.IsEnabled())
+	{
+		halo_.Mark(boids_);
+	}
+
+	setup_time_ = MPI_Wtime() - setup_time_;
+}
+
+/**
+ * \brief  Advances the flock one step: updates this rank's boids, exchanges them, rebuilds the search structure and runs the hooks.
+ */
+template <int Dim>
+void Simulation<Dim>::Step()
+{
+	double start_time = MPI_Wtime();
+	grid_updates_.resize(0);
+
+	Update();
+	Exchange();
+	if (grid_)
+	{
+		profiler_.Enter(ProfilePhase::GridUpdate);
+		grid_->Rebuild();
+		profiler_.Leave();
+	}
+
+	int step = steps_++;
+	for (StepHook &hook : hooks_)
+	{
+		hook(step, *this);
+	}
+
+	time_taken_ += MPI_Wtime() - start_time;
+}
+
+/**
+ * \brief  Advances the flock a number of steps.
+ * \param  steps | Number of steps
+ */
+template <int Dim>
+void Simulation<Dim>::Run(int steps)
+{
+	for (int step = 0; step < steps; step++)
+	{
+		Step();
+	}
+}
+
+/**
+ * \brief  Adds a hook run at the end of every step, once the flock is exchanged and the search structure rebuilt, in the order added.
+ *		   Hooks may read the boids and query the search structure but must not move boids.
+ * \param  hook | Called with the index of the step just run and the simulation
+ */
+template <int Dim>
+void Simulation<Dim>::AddHook(StepHook hook)
+{
+	hooks_.push_back(hook);
+}
+
+/**
+ * \brief  Replaces the behaviour parameters from the next step, rebuilding the search structure if the sight range changed.
+ *		   Meant for single node runs, such as the Python bindings, where the halo and the other ranks need not agree on them.
+ * \param  parameters | Behaviour parameters, the simulation's own profiler is kept
+ */
+template <int Dim>
+void Simulation<Dim>::SetParameters(const BoidParameters &parameters)
+{
+	bool rebuild = parameters.sight_range != options_.parameters.sight_range;
+	PhaseProfiler *profiler = options_.parameters.profiler;
+
+	options_.parameters = parameters;
+	options_.parameters.profiler = profiler;
+
+	if (rebuild && grid_)
+	{
+		grid_ = CreateNeighbourSearch<Dim>(options_.search, boids_, options_.parameters.sight_range);
+	}
+}
+
+/**
+ * \brief  Replaces the thread schedule of the update loops from the next step, dropping the adaptive schedule's measured costs.
+ * \param  mode | Thread schedule
+ */
+template <int Dim>
+void Simulation<Dim>::SetSchedule(ScheduleMode mode)
+{
+	options_.schedule = mode;
+	scheduler_ = LoopScheduler(mode);
+}
+
+/**
+ * \brief  The flock. Boids outside GetStart to GetEnd are other ranks' boids as of the last exchange. With the shared window
+ *		   the whole flock is loaded from the window into a copy on the first call of a step, which only hooks that need every
+ *		   boid should pay for.
+ * \return  | Boid vector, never reallocated
+ */
+template <int Dim>
+vector<BoidT<Dim>>& Simulation<Dim>::GetBoids()
+{
+	if (!world_.IsEnabled())
+	{
+		return boids_;
+	}
+
+	LoadFlock();
+	return flock_;
+}
+
+/**
+ * \brief  Neighbour search structure, up to date with the flock after every step. With the shared window one is built over
+ *		   the copy of the flock GetBoids loads.
+ * \return  | Search structure
+ */
+template <int Dim>
+NeighbourSearchT<Dim>& Simulation<Dim>::GetSearch()
+{
+	if (!world_.IsEnabled())
+	{
+		return *grid_;
+	}
+
+	LoadFlock();
+	return *flock_search_;
+}
+
+/**
+ * \brief  This rank's boids, GetStart to GetEnd, read in place whether or not the rank holds the whole flock.
+ * \return  | Pointer to the boid GetStart, the others follow it
+ */
+template <int Dim>
+const BoidT<Dim>* Simulation<Dim>::GetOwnedBoids() const
+{
+	return boids_.data() + (world_.IsEnabled() ? 0 : start_index_);
+}
+
+/**
+ * \brief  Address of the first boid's position, the next boid's is GetStride bytes on. With the shared window only this
+ *		   rank's boids are held, from GetStart.
+ * \return  | Pointer to Dim floats, valid for the life of the simulation
+ */
+template <int Dim>
+const float* Simulation<Dim>::GetPositions() const
+{
+	return boids_[0].GetPositionData();
+}
+
+/**
+ * \brief  Address of the first boid's velocity, the next boid's is GetStride bytes on. With the shared window only this
+ *		   rank's boids are held, from GetStart.
+ * \return  | Pointer to Dim floats, valid for the life of the simulation
+ */
+template <int Dim>
+const float* Simulation<Dim>::GetVelocities() const
+{
+	return boids_[0].GetVelocityData();
+}
+
+/**
+ * \brief  Bytes between consecutive boids.
+ * \return  | Stride in bytes
+ */
+template <int Dim>
+long long Simulation<Dim>::GetStride() const
+{
+	return sizeof(Boid);
+}
+
+/**
+ * \brief  First boid this rank updates.
+ * \return  | Boid index
+ */
+template <int Dim>
+int Simulation<Dim>::GetStart() const
+{
+	return start_index_;
+}
+
+/**
+ * \brief  One past the last boid this rank updates.
+ * \return  | Boid index
+ */
+template <int Dim>
+int Simulation<Dim>::GetEnd() const
+{
+	return end_index_;
+}
+
+/**
+ * \brief  Steps run so far.
+ * \return  | Step count
+ */
+template <int Dim>
+int Simulation<Dim>::GetSteps() const
+{
+	return steps_;
+}
+
+/**
+ * \brief  Options the simulation runs with.
+ * \return  | Run time options
+ */
+template <int Dim>
+const SimulationOptions& Simulation<Dim>::GetOptions() const
+{
+	return options_;
+}
+
+/**
+ * \brief  Phase profile of the run so far, summed over the threads of every rank. Collective over compute_comm on a multi-node run.
+ * \return  | Profile totals, empty when not profiled
+ */
+template <int Dim>
+ProfileTotals Simulation<Dim>::GetProfile() const
+{
+	ProfileTotals totals = profiler_.GetTotals();
+	static_assert(sizeof(ProfileTotals) % sizeof(double) == 0, "Profile totals are reduced as an array of doubles");
+
+	if (size_ > 1 && profiler_.IsEnabled())
+	{
+		MPI_Allreduce(MPI_IN_PLACE, &totals, sizeof(ProfileTotals) / sizeof(double), MPI_DOUBLE, MPI_SUM, compute_comm);
+	}
+	return totals;
+}
+
+/**
+ * \brief  Updates this rank's boids, or with the halo its boids and the ghosts still needed. Synchronous updates only steer,
+ *		   so every boid moves once all have read the old state.
+ */
+template <int Dim>
+void Simulation<Dim>::Update()
+{
+	if (world_.IsEnabled())
+	{
+		//Neighbours are read from the window, which holds the last exchanged state, so boids may move as soon as they are updated
+		world_.Update(options_.parameters, boids_, scheduler_);
+		if (options_.parameters.synchronous)
+		{
+			#pragma omp parallel for schedule(static)
+			for (int boid = 0; boid < boids_.size(); boid++)
+			{
+				boids_[boid].Integrate();
+			}
+		}
+		return;
+	}
+
+	if (halo_.IsEnabled())
+	{
+		halo_.Update(*grid_, options_.parameters, options_.tiled, boids_);
+		return;
+	}
+
+	if (options_.tiled)
+	{
+		UpdateTiled(*grid_, options_.parameters, &boids_[0] + start_index_, &boids_[0] + end_index_, nullptr, &scheduler_);
+	}
+	else
+	{
+		#pragma omp parallel
+		{
+			//Boids cost the neighbour candidates they scanned, for the adaptive schedule
+			scheduler_.ForEach(start_index_, end_index_, [&](int boid)
+			{
+				profiler_.Enter(ProfilePhase::CellSetup);
+				grid_->UpdateNearCells(boids_[boid]);
+				boids_[boid].Update(options_.parameters);
+				int candidates = boids_[boid].GetCandidateCount();
+				profiler_.CountUpdates(1, candidates);
+				profiler_.Leave(); //before the closing barrier, so waiting threads are not charged
+				return candidates;
+			});
+		}
+	}
+
+	if (options_.parameters.synchronous)
+	{
+		#pragma omp parallel for schedule(static)
+		for (int boid = start_index_; boid < end_index_; boid++)
+		{
+			boids_[boid].Integrate();
+		}
+	}
+}
+
+/**
+ * \brief  Brings every rank's copy of the flock and the search structure up to date with the boids just updated.
+ */
+template <int Dim>
+void Simulation<Dim>::Exchange()
+{
+	if (size_ == 1)
+	{
+		//GRID updated with only thread to avoid race conditions.
+		profiler_.Enter(ProfilePhase::GridUpdate);
+		for (int boid = 0; boid < options_.boid_number; boid++)
+		{
+			grid_->UpdateGrid(boids_[boid], grid_updates_, size_);
+		}
+		profiler_.Leave();
+	}
+	else if (halo_.IsEnabled())
+	{
+		//Ghosts carried the other ranks boids since the last exchange, only every depth steps are the owned boids swapped
+		if (halo_.NeedsExchange())
+		{
+			double exchange_start = MPI_Wtime();
+			profiler_.Enter(ProfilePhase::Serialization);
+			if (rank_ == MASTER)
+			{
+				for (int node = 1; node < size_; node++)
+				{
+					ReceiveBoids(boids_, node_boid_memory_, node, MASTER, (node - 1)*boids_per_worker_node_, node*boids_per_worker_node_);
+				}
+				BroadcastSendBoids(boids_, boid_memory_, MASTER);
+			}
+			else
+			{
+				SendBoids(boids_, node_boid_memory_, MASTER, start_index_, end_index_);
+				BroadcastReceiveBoids(boids_, boid_memory_, MASTER);
+			}
+			double exchange_time = MPI_Wtime() - exchange_start;
+			profiler_.Enter(ProfilePhase::GridUpdate);
+			halo_.Synchronise(*grid_, boids_, exchange_time);
+			profiler_.Leave();
+		}
+	}
+	else if (world_.IsEnabled())
+	{
+		//Boids are exchanged through the node's window, whose leader sorts them into cells for every rank on the node
+		profiler_.Enter(ProfilePhase::Serialization);
+		world_.Exchange(boids_);
+		profiler_.Leave();
+	}
+	else if (rank_ == MASTER)
+	{
+		ExchangeMaster();
+	}
+	else
+	{
+		ExchangeWorker();
+	}
+}
+
+/**
+ * \brief  Replicated exchange on the master: collects every worker's boids and grid moves, applies them with its own
+ *		   and broadcasts the whole flock and every move back.
+ */
+template <int Dim>
+void Simulation<Dim>::ExchangeMaster()
+{
+	profiler_.Enter(ProfilePhase::GridUpdate);
+	for (int boid = start_index_; boid < end_index_; boid++)
+	{
+		if (grid_->UpdateGrid(boids_[boid], grid_updates_, size_))
+		{
+			grid_updates_.push_back(boid);
+		}
+	}
+	profiler_.Enter(ProfilePhase::Serialization);
+	//Receive updated boids from worker nodes
+	for (int node = 1; node < size_; node++)
+	{
+		ReceiveBoids(boids_, node_boid_memory_, node, MASTER, (node - 1)*boids_per_worker_node_, node*boids_per_worker_node_);
+	}
+	//Receive updates to the grid from worker nodes and collate
+	for (int node = 1; node < size_; node++)
+	{
+		vector<int> node_grid_updates;
+		ReceiveGridUpdates(node_grid_updates, node);
+		grid_updates_.insert(grid_updates_.end(), node_grid_updates.begin(), node_grid_updates.end());
+	}
+	//Update masters copy of the grid with updates from all nodes and itself
+	profiler_.Enter(ProfilePhase::GridUpdate);
+	for (int i = 0; i < grid_updates_.size(); i += 3)
+	{
+		grid_->UpdateGrid(boids_[grid_updates_[i + 2]], grid_updates_[i], grid_updates_[i + 1]);
+	}
+
+	//Send out updates
+	profiler_.Enter(ProfilePhase::Serialization);
+	BroadcastSendGridUpdates(grid_updates_, MASTER);
+	BroadcastSendBoids(boids_, boid_memory_, MASTER);
+	profiler_.Leave();
+}
+
+/**
+ * \brief  Replicated exchange on a worker: sends its boids and grid moves to the master and receives everyone's back.
+ */
+template <int Dim>
+void Simulation<Dim>::ExchangeWorker()
+{
+	profiler_.Enter(ProfilePhase::GridUpdate);
+	for (int boid = start_index_; boid < end_index_; boid++)
+	{
+		if (grid_->UpdateGrid(boids_[boid], grid_updates_, size_))
+		{
+			grid_updates_.push_back(boid);
+		}
+	}
+
+	//Send updated boids and grid to master
+	profiler_.Enter(ProfilePhase::Serialization);
+	SendBoids(boids_, node_boid_memory_, MASTER, start_index_, end_index_);
+	SendGridUpdates(grid_updates_, MASTER);
+
+	//Receive updates from other nodes via master
+	BroadcastReceiveGridUpdates(grid_updates_, MASTER);
+	BroadcastReceiveBoids(boids_, boid_memory_, MASTER);
+
+	profiler_.Enter(ProfilePhase::GridUpdate);
+	for (int i = 0; i < grid_updates_.size(); i += 3)
+	{
+		grid_->UpdateGrid(boids_[grid_updates_[i + 2]], grid_updates_[i], grid_updates_[i + 1]);
+	}
+	profiler_.Leave();
+}
+
+/**
+ * \brief  Loads the whole flock from the shared window and builds a search structure over it, once per step.
+ */
+template <int Dim>
+void Simulation<Dim>::LoadFlock()
+{
+	if (flock_step_ == steps_)
+	{
+		return;
+	}
+
+	if (flock_.empty())
+	{
+		flock_.resize(options_.boid_number);
+		if (options_.fixed_point)
+		{
+			for (Boid &boid : flock_)
+			{
+				boid.SetFixedPoint();
+			}
+		}
+		if (options_.parameters.species)
+		{
+			AssignSpecies(flock_, *options_.parameters.species);
+		}
+	}
+
+	world_.Load(flock_);
+	if (flock_search_)
+	{
+		//Search structures index boids by cell, rebuilt from scratch since the copy jumps a whole step
+		int size = 1;
+		vector<int> unused;
+		for (Boid &boid : flock_)
+		{
+			flock_search_->UpdateGrid(boid, unused, size);
+		}
+		flock_search_->Rebuild();
+	}
+	else
+	{
+		flock_search_ = CreateNeighbourSearch<Dim>(options_.search, flock_, options_.parameters.sight_range);
+	}
+	flock_step_ = steps_;
+}
+
+/**
+ * \brief  Prints the run summary of the engine: configuration, timings, and the halo and shared window statistics when used.
+ *		   Called on the master, output and analytics rows are added by the caller.
+ */
+template <int Dim>
+void Simulation<Dim>::PrintSummary() const
+{
+	printf("*******Simulation Completed******\n");
+	printf(" --------------------------------\n");
+	printf("|  Number of Boids   |%10d|\n", options_.boid_number);
+	printf(" --------------------------------\n");
+	printf("|  Number of Steps   |%10d|\n", steps_);
+	printf(" -------------------------------\n");
+	printf("|   Number of Nodes  |%10d|\n", size_);
+	printf(" -------------------------------\n");
+	printf("|Number of Processors|%10d|\n", omp_get_max_threads());
+	printf(" --------------------------------\n");
+	printf("|  Total Processors  |%10d|\n", size_*omp_get_max_threads());
+	printf(" --------------------------------\n");
+	printf("|     Dimensions     |%10d|\n", Dim);
+	printf(" --------------------------------\n");
+	printf("|   Search Backend   |%10s|\n", SearchBackendName(options_.search));
+	printf(" --------------------------------\n");
+	printf("|    Interaction     |%10s|\n", options_.parameters.interaction == InteractionRule::Topological ? "k-nearest" : "metric");
+	printf(" --------------------------------\n");
+	printf("|   Sqrt Accuracy    |%10s|\n", SqrtAccuracyName(options_.parameters.accuracy));
+	printf(" --------------------------------\n");
+	printf("|    Coordinates     |%10s|\n", options_.fixed_point ? "fixed" : "float");
+	printf(" --------------------------------\n");
+	if (options_.parameters.species)
+	{
+		printf("|      Species       |%10d|\n", options_.parameters.species->Count());
+		printf(" --------------------------------\n");
+	}
+	printf("|      Schedule      |%10s|\n", ScheduleModeName(options_.schedule));
+	printf(" --------------------------------\n");
+	printf("|  Thread idle/%%     |%10.2f|\n", 100 * scheduler_.GetIdleFraction());
+	printf(" --------------------------------\n");
+	printf("|      Scenario      |%10s|\n", ScenarioName(options_.scenario));
+	printf(" --------------------------------\n");
+	printf("|        Seed        |%10llu|\n", (unsigned long long)options_.seed);
+	printf(" --------------------------------\n");
+	printf("|  Startup time/s    |%10f|\n", setup_time_);
+	printf(" --------------------------------\n");
+	printf("|    Time taken/s    |%10f|\n", time_taken_);
+	printf(" --------------------------------\n");
+	if (halo_.IsEnabled())
+	{
+		int messages = 2 * (size_ - 1); //per exchange
+		printf("|     Halo Depth     |%10d|\n", halo_.GetDepth());
+		printf(" --------------------------------\n");
+		printf("|     Exchanges      |%10d|\n", halo_.GetExchanges());
+		printf(" --------------------------------\n");
+		printf("|    Messages/s      |%10.1f|\n", halo_.GetExchanges() * messages / time_taken_);
+		printf(" --------------------------------\n");
+		printf("|  Ghost updates/%%   |%10.2f|\n", 100 * halo_.GetGhostFraction());
+		printf(" --------------------------------\n");
+	}
+	if (world_.IsEnabled())
+	{
+		printf("|  Nodes (shared)    |%10d|\n", world_.GetNodeNumber());
+		printf(" --------------------------------\n");
+		printf("|  Ranks on Master   |%10d|\n", world_.GetNodeSize());
+		printf(" --------------------------------\n");
+		printf("|  Window size/MB    |%10f|\n", world_.GetWindowBytes() / 1048576.0);
+		printf(" --------------------------------\n");
+		printf("|  Exchange time/s   |%10f|\n", world_.GetTimeTaken());
+		printf(" --------------------------------\n");
+	}
+}
+
+template class Simulation<2>;
+template class Simulation<3>;
@@ -0,0 +1,89 @@
+#pragma once
+#include "pch.h"
+#include "preprocessor.h"
+#include "boid.h"
+#include "neighbour_search.h"
+#include "options.h"
+#include "topology.h"
+#include "tiled_kernel.h"
+#include "species.h"
+#include "scenario.h"
+#include "scheduler.h"
+#include "communication.h"
+#include "shared_world.h"
+#include "deep_halo.h"
+#include "phase_profiler.h"
+#include "Eigen/Dense"
+#include "omp.h"
+#include <mpi.h>
+#include <functional>
+#include <memory>
+#include <vector>
+#include <cstdio>
+
+/**
+ * \brief  The simulation engine of one rank, advanced a step at a time. With one rank it runs the whole flock, with more
+ *		   rank 0 is the master and the others are workers, each updating its own range of the replicated flock and exchanging
+ *		   it every step (or through the deep halo). With the shared window a rank holds only its own boids and reads the rest
+ *		   from the node's window. No positions are kept between steps; callers read the boids in place and add hooks, run at
+ *		   the end of every step, for output and analytics. MPI must be initialised first.
+ */
+template <int Dim>
+class Simulation
+{
+public:
+	typedef BoidT<Dim> Boid;
+	typedef function<void(int step, Simulation<Dim> &simulation)> StepHook;
+
+	Simulation(const SimulationOptions &options, int rank = MASTER, int size = 1);
+
+	void Step();
+	void Run(int steps);
+	void AddHook(StepHook hook);
+	void SetParameters(const BoidParameters &parameters);
+	void SetSchedule(ScheduleMode mode);
+
+	vector<Boid>& GetBoids();
+	NeighbourSearchT<Dim>& GetSearch();
+	const Boid* GetOwnedBoids() const;
+	const float* GetPositions() const;
+	const float* GetVelocities() const;
+	long long GetStride() const;
+	int GetStart() const;
+	int GetEnd() const;
+	int GetSteps() const;
+	const SimulationOptions& GetOptions() const;
+	ProfileTotals GetProfile() const;
+	void PrintSummary() const;
+
+private:
+
+	SimulationOptions options_;
+	int rank_;
+	int size_;
+	int boids_per_worker_node_;
+	int start_index_;					//Boids this rank updates
+	int end_index_;
+	double setup_time_;					//Start up wall time, timed from before the window is set up
+	SharedWorld<Dim> world_;
+	vector<Boid> boids_;				//The flock, or only this rank's boids with the shared window
+	vector<float> boid_memory_;			//Whole flock de/serialised for the exchange
+	vector<float> node_boid_memory_;	//One worker's boids de/serialised for the exchange
+	vector<int> grid_updates_;			//Each update adds three integers: old spatial grid vector index, new grid vector index, boids vector index
+	unique_ptr<NeighbourSearchT<Dim>> grid_;	//Null with the shared window
+	vector<Boid> flock_;				//Whole flock loaded from the shared window when a hook asks for it
+	unique_ptr<NeighbourSearchT<Dim>> flock_search_;
+	int flock_step_ = -1;				//Step the loaded flock is from
+	DeepHalo<Dim> halo_;
+	LoopScheduler scheduler_;
+	PhaseProfiler profiler_;
+	vector<StepHook> hooks_;
+	int steps_ = 0;
+	double time_taken_ = 0;				//Wall time in Step, hooks included
+
+	void Update();
+	void Exchange();
+	void ExchangeMaster();
+	void ExchangeWorker();
+	void LoadFlock();
+};
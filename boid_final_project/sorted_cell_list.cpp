@@ -0,0 +1,173 @@
+#include "pch.h"
+#include "sorted_cell_list.h"
+
+/*! \file sorted_cell_list.cpp
+	\brief Implementation of the sorted cell list neighbour search
+*/
+
+/**
+ * \brief  Creates the cell list for given simulation details and sorts all boids into it.
+ * \param  boids | Boids to index. Referenced, not copied.
+ * \param  sight_range | Interaction cutoff the structure must cover
+ */
+SortedCellList::SortedCellList(vector<Boid>& boids, float sight_range) : boids_(boids)
+{
+	cell_num = max(int(floor(LENGTH / sight_range)), 1); // same sizing as SpatialGrid so 27 adjacent cells contain all boids within range
+	cell_length = float(LENGTH) / float(cell_num);
+	sorted_boids_.resize(boids.size());
+	cell_start_.resize(cell_num*cell_num*cell_num + 1);
+	boid_cell_.resize(boids.size());
+	Rebuild();
+}
+
+/**
+ * \brief  Hands the boid the 27 sorted ranges surrounding its cell.
+ * \param  boid | The boid to update
+ */
+void SortedCellList::UpdateNearCells(Boid & boid)
+{
+	Vector3f position = boid.GetPosition();
+	int coord[SYS_DIM];
+
+	for (int i = 0; i < SYS_DIM; i++)
+	{
+		coord[i] = floor(position[i] / cell_length);
+		coord[i] = coord[i] < cell_num ? coord[i] : cell_num - 1;
+	}
+
+	float stencil_distances[SYS_DIM][3];
+	GetStencilDistances(position, coord, cell_length, cell_num, stencil_distances);
+	boid.neighbouring_cells_buffer_.clear();
+
+	for (int x = -1; x < 2; x++)
+	{
+		for (int y = -1; y < 2; y++)
+		{
+			for (int z = -1; z < 2; z++)
+			{
+				if (IsStencilDuplicate(x, cell_num) || IsStencilDuplicate(y, cell_num) || IsStencilDuplicate(z, cell_num))
+				{
+					continue;
+				}
+
+				//Periodic boundary conditions, matching SpatialGrid::UpdateNearCells
+				int row_x = (coord[0] + x + cell_num) % cell_num;
+				int row_y = (coord[1] + y + cell_num) % cell_num;
+				int row_z = (coord[2] + z + cell_num) % cell_num;
+				int cell = row_x * cell_num*cell_num + row_y * cell_num + row_z;
+
+				float distance_squared = stencil_distances[0][x + 1] + stencil_distances[1][y + 1] + stencil_distances[2][z + 1];
+				boid.neighbouring_cells_buffer_.push_back({ sorted_boids_.data() + cell_start_[cell], sorted_boids_.data() + cell_start_[cell + 1], distance_squared });
+			}
+		}
+	}
+}
+
+/**
+ * \brief  Cell list is rebuilt from scratch each step so no incremental updates are tracked.
+ * \return  | Always false
+ */
+bool SortedCellList::UpdateGrid(Boid &, vector<int>&, int &)
+{
+	return false;
+}
+
+/**
+ * \brief  Cell list is rebuilt from scratch each step so updates from other nodes are ignored.
+ */
+void SortedCellList::UpdateGrid(Boid &, int, int)
+{
+}
+
+/**
+ * \brief  Recomputes every boids cell in parallel then counting sorts the boid pointers by cell.
+ */
+void SortedCellList::Rebuild()
+{
+	int boid_number = boids_.size();
+
+	#pragma omp parallel for schedule(static)
+	for (int boid = 0; boid < boid_number; boid++)
+	{
+		boid_cell_[boid] = GetCellIndex(boids_[boid].GetPosition());
+	}
+
+	fill(cell_start_.begin(), cell_start_.end(), 0);
+
+	for (int boid = 0; boid < boid_number; boid++)
+	{
+		cell_start_[boid_cell_[boid] + 1]++;
+	}
+	for (int cell = 1; cell < int(cell_start_.size()); cell++)
+	{
+		cell_start_[cell] += cell_start_[cell - 1];
+	}
+
+	vector<int> insert_position(cell_start_.begin(), cell_start_.end() - 1);
+
+	for (int boid = 0; boid < boid_number; boid++)
+	{
+		sorted_boids_[insert_position[boid_cell_[boid]]++] = &boids_[boid];
+	}
+}
+
+/**
+ * \brief  Works out the 1D cell index of a position.
+ * \param  position | Position to locate
+ * \return  | 1D cell index
+ */
+int SortedCellList::GetCellIndex(const Vector3f & position) const
+{
+	int coord[SYS_DIM];
+
+	for (int i = 0; i < SYS_DIM; i++)
+	{
+		coord[i] = floor(position[i] / cell_length);
+		coord[i] = coord[i] < cell_num ? coord[i] : cell_num - 1; // position exactly LENGTH
+	}
+
+	return coord[0] * cell_num*cell_num + coord[1] * cell_num + coord[2];
+}
+
+/**
+ * \brief  Number of cells, for iterating over the list cell by cell.
+ * \return  | Cell count
+ */
+int SortedCellList::GetCellCount() const
+{
+	return cell_start_.size() - 1;
+}
+
+/**
+ * \brief  Gives the boids resident in a cell and the 27 sorted ranges surrounding it.
+ * \param  cell | 1D cell index
+ * \param  residents | Set to the boids in the cell
+ * \param  neighbourhood | Filled with the surrounding cells, including the cell itself
+ */
+void SortedCellList::GatherCell(int cell, CellSpan & residents, vector<CellSpan>& neighbourhood)
+{
+	int coord[SYS_DIM] = { cell / (cell_num*cell_num), (cell / cell_num) % cell_num, cell % cell_num };
+	residents = { sorted_boids_.data() + cell_start_[cell], sorted_boids_.data() + cell_start_[cell + 1], 0 };
+	neighbourhood.clear();
+
+	for (int x = -1; x < 2; x++)
+	{
+		for (int y = -1; y < 2; y++)
+		{
+			for (int z = -1; z < 2; z++)
+			{
+				if (IsStencilDuplicate(x, cell_num) || IsStencilDuplicate(y, cell_num) || IsStencilDuplicate(z, cell_num))
+				{
+					continue;
+				}
+
+				int row_x = (coord[0] + x + cell_num) % cell_num;
+				int row_y = (coord[1] + y + cell_num) % cell_num;
+				int row_z = (coord[2] + z + cell_num) % cell_num;
+				int near_cell = row_x * cell_num*cell_num + row_y * cell_num + row_z;
+
+				neighbourhood.push_back({ sorted_boids_.data() + cell_start_[near_cell], sorted_boids_.data() + cell_start_[near_cell + 1], 0 });
+			}
+		}
+	}
+}
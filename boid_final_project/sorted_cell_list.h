@@ -0,0 +1,35 @@
+#pragma once
+#include "boid.h"
+#include "neighbour_search.h"
+#include <vector>
+#include <algorithm>
+#include <math.h>
+
+/**
+ * \brief  Cell list that is rebuilt each step by counting sort of boid pointers into one contiguous array.
+ *		   Same cell geometry as SpatialGrid but an empty cell costs only an offset instead of a container.
+ */
+class SortedCellList : public NeighbourSearch
+{
+public:
+	SortedCellList(vector<Boid> &boids, float sight_range);
+	~SortedCellList() = default;
+
+	void UpdateNearCells(Boid &boid) override;
+	bool UpdateGrid(Boid &boid, vector<int> &update_tracker, int &size) override;
+	void UpdateGrid(Boid &boid, int old_pos, int new_pos) override;
+	void Rebuild() override;
+	int GetCellCount() const override;
+	void GatherCell(int cell, CellSpan &residents, vector<CellSpan> &neighbourhood) override;
+
+private:
+
+	int cell_num;
+	float cell_length;
+	vector<Boid> &boids_;
+	vector<Boid*> sorted_boids_; //Boid pointers ordered by cell index
+	vector<int> cell_start_;	 //Offset of the first boid of each cell in sorted_boids_, with a trailing end offset
+	vector<int> boid_cell_;		 //Cell index of each boid, reused between steps
+
+	int GetCellIndex(const Vector3f &position) const;
+};
@@ -9,12 +9,33 @@
 /**
  * \brief  Creates a grid for given simulation details and adds all boids to appropriate cells.
  * \param  boids | Boids to add to grid 
+ * \param  sight_range | Interaction cutoff, cells are at least this long
  */
-SpatialGrid::SpatialGrid(vector<Boid> &boids)
+template <int Dim>
+SpatialGridT<Dim>::SpatialGridT(vector<Boid> &boids, float sight_range)
 {
-	cell_num = floor(LENGTH / SIGHT_RANGE); // number & size of cells calculated off seeing distance so 27 adjacent will always contain all boids within range
+	cell_num = max(int(floor(LENGTH / sight_range)), 1); // number & size of cells calculated off seeing distance so 3^Dim adjacent will always contain all boids within range
+	fixed_point = !boids.empty() && boids.front().IsFixedPoint();
+	cell_shift = 32;
+
+	if (fixed_point)
+	{
+		//Rounds down to a power of two, cells only get longer so the stencil still covers the sight range.
+		//The simulation only runs fixed point with at least 4 cells per axis, so the stencil never wraps onto itself
+		while ((uint64_t(1) << (32 - cell_shift + 1)) <= uint64_t(cell_num))
+		{
+			cell_shift--;
+		}
+		cell_num = 1 << (32 - cell_shift);
+	}
 	cell_length = float(LENGTH) / float(cell_num);
-	grid.resize(cell_num*cell_num*cell_num);
+
+	int cell_count = 1;
+	for (int i = 0; i < Dim; i++)
+	{
+		cell_count *= cell_num;
+	}
+	grid.resize(cell_count);
 
 	for (Boid &boid : boids)
 	{
@@ -24,40 +45,46 @@ SpatialGrid::SpatialGrid(vector<Boid> &boids)
 
 
 /**
- * \brief  Updates the 27 cell buffer for a given boid.
+ * \brief  Updates the 3^Dim cell buffer for a given boid.
  *		   It can then query this for neighbours
  * \param  boid | The boid to update
  */
-void SpatialGrid::UpdateNearCells(Boid & boid)
+template <int Dim>
+void SpatialGridT<Dim>::UpdateNearCells(Boid & boid)
 {
 	vector<int> boid_grid_coord = boid.GetGridCoord();
-	int i = 0; 
+	float stencil_distances[Dim][3];
+	this->GetStencilDistances(boid.GetPosition(), boid_grid_coord.data(), cell_length, cell_num, stencil_distances);
+	boid.neighbouring_cells_buffer_.clear();
 
-	//Iterates over 27 cells adjacent to cell boid currently resides in.
-	for (int x = -1; x < 2; x++)
+	//Iterates over 3^Dim cells adjacent to cell boid currently resides in.
+	//The stencil index is read as Dim base 3 digits, last axis fastest, giving the x, y, z nesting order in 3D.
+	for (int stencil = 0; stencil < Boid::STENCIL_SIZE; stencil++)
 	{
-		for (int y = -1; y < 2; y++)
+		int row[Dim];
+		float distance_squared = 0;
+		bool duplicate = false;
+
+		for (int i = Dim - 1, digits = stencil; i >= 0; i--, digits /= 3)
+		{
+			int offset = digits % 3 - 1;
+			duplicate = duplicate || this->IsStencilDuplicate(offset, cell_num);
+			row[i] = boid_grid_coord[i] + offset;
+
+			//Imposes periodic boundary conditions.
+			row[i] = row[i] < cell_num ? row[i] : 0;
+			row[i] = row[i] > -1 ? row[i] : cell_num - 1;
+
+			distance_squared += stencil_distances[i][offset + 1];
+		}
+
+		if (duplicate)
 		{
-			for (int z = -1; z < 2; z++)
-			{
-				int row_x = boid_grid_coord[0] + x;
-				int row_y = boid_grid_coord[1] + y;
-				int row_z = boid_grid_coord[2] + z;
-
-
-				//Imposes periodic boundary conditions.
-				row_x = row_x < cell_num ? row_x : 0;
-				row_y = row_y < cell_num ? row_y : 0;
-				row_z = row_z < cell_num ? row_z : 0;
-
-				row_x = row_x > -1 ? row_x : cell_num - 1;
-				row_y = row_y > -1 ? row_y : cell_num - 1;
-				row_z = row_z > -1 ? row_z : cell_num - 1;
-								
-				boid.neighbouring_cells_buffer_[i] = &grid[GetGridVectorIndex(row_x, row_y, row_z)];
-				i++;
-			}
+			continue;
 		}
+
+		vector<Boid*> &cell = grid[GetGridVectorIndex(row)];
+		boid.neighbouring_cells_buffer_.push_back({ cell.data(), cell.data() + cell.size(), distance_squared });
 	}
 }
 
@@ -69,7 +96,8 @@ void SpatialGrid::UpdateNearCells(Boid & boid)
  * \param  size | Number of nodes of system to determine what routine to run.
  * \return  | Boolean indicating if the boid has moved grid cells
  */
-bool SpatialGrid::UpdateGrid(Boid & boid, vector<int>& update_tracker, int &size)
+template <int Dim>
+bool SpatialGridT<Dim>::UpdateGrid(Boid & boid, vector<int>& update_tracker, int &size)
 {
 	vector<int> old_grid_coord = boid.GetGridCoord();
 	vector<int> new_grid_coord = GetGridCoord(boid);
@@ -79,8 +107,7 @@ bool SpatialGrid::UpdateGrid(Boid & boid, vector<int>& update_tracker, int &size
 		int old_vector_index = GetGridVectorIndex(old_grid_coord);
 		int new_vector_index = GetGridVectorIndex(new_grid_coord);
 
-		grid[old_vector_index].remove(&boid);
-		grid[new_vector_index].push_back(&boid);
+		MoveBoid(boid, old_vector_index, new_vector_index);
 		
 		boid.SetGridCoord(new_grid_coord);
 		
@@ -114,49 +141,76 @@ bool SpatialGrid::UpdateGrid(Boid & boid, vector<int>& update_tracker, int &size
  * \param  old_vector_index | Vector index of the boids old cell. 
  * \param  new_vector_index | Vector index of the boids new cell
  */
-void SpatialGrid::UpdateGrid(Boid & boid, int old_vector_index, int new_vector_index)
+template <int Dim>
+void SpatialGridT<Dim>::UpdateGrid(Boid & boid, int old_vector_index, int new_vector_index)
 {
-	grid[old_vector_index].remove(&boid);
-	grid[new_vector_index].push_back(&boid);
+	MoveBoid(boid, old_vector_index, new_vector_index);
 
 	vector<int> boid_grid_coord = GetGridCoord(new_vector_index);
 	boid.SetGridCoord(boid_grid_coord);
 }
 
 /**
- * \brief  Turns 3D cell co-ordinates into a 1D index so the grid can be represented
+ * \brief  Grid is maintained incrementally through UpdateGrid so there is nothing to rebuild.
+ */
+template <int Dim>
+void SpatialGridT<Dim>::Rebuild()
+{
+}
+
+/**
+ * \brief  Turns Dim cell co-ordinates into a 1D index so the grid can be represented
  *		   by a 1D vector to guarantee contiguous memory and hence enable fast access.
- * \param  grid_index | (x,y,z) vector that gives cells 3D grid co-ordinates 
+ * \param  grid_index | Dim co-ordinates of the cell, (x,y,z) in 3D
  * \return  | 1D grid vector index of the cell
  */
-int SpatialGrid::GetGridVectorIndex(vector<int>& grid_index) const
+template <int Dim>
+int SpatialGridT<Dim>::GetGridVectorIndex(const int * grid_index) const
 {
-	return cell_num * cell_num*grid_index[0] + cell_num * grid_index[1] + grid_index[2];
+	int vector_index = 0;
+
+	for (int i = 0; i < Dim; i++)
+	{
+		vector_index = vector_index * cell_num + grid_index[i];
+	}
+
+	return vector_index;
 }
 
 /**
- * \brief  Turns 3D cell co-ordinates into a 1D index so the grid can be represented
+ * \brief  Turns Dim cell co-ordinates into a 1D index so the grid can be represented
  *		   by a 1D vector to guarantee contiguous memory and hence enable fast access.
- * \param  x | Cell x co-ordinate
- * \param  y | Cell y co-ordinate 
- * \param  z | Cell z co-ordinate 
+ * \param  grid_index | Vector that gives the cells grid co-ordinates
  * \return  | 1D grid vector index of the cell
  */
-int SpatialGrid::GetGridVectorIndex(int & x, int & y, int & z) const
+template <int Dim>
+int SpatialGridT<Dim>::GetGridVectorIndex(vector<int>& grid_index) const
 {
-	return x * cell_num*cell_num + y * cell_num + z;
+	return GetGridVectorIndex(grid_index.data());
 }
 
 /**
  * \brief  Uses a boids position to work out which grid cell it currently is in.
+ *		   A fixed point position is always inside the box, so its cell is a shift with nothing to clamp.
  * \param  boid | Boid to work out co-ordinates
  * \return  | Grid co-ordinates of boid
  */
-vector<int> SpatialGrid::GetGridCoord(Boid & boid) const
+template <int Dim>
+vector<int> SpatialGridT<Dim>::GetGridCoord(Boid & boid) const
 {
-	vector<int> grid_coord(SYS_DIM);
+	vector<int> grid_coord(Dim);
+
+	if (fixed_point)
+	{
+		const uint32_t *position = boid.GetFixedPosition();
+		for (int i = 0; i < Dim; i++)
+		{
+			grid_coord[i] = int(uint64_t(position[i]) >> cell_shift);
+		}
+		return grid_coord;
+	}
 	
-	for (int i = 0; i < SYS_DIM; i++)
+	for (int i = 0; i < Dim; i++)
 	{
 		grid_coord[i] = floor(boid.GetPosition()[i] / cell_length);
 
@@ -171,16 +225,22 @@ vector<int> SpatialGrid::GetGridCoord(Boid & boid) const
 }
 
 /**
- * \brief  Converts 1D grid vector index into corresponding 3D grid cell co-ordinates.
+ * \brief  Converts 1D grid vector index into corresponding Dim grid cell co-ordinates.
  * \param  vector_index | 1D Grid vector index to convert
  * \return  | Grid cell co-ordinates
  */
-vector<int> SpatialGrid::GetGridCoord(int & vector_index)
+template <int Dim>
+vector<int> SpatialGridT<Dim>::GetGridCoord(int & vector_index)
 {
-	vector<int> return_value(SYS_DIM);
-	return_value[0] = vector_index / (cell_num*cell_num);
-	return_value[1] = (vector_index - return_value[0] * cell_num*cell_num) / cell_num;
-	return_value[2] = vector_index - return_value[0] * cell_num*cell_num - return_value[1] * cell_num;
+	vector<int> return_value(Dim);
+	int remainder = vector_index;
+
+	for (int i = Dim - 1; i >= 0; i--)
+	{
+		return_value[i] = remainder % cell_num;
+		remainder /= cell_num;
+	}
+
 	return return_value;
 }
 
@@ -188,10 +248,72 @@ vector<int> SpatialGrid::GetGridCoord(int & vector_index)
  * \brief  Finds appropriate grid cell location of a boid and adds it to the grid.
  * \param  boid | Boid to add to the grid
  */
-void SpatialGrid::AddBoid(Boid & boid)
+template <int Dim>
+void SpatialGridT<Dim>::AddBoid(Boid & boid)
 {
 	vector<int> grid_coord = GetGridCoord(boid);
 	int grid_vector_index = GetGridVectorIndex(grid_coord);
 	grid[grid_vector_index].push_back(&boid);
 	boid.SetGridCoord(grid_coord);
 }
+
+/**
+ * \brief  Moves a boid pointer between two cells, preserving the order of the remaining boids in the old cell.
+ * \param  boid | Boid to move
+ * \param  old_vector_index | Vector index of the boids old cell
+ * \param  new_vector_index | Vector index of the boids new cell
+ */
+template <int Dim>
+void SpatialGridT<Dim>::MoveBoid(Boid & boid, int old_vector_index, int new_vector_index)
+{
+	vector<Boid*> &old_cell = grid[old_vector_index];
+	old_cell.erase(find(old_cell.begin(), old_cell.end(), &boid));
+	grid[new_vector_index].push_back(&boid);
+}
+
+/**
+ * \brief  Number of cells, for iterating over the grid cell by cell.
+ * \return  | Cell count
+ */
+template <int Dim>
+int SpatialGridT<Dim>::GetCellCount() const
+{
+	return grid.size();
+}
+
+/**
+ * \brief  Gives the boids resident in a cell and the 3^Dim cells surrounding it.
+ * \param  cell | 1D grid vector index of the cell
+ * \param  residents | Set to the boids in the cell
+ * \param  neighbourhood | Filled with the surrounding cells, including the cell itself
+ */
+template <int Dim>
+void SpatialGridT<Dim>::GatherCell(int cell, CellSpan & residents, vector<CellSpan>& neighbourhood)
+{
+	vector<int> grid_coord = GetGridCoord(cell);
+	residents = { grid[cell].data(), grid[cell].data() + grid[cell].size(), 0 };
+	neighbourhood.clear();
+
+	for (int stencil = 0; stencil < Boid::STENCIL_SIZE; stencil++)
+	{
+		int row[Dim];
+		bool duplicate = false;
+
+		for (int i = Dim - 1, digits = stencil; i >= 0; i--, digits /= 3)
+		{
+			duplicate = duplicate || this->IsStencilDuplicate(digits % 3 - 1, cell_num);
+			row[i] = (grid_coord[i] + digits % 3 - 1 + cell_num) % cell_num;
+		}
+
+		if (duplicate)
+		{
+			continue;
+		}
+
+		vector<Boid*> &near_cell = grid[GetGridVectorIndex(row)];
+		neighbourhood.push_back({ near_cell.data(), near_cell.data() + near_cell.size(), 0 });
+	}
+}
+
+template class SpatialGridT<2>;
+template class SpatialGridT<3>;
@@ -1,37 +1,51 @@
 #pragma once
 #include "boid.h"
+#include "neighbour_search.h"
 #include <vector>
-#include <list>
+#include <algorithm>
 #include <math.h>
 
 /**
  * \brief  Spatial data structure for keeping track of boids and quickly working out a given boids neighbours 
+ *		   Cells are indexed in row major order, last axis fastest, and the 3^Dim surrounding cells form the stencil.
+ *		   A fixed point flock gets a power of two cells per axis, so a boid's cell co-ordinates are the top bits of its position.
  */
-class SpatialGrid
+template <int Dim>
+class SpatialGridT : public NeighbourSearchT<Dim>
 {
 public:
-	SpatialGrid(vector<Boid> &boids);
-	~SpatialGrid() = default;
+	typedef BoidT<Dim> Boid;
+	typedef CellSpanT<Dim> CellSpan;
 
-	void UpdateNearCells(Boid &boid);
-	bool UpdateGrid(Boid &boid, vector<int> &update_tracker, int &size);
-	void UpdateGrid(Boid &boid, int old_pos, int new_pos);
+	SpatialGridT(vector<Boid> &boids, float sight_range);
+	~SpatialGridT() = default;
+
+	void UpdateNearCells(Boid &boid) override;
+	bool UpdateGrid(Boid &boid, vector<int> &update_tracker, int &size) override;
+	void UpdateGrid(Boid &boid, int old_pos, int new_pos) override;
+	void Rebuild() override;
+	int GetCellCount() const override;
+	void GatherCell(int cell, CellSpan &residents, vector<CellSpan> &neighbourhood) override;
 
 private:
 	
 	int cell_num;
 	float cell_length;
-	vector<list<Boid*>> grid; //Grid holds pointers to boids not boid itself to reduce memory and speed up access.
-							  //Each cell corresponds to doubly linked list for quick insertion/removal.
+	bool fixed_point;	//cells are found by shifting fixed point positions
+	int cell_shift;		//32 - log2(cell_num), bits below a fixed point cell index
+	vector<vector<Boid*>> grid; //Grid holds pointers to boids not boid itself to reduce memory and speed up access.
+								//Each cell is a contiguous array so boids can iterate over it as a CellSpan.
 
+	int GetGridVectorIndex(const int *grid_index) const;
 	int GetGridVectorIndex(vector<int> &grid_index) const;
-	int GetGridVectorIndex(int &x, int &y, int &z) const;
 
 	vector<int> GetGridCoord(Boid &boid) const;
 	vector<int> GetGridCoord(int &vector_index);
 
 	void AddBoid(Boid &boid);
+	void MoveBoid(Boid &boid, int old_vector_index, int new_vector_index);
 
 	
 };
 
+typedef SpatialGridT<SYS_DIM> SpatialGrid;
@@ -0,0 +1,139 @@
+#include "pch.h"
+#include "species.h"
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+
+/*! \file species.cpp
+	\brief Species tables for multi-species runs.
+*/
+
+using namespace std;
+using namespace Eigen;
+
+/**
+ * \brief  Reads the species of a run. Non empty lines not starting with # are either
+ *		   "species name count max_speed max_force sight_range cohesion alignment separation", in storage order, or
+ *		   "response observer target cohesion alignment separation" for how one species steers relative to another.
+ *		   Without a response line a species follows its own weights towards itself and only separates from other species.
+ *		   Counts are rescaled to boid_number if they do not add up to it.
+ * \param  file_name | Path of the species file
+ * \param  defaults | Parameters for anything not given per species (interaction rule, sqrt accuracy, obstacles)
+ * \param  boid_number | Total number of boids
+ * \return  | Species table, with no species if the file could not be read
+ */
+SpeciesTable ReadSpecies(const string &file_name, const BoidParameters &defaults, int boid_number)
+{
+	SpeciesTable table;
+	vector<int> counts;
+	vector<string> responses;
+	ifstream file(file_name);
+	string line;
+
+	while (getline(file, line))
+	{
+		istringstream values(line);
+		string kind, name;
+		int count;
+		BoidParameters parameters = defaults;
+
+		if (line.empty() || line[0] == '#' || !(values >> kind))
+		{
+			continue;
+		}
+
+		if (kind == "species" && values >> name >> count >> parameters.max_speed >> parameters.max_force >> parameters.sight_range
+			>> parameters.cohesion_factor >> parameters.alignment_factor >> parameters.separation_factor && count > 0)
+		{
+			table.names.push_back(name);
+			table.parameters.push_back(parameters);
+			counts.push_back(count);
+		}
+		else if (kind == "response")
+		{
+			responses.push_back(line); //species may be declared after their responses
+		}
+		else
+		{
+			printf("Skipping malformed species line: %s\n", line.c_str());
+		}
+	}
+
+	int species_number = table.Count();
+	table.response.resize(species_number * species_number);
+
+	for (int observer = 0; observer < species_number; observer++)
+	{
+		const BoidParameters &own = table.parameters[observer];
+		for (int target = 0; target < species_number; target++)
+		{
+			table.response[observer * species_number + target] = observer == target ?
+				Vector3f(own.cohesion_factor, own.alignment_factor, own.separation_factor) : Vector3f(0, 0, own.separation_factor);
+		}
+		table.max_sight_range = max(table.max_sight_range, own.sight_range);
+	}
+
+	for (const string &response : responses)
+	{
+		istringstream values(response);
+		string kind, observer, target;
+		Vector3f weights;
+		values >> kind >> observer >> target >> weights[0] >> weights[1] >> weights[2];
+
+		int a = find(table.names.begin(), table.names.end(), observer) - table.names.begin();
+		int b = find(table.names.begin(), table.names.end(), target) - table.names.begin();
+
+		if (values && a < species_number && b < species_number)
+		{
+			table.response[a * species_number + b] = weights;
+		}
+		else
+		{
+			printf("Skipping malformed species line: %s\n", response.c_str());
+		}
+	}
+
+	int total = 0;
+	for (int count : counts)
+	{
+		total += count;
+	}
+
+	if (total != boid_number && species_number > 0)
+	{
+		printf("Species counts add up to %d, rescaling to %d boids\n", total, boid_number);
+	}
+
+	//Cumulative rounding keeps the ranges contiguous and the last one ending at boid_number
+	int cumulative = 0;
+	table.first_boid.push_back(0);
+	for (int count : counts)
+	{
+		cumulative += count;
+		table.first_boid.push_back(int(double(cumulative) * boid_number / total));
+	}
+
+	return table;
+}
+
+/**
+ * \brief  Tags every boid with the species whose index range holds it. Call after any first touch reset of the boids.
+ * \param  boids | Boid vector
+ * \param  table | Species table
+ * \param  first | Index of the boid held at boids[0], for vectors holding only part of the flock
+ */
+template <int Dim>
+void AssignSpecies(vector<BoidT<Dim>> &boids, const SpeciesTable &table, int first)
+{
+	for (int species = 0; species < table.Count(); species++)
+	{
+		int start = max(table.first_boid[species], first), end = min(table.first_boid[species + 1], first + int(boids.size()));
+		for (int boid = start; boid < end; boid++)
+		{
+			boids[boid - first].SetSpecies(species);
+		}
+	}
+}
+
+template void AssignSpecies<2>(vector<BoidT<2>>&, const SpeciesTable&, int);
+template void AssignSpecies<3>(vector<BoidT<3>>&, const SpeciesTable&, int);
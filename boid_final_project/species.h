@@ -0,0 +1,43 @@
+#pragma once
+#include "pch.h"
+#include "preprocessor.h"
+#include "boid.h"
+#include "Eigen/Dense"
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cstdio>
+
+/**
+ * \brief  Species of a multi-species run. Boids of a species occupy one contiguous range of the boid vector, so a boids
+ *		   species is fixed by its index on every rank and never needs communicating.
+ *		   Each species has its own speed, force, sight range and behaviour weights, and a response to every other species.
+ */
+struct SpeciesTable
+{
+	vector<string> names;
+	vector<int> first_boid;				//boid index range of each species, count + 1 entries
+	vector<BoidParameters> parameters;	//speed, force, sight range and own weights of each species
+	vector<Vector3f> response;			//cohesion, alignment and separation weights of observer species a towards target b, at a * count + b
+	float max_sight_range = 0;			//largest sight range, sizes the neighbour search stencil
+
+	int Count() const
+	{
+		return names.size();
+	}
+
+	const Vector3f& Response(int observer, int target) const
+	{
+		return response[observer * Count() + target];
+	}
+
+	int SpeciesOf(int boid) const
+	{
+		return int(upper_bound(first_boid.begin(), first_boid.end(), boid) - first_boid.begin()) - 1;
+	}
+};
+
+SpeciesTable ReadSpecies(const string &file_name, const BoidParameters &defaults, int boid_number);
+
+template <int Dim>
+void AssignSpecies(vector<BoidT<Dim>> &boids, const SpeciesTable &table, int first = 0);
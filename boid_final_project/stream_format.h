@@ -0,0 +1,91 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/*! \file stream_format.h
+	\brief Layout of the live frame stream shared between the simulation and any reader.
+*/
+
+/**
+ * \brief  Identifies a live frame stream region.
+ */
+constexpr char STREAM_MAGIC[8] = "BOIDSTM";
+
+/**
+ * \brief  Version of the stream layout, bumped whenever the layout changes.
+ */
+constexpr int32_t STREAM_VERSION = 1;
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_INT_LOCK_FREE == 2, "Stream counters must be lock free to be shared between processes");
+
+/**
+ * \brief  Start of the shared memory region. The simulation is the only producer and a single reader at a time may consume.
+ *		   The producer fills slot write_index % slot_count and then advances write_index. An attached reader copies slot
+ *		   read_index % slot_count once write_index has passed it and then advances read_index. When a reader is attached and
+ *		   all slots hold frames it has not read, the producer drops the new frame and counts it rather than wait.
+ *		   A reader attaches by setting read_index to write_index and then setting reader_attached, and detaches by clearing it.
+ *		   Attaching always succeeds, so a reader that died while attached is replaced by the next one.
+ */
+struct StreamHeader
+{
+	char magic[8];						//STREAM_MAGIC
+	int32_t version;					//STREAM_VERSION
+	int32_t dimension;					//Spatial dimensions of each position
+	int32_t boid_number;				//Positions in each frame
+	int32_t slot_count;					//Frames the ring holds
+	int32_t slot_bytes;					//Bytes from the start of one slot to the next
+	int32_t interval;					//Steps between published frames
+	float length;						//Side length of the simulation area
+	int32_t reserved;
+	std::atomic<uint64_t> write_index;	//Frames published, written by the producer
+	std::atomic<uint64_t> read_index;	//Next frame the reader will copy, written by the reader
+	std::atomic<uint64_t> dropped;		//Frames dropped because the reader was a full ring behind, written by the producer
+	std::atomic<int32_t> reader_attached; //Non zero while a reader consumes the stream
+	std::atomic<int32_t> producer_alive;  //Cleared when the simulation finishes
+};
+
+/**
+ * \brief  Start of each slot, followed by boid_number * dimension floats. Also the start of each socket datagram.
+ */
+struct StreamFrameHeader
+{
+	int32_t step;			//Simulation step of the frame
+	int32_t boid_number;	//Positions that follow
+};
+
+/**
+ * \brief  Bytes from the start of one slot to the next, rounded up to a cache line so slots never share one.
+ * \param  dimension | Spatial dimensions
+ * \param  boid_number | Positions in each frame
+ * \return  | Slot stride in bytes
+ */
+inline size_t StreamSlotBytes(int dimension, int boid_number)
+{
+	size_t bytes = sizeof(StreamFrameHeader) + sizeof(float) * size_t(dimension) * boid_number;
+	return (bytes + 63) / 64 * 64;
+}
+
+/**
+ * \brief  Total size of the shared memory region.
+ * \param  dimension | Spatial dimensions
+ * \param  boid_number | Positions in each frame
+ * \param  slot_count | Frames the ring holds
+ * \return  | Region size in bytes
+ */
+inline size_t StreamRegionBytes(int dimension, int boid_number, int slot_count)
+{
+	return 64 * ((sizeof(StreamHeader) + 63) / 64) + StreamSlotBytes(dimension, boid_number) * slot_count;
+}
+
+/**
+ * \brief  Start of a slot within the region.
+ * \param  header | Start of the mapped region
+ * \param  slot | Slot index
+ * \return  | Pointer to the slot's frame header
+ */
+inline StreamFrameHeader* StreamSlot(StreamHeader *header, int slot)
+{
+	char *slots = reinterpret_cast<char*>(header) + 64 * ((sizeof(StreamHeader) + 63) / 64);
+	return reinterpret_cast<StreamFrameHeader*>(slots + size_t(slot) * header->slot_bytes);
+}
@@ -0,0 +1,197 @@
+#include "pch.h"
+#include "tiled_kernel.h"
+#include "species.h"
+#include "phase_profiler.h"
+
+/*! \file tiled_kernel.cpp
+	\brief Cell centric boid update that shares one gathered neighbourhood between all boids of a cell.
+*/
+
+/**
+ * \brief  Copies the positions and velocities of every boid in a neighbourhood into a tile.
+ *		   With more than one species the tile is counting sorted into one contiguous run per species.
+ *		   A fixed point tile holds fixed point positions, from which the kernel takes minimum image offsets by integer differences.
+ * \param  neighbourhood | Cells to gather
+ * \param  tile | Tile to fill, grown if needed and reused between cells
+ * \param  species_number | Number of species in the run
+ */
+template <int Dim>
+static void GatherTile(const vector<CellSpanT<Dim>> &neighbourhood, NeighbourTileT<Dim> &tile, int species_number)
+{
+	int size = 0;
+	for (const CellSpanT<Dim> &cell : neighbourhood)
+	{
+		size += cell.end - cell.begin;
+	}
+
+	if (tile.velocity[0].size() < size)
+	{
+		for (int i = 0; i < Dim; i++)
+		{
+			tile.position[i].resize(size);
+			tile.velocity[i].resize(size);
+			tile.fixed_position[i].resize(size);
+		}
+	}
+
+	//Counting sort by species: count each run, turn counts into run starts, then use the starts as fill cursors
+	vector<int> &offset = tile.species_offset;
+	offset.assign(species_number + 1, 0);
+
+	if (species_number > 1)
+	{
+		for (const CellSpanT<Dim> &cell : neighbourhood)
+		{
+			for (BoidT<Dim>* const* boid = cell.begin; boid != cell.end; boid++)
+			{
+				offset[(*boid)->GetSpecies() + 1]++;
+			}
+		}
+	}
+	else
+	{
+		offset[1] = size;
+	}
+
+	for (int species = 1; species <= species_number; species++)
+	{
+		offset[species] += offset[species - 1];
+	}
+
+	for (const CellSpanT<Dim> &cell : neighbourhood)
+	{
+		for (BoidT<Dim>* const* boid = cell.begin; boid != cell.end; boid++)
+		{
+			int j = offset[species_number > 1 ? (*boid)->GetSpecies() : 0]++;
+			typename BoidT<Dim>::VectorD position = (*boid)->GetPosition();
+			typename BoidT<Dim>::VectorD velocity = (*boid)->GetVelocity();
+			for (int i = 0; i < Dim; i++)
+			{
+				if (tile.fixed_point)
+				{
+					tile.fixed_position[i][j] = (*boid)->GetFixedPosition()[i];
+				}
+				else
+				{
+					tile.position[i][j] = position[i];
+				}
+				tile.velocity[i][j] = velocity[i];
+			}
+		}
+	}
+
+	//Cursors now sit at the end of their runs, shift them back to the starts
+	for (int species = species_number; species > 0; species--)
+	{
+		offset[species] = offset[species - 1];
+	}
+	offset[0] = 0;
+
+	tile.size = size;
+}
+
+/**
+ * \brief  Updates boids cell by cell: each cells neighbourhood is looked up and gathered into a contiguous tile once,
+ *		   then every resident boid streams over that tile. OpenMP schedules cells instead of boids.
+ *		   Under the topological rule the shared neighbourhood is handed to each resident for its k nearest search instead.
+ * \param  search | Neighbour search backend, must be up to date with boid positions
+ * \param  parameters | Behaviour parameters
+ * \param  first | First boid this node updates, residents outside [first, last) are read but not updated
+ * \param  last | One past the last boid this node updates
+ * \param  active | Optional flag per boid of [first, last), only flagged boids are updated
+ * \param  scheduler | Optional scheduler of the cell loop, guided when not given. A cell costs its updated residents times its tile size
+ */
+template <int Dim>
+void UpdateTiled(NeighbourSearchT<Dim> & search, const BoidParameters & parameters, BoidT<Dim> * first, BoidT<Dim> * last, const char *active, LoopScheduler *scheduler)
+{
+	int cell_number = search.GetCellCount();
+	int species_number = parameters.species ? parameters.species->Count() : 1;
+	LoopScheduler guided(ScheduleMode::Guided);
+	LoopScheduler &cells = scheduler ? *scheduler : guided;
+
+	#pragma omp parallel
+	{
+		NeighbourTileT<Dim> tile;
+		CellSpanT<Dim> residents;
+		vector<CellSpanT<Dim>> neighbourhood;
+		neighbourhood.reserve(BoidT<Dim>::STENCIL_SIZE);
+
+		PhaseProfiler *profiler = parameters.profiler;
+
+		cells.ForEach(0, cell_number, [&](int cell)
+		{
+			if (profiler)
+			{
+				profiler->Enter(ProfilePhase::CellSetup);
+			}
+
+			search.GatherCell(cell, residents, neighbourhood);
+
+			if (residents.begin == residents.end)
+			{
+				if (profiler)
+				{
+					profiler->Leave();
+				}
+				return 0;
+			}
+
+			int updated = 0;
+
+			if (parameters.interaction == InteractionRule::Topological)
+			{
+				for (BoidT<Dim>* const* boid = residents.begin; boid != residents.end; boid++)
+				{
+					if (*boid >= first && *boid < last && (!active || active[*boid - first]))
+					{
+						(*boid)->neighbouring_cells_buffer_ = neighbourhood;
+						(*boid)->Update(parameters);
+						updated++;
+					}
+				}
+				int candidates = 0;
+				for (const CellSpanT<Dim> &span : neighbourhood)
+				{
+					candidates += span.end - span.begin;
+				}
+				if (profiler)
+				{
+					profiler->CountUpdates(updated, (long long)updated * candidates);
+					profiler->Leave();
+				}
+				return updated * candidates;
+			}
+
+			if (profiler)
+			{
+				profiler->Enter(ProfilePhase::Gather);
+			}
+
+			tile.fixed_point = (*residents.begin)->IsFixedPoint();
+			GatherTile(neighbourhood, tile, species_number);
+
+			if (profiler)
+			{
+				profiler->Enter(ProfilePhase::Steering);
+			}
+
+			for (BoidT<Dim>* const* boid = residents.begin; boid != residents.end; boid++)
+			{
+				if (*boid >= first && *boid < last && (!active || active[*boid - first]))
+				{
+					(*boid)->UpdateFromTile(tile, parameters);
+					updated++;
+				}
+			}
+			if (profiler)
+			{
+				profiler->CountUpdates(updated, (long long)updated * tile.size);
+				profiler->Leave(); //before the closing barrier, so waiting threads are not charged
+			}
+			return updated * tile.size;
+		});
+	}
+}
+
+template void UpdateTiled<2>(NeighbourSearchT<2>&, const BoidParameters&, BoidT<2>*, BoidT<2>*, const char*, LoopScheduler*);
+template void UpdateTiled<3>(NeighbourSearchT<3>&, const BoidParameters&, BoidT<3>*, BoidT<3>*, const char*, LoopScheduler*);
@@ -0,0 +1,10 @@
+#pragma once
+#include "pch.h"
+#include "boid.h"
+#include "neighbour_search.h"
+#include "scheduler.h"
+#include "omp.h"
+#include <vector>
+
+template <int Dim>
+void UpdateTiled(NeighbourSearchT<Dim> &search, const BoidParameters &parameters, BoidT<Dim> *first, BoidT<Dim> *last, const char *active = nullptr, LoopScheduler *scheduler = nullptr);
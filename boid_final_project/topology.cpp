@@ -0,0 +1,200 @@
+#include "pch.h"
+#include "topology.h"
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+/*! \file topology.cpp
+	\brief NUMA topology detection, rank/thread pinning and parallel first touch of boid storage.
+*/
+
+/**
+ * \brief  Parses a Linux cpu list such as "0-3,8-11".
+ * \param  list | Cpu list string
+ * \return  | Cpu numbers in the list
+ */
+static vector<int> ParseCpuList(const string &list)
+{
+	vector<int> cpus;
+	stringstream stream(list);
+	string range;
+
+	while (getline(stream, range, ','))
+	{
+		size_t dash = range.find('-');
+		int first = stoi(range.substr(0, dash));
+		int last = dash == string::npos ? first : stoi(range.substr(dash + 1));
+
+		for (int cpu = first; cpu <= last; cpu++)
+		{
+			cpus.push_back(cpu);
+		}
+	}
+
+	return cpus;
+}
+
+/**
+ * \brief  Reads the NUMA domains and their cpus from sysfs, or on Windows from each node's processor mask, numbering cpus
+ *		   across processor groups as group * 64 + bit. Falls back to a single domain of THREAD_NUM cpus where neither is available.
+ * \return  | Detected topology, always at least one domain
+ */
+Topology DetectTopology()
+{
+	Topology topology;
+
+#ifdef _WIN32
+	ULONG highest_node = 0;
+	GetNumaHighestNodeNumber(&highest_node);
+
+	for (ULONG node = 0; node <= highest_node; node++)
+	{
+		GROUP_AFFINITY affinity = {};
+		vector<int> cpus;
+
+		if (GetNumaNodeProcessorMaskEx(USHORT(node), &affinity))
+		{
+			for (int bit = 0; bit < int(8 * sizeof(KAFFINITY)); bit++)
+			{
+				if (affinity.Mask >> bit & 1)
+				{
+					cpus.push_back(affinity.Group * int(8 * sizeof(KAFFINITY)) + bit);
+				}
+			}
+		}
+
+		if (!cpus.empty())
+		{
+			topology.domain_cpus.push_back(cpus);
+		}
+	}
+#else
+	for (int node = 0;; node++)
+	{
+		ifstream file("/sys/devices/system/node/node" + to_string(node) + "/cpulist");
+		string list;
+
+		if (!(file >> list))
+		{
+			break;
+		}
+
+		vector<int> cpus = ParseCpuList(list);
+		if (!cpus.empty())
+		{
+			topology.domain_cpus.push_back(cpus);
+		}
+	}
+#endif
+
+	if (topology.domain_cpus.empty())
+	{
+		vector<int> cpus(THREAD_NUM);
+		for (int cpu = 0; cpu < THREAD_NUM; cpu++)
+		{
+			cpus[cpu] = cpu;
+		}
+		topology.domain_cpus.push_back(cpus);
+	}
+
+	return topology;
+}
+
+/**
+ * \brief  Binds this rank to one NUMA domain and pins one OpenMP thread per cpu it owns.
+ *		   Ranks on a node are spread evenly over the domains (launch one rank per domain for best results)
+ *		   and ranks sharing a domain split its cpus. Sets the OpenMP thread count to the cpus owned.
+ *		   Threads are pinned on Linux and Windows only, elsewhere the placement is computed but not applied.
+ * \return  | Placement chosen for this rank
+ */
+Placement SetupPlacement(const Topology &topology)
+{
+	MPI_Comm node_comm;
+	int local_rank, local_size;
+	MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &node_comm);
+	MPI_Comm_rank(node_comm, &local_rank);
+	MPI_Comm_size(node_comm, &local_size);
+	MPI_Comm_free(&node_comm);
+
+	Placement placement;
+	placement.domain_number = topology.domain_cpus.size();
+	placement.ranks_on_node = local_size;
+	placement.domain = local_rank * placement.domain_number / local_size;
+
+	//Ranks sharing this domain and this ranks position among them
+	int first_sharer = (placement.domain * local_size + placement.domain_number - 1) / placement.domain_number;
+	int last_sharer = ((placement.domain + 1) * local_size + placement.domain_number - 1) / placement.domain_number;
+	int sharers = max(last_sharer - first_sharer, 1);
+	int position = local_rank - first_sharer;
+
+	const vector<int> &domain_cpus = topology.domain_cpus[placement.domain];
+	int per_rank = max(int(domain_cpus.size()) / sharers, 1);
+
+	for (int cpu = position * per_rank; cpu < (position + 1) * per_rank && cpu < domain_cpus.size(); cpu++)
+	{
+		placement.cpus.push_back(domain_cpus[cpu]);
+	}
+	if (placement.cpus.empty())
+	{
+		placement.cpus.push_back(domain_cpus[position % domain_cpus.size()]);
+	}
+
+	placement.thread_number = placement.cpus.size();
+	omp_set_num_threads(placement.thread_number);
+
+#if defined(__linux__)
+	#pragma omp parallel
+	{
+		cpu_set_t cpu_set;
+		CPU_ZERO(&cpu_set);
+		CPU_SET(placement.cpus[omp_get_thread_num()], &cpu_set);
+		sched_setaffinity(0, sizeof(cpu_set), &cpu_set); // 0 is the calling thread
+	}
+	placement.pinned = true;
+#elif defined(_WIN32)
+	#pragma omp parallel
+	{
+		//Group aware form of SetThreadAffinityMask, so cpus past the first 64 can be reached
+		int cpu = placement.cpus[omp_get_thread_num()];
+		GROUP_AFFINITY affinity = {};
+		affinity.Group = WORD(cpu / int(8 * sizeof(KAFFINITY)));
+		affinity.Mask = KAFFINITY(1) << cpu % int(8 * sizeof(KAFFINITY));
+		SetThreadGroupAffinity(GetCurrentThread(), &affinity, nullptr);
+	}
+	placement.pinned = true;
+#else
+	placement.pinned = false;
+#endif
+
+	return placement;
+}
+
+/**
+ * \brief  Reconstructs a rank's boids from its thread team with the compute loops schedule, so each boids
+ *		   neighbour buffers are allocated and first touched on the NUMA domain of the thread that updates it.
+ *		   Positions and velocities are reset, call before initialising or receiving boid state.
+ * \param  boids | Boid vector
+ * \param  start | First boid index the rank updates
+ * \param  end | One past the last boid index the rank updates
+ */
+template <int Dim>
+void FirstTouchBoids(vector<BoidT<Dim>>& boids, int start, int end)
+{
+	#pragma omp parallel for schedule(SCHEDULE)
+	for (int boid = start; boid < end; boid++)
+	{
+		boids[boid] = BoidT<Dim>();
+	}
+}
+
+template void FirstTouchBoids<2>(vector<BoidT<2>>&, int, int);
+template void FirstTouchBoids<3>(vector<BoidT<3>>&, int, int);
@@ -0,0 +1,36 @@
+#pragma once
+#include "pch.h"
+#include "preprocessor.h"
+#include "boid.h"
+#include "omp.h"
+#include <mpi.h>
+#include <vector>
+#include <string>
+
+/**
+ * \brief  NUMA layout of the node the process runs on.
+ */
+struct Topology
+{
+	vector<vector<int>> domain_cpus; //Logical cpus of each NUMA domain
+};
+
+/**
+ * \brief  Where this rank and its threads were placed.
+ */
+struct Placement
+{
+	int domain;			//NUMA domain the rank is bound to
+	int domain_number;	//NUMA domains on the node
+	int ranks_on_node;	//MPI ranks sharing the node
+	int thread_number;	//OpenMP threads the rank runs
+	vector<int> cpus;	//Cpu each thread is pinned to, indexed by thread number
+	bool pinned;		//Threads were pinned, false where the platform has no affinity call
+};
+
+Topology DetectTopology();
+
+Placement SetupPlacement(const Topology &topology);
+
+template <int Dim>
+void FirstTouchBoids(vector<BoidT<Dim>> &boids, int start, int end);
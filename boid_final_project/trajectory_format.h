@@ -0,0 +1,23 @@
+#pragma once
+#include <cstdint>
+
+/**
+ * \brief  Header at the start of a binary trajectory file, shared by the simulation and the trajectory analyzer.
+ *		   It is followed by steps frames, each holding boid_number * dimension floats of boid positions in boid order,
+ *		   so a reader can map the file and index any frame directly.
+ */
+struct TrajectoryHeader
+{
+	char magic[8];		 //TRAJECTORY_MAGIC
+	int32_t version;	 //TRAJECTORY_VERSION
+	int32_t dimension;	 //Floats per position
+	int32_t boid_number; //Boids per frame
+	int32_t steps;		 //Number of frames
+	float length;		 //Side length of the periodic simulation area
+	int32_t first_boid;	 //Simulation index of the first boid in the file, non zero for a worker ranks share
+};
+
+static_assert(sizeof(TrajectoryHeader) == 32, "Trajectory header must have the same layout for every compiler");
+
+constexpr char TRAJECTORY_MAGIC[8] = "BOIDTRJ";
+constexpr int32_t TRAJECTORY_VERSION = 1;
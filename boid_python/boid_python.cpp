@@ -0,0 +1,166 @@
+#include "pch.h"
+#include "python_flock.h"
+#include <cstdlib>
+
+/*! \file boid_python.cpp
+	\brief C interface of the boid engine, loaded by boids.py through ctypes. ctypes releases the GIL for every call,
+		   so Python threads keep running while boid_step advances the flock.
+*/
+
+#ifdef _WIN32
+#define BOID_API extern "C" __declspec(dllexport)
+#else
+#define BOID_API extern "C" __attribute__((visibility("default")))
+#endif
+
+using namespace std;
+
+/**
+ * \brief  Initialises MPI for the engine, which times its steps with it, unless the host process already has. The process
+ *		   then runs as a single rank of its own, and MPI is finalised when it exits.
+ */
+static void InitialiseMpi()
+{
+	int initialised;
+	MPI_Initialized(&initialised);
+	if (!initialised)
+	{
+		MPI_Init(nullptr, nullptr);
+		atexit([] { MPI_Finalize(); });
+	}
+}
+
+/**
+ * \brief  Creates a flock.
+ * \param  dimension | 2 or 3
+ * \param  boid_number | Number of boids, at least 1
+ * \param  seed | Seed of the initial conditions
+ * \param  scenario | uniform, box, clusters or flocks
+ * \param  search | grid, cells, kdtree or hashed, grid only in 2D
+ * \param  tiled | Non zero to update cell by cell with the tiled kernel
+ * \return  | Flock handle, null if an argument is not valid
+ */
+BOID_API PythonFlock* boid_create(int dimension, int boid_number, unsigned long long seed, const char *scenario, const char *search, int tiled)
+{
+	Scenario start;
+	SearchBackend backend;
+
+	if (boid_number < 1 || !ParseScenario(scenario, start) || !ParseSearchBackend(search, backend) || (dimension == 2 && backend != SearchBackend::Grid))
+	{
+		return nullptr;
+	}
+
+	InitialiseMpi();
+	if (dimension == 2)
+	{
+		return new PythonFlockT<2>(boid_number, seed, start, backend, tiled != 0);
+	}
+	if (dimension == 3)
+	{
+		return new PythonFlockT<3>(boid_number, seed, start, backend, tiled != 0);
+	}
+	return nullptr;
+}
+
+/**
+ * \brief  Frees a flock. Views of its state must not be used afterwards.
+ * \param  flock | Flock handle
+ */
+BOID_API void boid_destroy(PythonFlock *flock)
+{
+	delete flock;
+}
+
+/**
+ * \brief  Advances the flock.
+ * \param  flock | Flock handle
+ * \param  steps | Number of steps
+ */
+BOID_API void boid_step(PythonFlock *flock, int steps)
+{
+	flock->Step(steps);
+}
+
+/**
+ * \brief  Sets a behaviour parameter.
+ * \param  flock | Flock handle
+ * \param  name | cohesion, alignment, separation, sight_range, max_speed, max_force or avoidance
+ * \param  value | New value
+ * \return  | 0 if the name is not recognised
+ */
+BOID_API int boid_set_parameter(PythonFlock *flock, const char *name, float value)
+{
+	return flock->SetParameter(name, value);
+}
+
+/**
+ * \brief  Sets a named option.
+ * \param  flock | Flock handle
+ * \param  name | neighbours, fast_math or schedule
+ * \param  value | Option value, as on the command line
+ * \return  | 0 if the name or value is not recognised
+ */
+BOID_API int boid_set_option(PythonFlock *flock, const char *name, const char *value)
+{
+	return flock->SetOption(name, value);
+}
+
+/**
+ * \brief  Address of the first boids position.
+ * \param  flock | Flock handle
+ * \return  | Pointer to dimension floats, valid until the flock is destroyed
+ */
+BOID_API const float* boid_positions(PythonFlock *flock)
+{
+	return flock->GetPositions();
+}
+
+/**
+ * \brief  Address of the first boids velocity.
+ * \param  flock | Flock handle
+ * \return  | Pointer to dimension floats, valid until the flock is destroyed
+ */
+BOID_API const float* boid_velocities(PythonFlock *flock)
+{
+	return flock->GetVelocities();
+}
+
+/**
+ * \brief  Bytes between the state of consecutive boids.
+ * \param  flock | Flock handle
+ * \return  | Stride in bytes
+ */
+BOID_API long long boid_stride(PythonFlock *flock)
+{
+	return flock->GetStride();
+}
+
+/**
+ * \brief  Number of spatial dimensions.
+ * \param  flock | Flock handle
+ * \return  | 2 or 3
+ */
+BOID_API int boid_dimension(PythonFlock *flock)
+{
+	return flock->GetDimension();
+}
+
+/**
+ * \brief  Number of boids.
+ * \param  flock | Flock handle
+ * \return  | Boid count
+ */
+BOID_API int boid_number(PythonFlock *flock)
+{
+	return flock->GetBoidNumber();
+}
+
+/**
+ * \brief  Steps run so far.
+ * \param  flock | Flock handle
+ * \return  | Step count
+ */
+BOID_API int boid_steps(PythonFlock *flock)
+{
+	return flock->GetSteps();
+}
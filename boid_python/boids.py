@@ -0,0 +1,123 @@
+"""Python bindings of the boid engine.
+
+Loads boid_python.dll (libboid_python.so elsewhere) from this directory, or from the path in BOID_LIBRARY.
+ctypes releases the GIL while the engine steps, and positions and velocities are NumPy views of the engine's
+boid vector, so nothing is copied or written to file.
+
+    flock = Flock(boid_number=100000, scenario="clusters", seed=1)
+    flock.configure(cohesion=0.02, neighbours="topological")
+    flock.step(100)
+    centre = flock.positions.mean(axis=0)
+"""
+import ctypes
+import os
+import sys
+import weakref
+
+import numpy as np
+
+
+def _load_library():
+    name = "boid_python.dll" if sys.platform == "win32" else "libboid_python.so"
+    path = os.environ.get("BOID_LIBRARY", os.path.join(os.path.dirname(os.path.abspath(__file__)), name))
+    library = ctypes.CDLL(path)
+
+    handle = ctypes.c_void_p
+    library.boid_create.restype = handle
+    library.boid_create.argtypes = [ctypes.c_int, ctypes.c_int, ctypes.c_ulonglong, ctypes.c_char_p, ctypes.c_char_p, ctypes.c_int]
+    library.boid_destroy.argtypes = [handle]
+    library.boid_step.argtypes = [handle, ctypes.c_int]
+    library.boid_set_parameter.restype = ctypes.c_int
+    library.boid_set_parameter.argtypes = [handle, ctypes.c_char_p, ctypes.c_float]
+    library.boid_set_option.restype = ctypes.c_int
+    library.boid_set_option.argtypes = [handle, ctypes.c_char_p, ctypes.c_char_p]
+    for function in (library.boid_positions, library.boid_velocities):
+        function.restype = ctypes.c_void_p
+        function.argtypes = [handle]
+    library.boid_stride.restype = ctypes.c_longlong
+    for function in (library.boid_stride, library.boid_dimension, library.boid_number, library.boid_steps):
+        function.argtypes = [handle]
+    return library
+
+
+_library = _load_library()
+
+PARAMETERS = ("cohesion", "alignment", "separation", "sight_range", "max_speed", "max_force", "avoidance")
+OPTIONS = ("neighbours", "fast_math", "schedule")
+
+
+class Flock:
+    """A flock stepped in process by the engine's single node step, on as many OpenMP threads as OMP_NUM_THREADS allows."""
+
+    def __init__(self, boid_number=2000, dimension=3, seed=None, scenario="box", search="grid", tiled=False):
+        if seed is None:
+            seed = int.from_bytes(os.urandom(8), "little")
+        self.seed = seed
+        self._views = []  # weak references to the views handed out, alive for as long as any array derived from them
+        self._handle = _library.boid_create(dimension, boid_number, seed, scenario.encode(), search.encode(), int(tiled))
+        if not self._handle:
+            raise ValueError(f"Cannot create a {dimension}D flock of {boid_number} boids with scenario {scenario} and search {search}")
+
+    def step(self, steps=1):
+        """Advances the flock, with the GIL released."""
+        _library.boid_step(self._open(), steps)
+
+    def configure(self, **settings):
+        """Sets behaviour parameters (cohesion, alignment, separation, sight_range, max_speed, max_force, avoidance)
+        and options (neighbours, fast_math, schedule, with the command line values)."""
+        for name, value in settings.items():
+            if name in PARAMETERS:
+                accepted = _library.boid_set_parameter(self._open(), name.encode(), value)
+            else:
+                accepted = _library.boid_set_option(self._open(), name.encode(), str(value).encode())
+            if not accepted:
+                raise ValueError(f"Unknown setting {name}={value}")
+
+    @property
+    def positions(self):
+        """Read only (boid_number, dimension) view of the positions, updated in place by step."""
+        return self._view(_library.boid_positions(self._open()))
+
+    @property
+    def velocities(self):
+        """Read only (boid_number, dimension) view of the velocities, updated in place by step."""
+        return self._view(_library.boid_velocities(self._open()))
+
+    @property
+    def dimension(self):
+        return _library.boid_dimension(self._open())
+
+    @property
+    def boid_number(self):
+        return _library.boid_number(self._open())
+
+    @property
+    def steps(self):
+        return _library.boid_steps(self._open())
+
+    def _open(self):
+        if not self._handle:
+            raise ValueError("The flock is closed")
+        return self._handle
+
+    def _view(self, address):
+        stride = _library.boid_stride(self._open())
+        number, dimension = self.boid_number, self.dimension
+        memory = (ctypes.c_char * (stride * (number - 1) + 4 * dimension)).from_address(address)
+        memory._flock = self  # the view keeps the flock, and so the engine's memory, alive
+        view = np.ndarray((number, dimension), dtype=np.float32, buffer=memory, strides=(stride, 4))
+        view.flags.writeable = False
+        self._views = [reference for reference in self._views if reference() is not None] + [weakref.ref(view)]
+        return view
+
+    def close(self):
+        """Frees the engine's memory. Refused while a view of it, or an array derived from one, is still alive."""
+        alive = sum(reference() is not None for reference in self._views)
+        if alive:
+            raise RuntimeError(f"Cannot close the flock while {alive} positions or velocities views are alive, delete them or copy them first")
+        if self._handle:
+            _library.boid_destroy(self._handle)
+            self._handle = None
+
+    def __del__(self):
+        self.close()
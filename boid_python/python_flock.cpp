@@ -0,0 +1,200 @@
+#include "pch.h"
+#include "python_flock.h"
+
+/*! \file python_flock.cpp
+	\brief Single node simulation behind the Python bindings.
+*/
+
+using namespace std;
+using namespace Eigen;
+
+/**
+ * \brief  Sets up the options shared by both dimensions: a single node run of the engine that saves no paths.
+ * \param  boid_number | Number of boids
+ * \param  seed | Seed of the initial conditions
+ * \param  scenario | Initial conditions
+ * \param  search | Neighbour search backend
+ * \param  tiled | Update cell by cell with the tiled kernel
+ */
+PythonFlock::PythonFlock(int boid_number, uint64_t seed, Scenario scenario, SearchBackend search, bool tiled)
+{
+	options_.boid_number = boid_number;
+	options_.seed = seed;
+	options_.seeded = true;
+	options_.scenario = scenario;
+	options_.search = search;
+	options_.tiled = tiled;
+	options_.save = SaveFormat::None;
+}
+
+/**
+ * \brief  Sets one behaviour parameter, taking effect from the next step.
+ * \param  name | cohesion, alignment, separation, sight_range, max_speed, max_force or avoidance
+ * \param  value | New value
+ * \return  | False if the name is not recognised
+ */
+bool PythonFlock::SetParameter(const string &name, float value)
+{
+	if (name == "cohesion")
+	{
+		options_.parameters.cohesion_factor = value;
+	}
+	else if (name == "alignment")
+	{
+		options_.parameters.alignment_factor = value;
+	}
+	else if (name == "separation")
+	{
+		options_.parameters.separation_factor = value;
+	}
+	else if (name == "sight_range")
+	{
+		options_.parameters.sight_range = value; //the simulation rebuilds its search structure
+	}
+	else if (name == "max_speed")
+	{
+		options_.parameters.max_speed = value;
+	}
+	else if (name == "max_force")
+	{
+		options_.parameters.max_force = value;
+	}
+	else if (name == "avoidance")
+	{
+		options_.parameters.avoidance_factor = value;
+	}
+	else
+	{
+		return false;
+	}
+
+	changed_ = true;
+	return true;
+}
+
+/**
+ * \brief  Sets one named option, taking effect from the next step.
+ * \param  name | neighbours, fast_math or schedule, as the command line options
+ * \param  value | Option value, as on the command line
+ * \return  | False if the name or value is not recognised
+ */
+bool PythonFlock::SetOption(const string &name, const string &value)
+{
+	if (name == "neighbours" && (value == "metric" || value == "topological"))
+	{
+		options_.parameters.interaction = value == "metric" ? InteractionRule::Metric : InteractionRule::Topological;
+		changed_ = true;
+	}
+	else if (name == "fast_math" && ParseSqrtAccuracy(value, options_.parameters.accuracy))
+	{
+		changed_ = true;
+	}
+	else if (name == "schedule" && ParseScheduleMode(value, options_.schedule))
+	{
+		changed_ = true;
+	}
+	else
+	{
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * \brief  Generates the flock and builds its neighbour search structure.
+ * \param  boid_number | Number of boids
+ * \param  seed | Seed of the initial conditions
+ * \param  scenario | Initial conditions
+ * \param  search | Neighbour search backend
+ * \param  tiled | Update cell by cell with the tiled kernel
+ */
+template <int Dim>
+PythonFlockT<Dim>::PythonFlockT(int boid_number, uint64_t seed, Scenario scenario, SearchBackend search, bool tiled)
+	: PythonFlock(boid_number, seed, scenario, search, tiled), simulation_(options_)
+{
+}
+
+/**
+ * \brief  Runs steps of the engine, first handing it any parameters or options set since the last call.
+ *		   Called from Python without the GIL, so the caller may analyse other data meanwhile.
+ * \param  steps | Number of steps
+ */
+template <int Dim>
+void PythonFlockT<Dim>::Step(int steps)
+{
+	if (changed_)
+	{
+		simulation_.SetParameters(options_.parameters);
+		if (options_.schedule != simulation_.GetOptions().schedule)
+		{
+			simulation_.SetSchedule(options_.schedule);
+		}
+		changed_ = false;
+	}
+
+	simulation_.Run(steps);
+}
+
+/**
+ * \brief  Address of the first boids position, the next boid's is GetStride bytes on.
+ * \return  | Pointer to Dim floats
+ */
+template <int Dim>
+const float* PythonFlockT<Dim>::GetPositions() const
+{
+	return simulation_.GetPositions();
+}
+
+/**
+ * \brief  Address of the first boids velocity, the next boid's is GetStride bytes on.
+ * \return  | Pointer to Dim floats
+ */
+template <int Dim>
+const float* PythonFlockT<Dim>::GetVelocities() const
+{
+	return simulation_.GetVelocities();
+}
+
+/**
+ * \brief  Bytes between consecutive boids.
+ * \return  | Stride in bytes
+ */
+template <int Dim>
+long long PythonFlockT<Dim>::GetStride() const
+{
+	return simulation_.GetStride();
+}
+
+/**
+ * \brief  Number of spatial dimensions.
+ * \return  | 2 or 3
+ */
+template <int Dim>
+int PythonFlockT<Dim>::GetDimension() const
+{
+	return Dim;
+}
+
+/**
+ * \brief  Number of boids.
+ * \return  | Boid count
+ */
+template <int Dim>
+int PythonFlockT<Dim>::GetBoidNumber() const
+{
+	return simulation_.GetOptions().boid_number;
+}
+
+/**
+ * \brief  Steps run since the flock was created.
+ * \return  | Step count
+ */
+template <int Dim>
+int PythonFlockT<Dim>::GetSteps() const
+{
+	return simulation_.GetSteps();
+}
+
+template class PythonFlockT<2>;
+template class PythonFlockT<3>;
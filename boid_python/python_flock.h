@@ -0,0 +1,60 @@
+#pragma once
+#include "pch.h"
+#include "../boid_final_project/preprocessor.h"
+#include "../boid_final_project/options.h"
+#include "../boid_final_project/simulation.h"
+#include <string>
+
+/**
+ * \brief  In process flock driven from Python. It runs the engine's single node step without a path buffer, and the engine
+ *		   keeps the boids in one vector that never reallocates, so Python can view positions and velocities in place, striding
+ *		   over the boids. The dimension is chosen at run time, the simulation lives in PythonFlockT.
+ */
+class PythonFlock
+{
+public:
+
+	virtual ~PythonFlock() = default;
+
+	virtual void Step(int steps) = 0;
+	virtual const float* GetPositions() const = 0;
+	virtual const float* GetVelocities() const = 0;
+	virtual long long GetStride() const = 0;
+	virtual int GetDimension() const = 0;
+	virtual int GetBoidNumber() const = 0;
+
+	bool SetParameter(const string &name, float value);
+	bool SetOption(const string &name, const string &value);
+	virtual int GetSteps() const = 0;
+
+protected:
+
+	PythonFlock(int boid_number, uint64_t seed, Scenario scenario, SearchBackend search, bool tiled);
+
+	SimulationOptions options_;	//Options of the next step
+	bool changed_ = false;		//Parameters or schedule changed, handed to the simulation before the next step
+};
+
+/**
+ * \brief  Flock state of one dimension.
+ */
+template <int Dim>
+class PythonFlockT : public PythonFlock
+{
+public:
+	typedef BoidT<Dim> Boid;
+
+	PythonFlockT(int boid_number, uint64_t seed, Scenario scenario, SearchBackend search, bool tiled);
+
+	void Step(int steps) override;
+	const float* GetPositions() const override;
+	const float* GetVelocities() const override;
+	long long GetStride() const override;
+	int GetDimension() const override;
+	int GetBoidNumber() const override;
+	int GetSteps() const override;
+
+private:
+
+	Simulation<Dim> simulation_;
+};
@@ -13,6 +13,7 @@ from statistics import median, mean
 
 head_length =7
 posistions =[]
+distances = []
 file_val = True
 
 
@@ -30,9 +31,14 @@ if __name__ == "__main__":
     else:
         
         file = open("test.txt") if file_val else open(argv[1])
-        [next(file) for i in range(head_length)]
+        trace = next(file).startswith("Boid Simulation Separation Trace") # in situ trace from --analytics, already holds the distances
+        [next(file) for i in range(3 if trace else head_length - 1)]
         
         for line in tqdm(file):
+
+            if trace:
+                distances.append(array([float(value) for value in line.split()[1:]]))
+                continue
         
             pos_vector_string = line.split('$')[:-1]
             boid_posistions = []
@@ -55,7 +61,6 @@ if __name__ == "__main__":
      
 
     boid = 100 
-    distances = []
     for ind,boid_step in tqdm(enumerate(posistions)):
         chosen_boid = boid_step[boid]
         dist_arr = array([distance(chosen_boid,boid) for boid in boid_step if not all(boid==chosen_boid)])
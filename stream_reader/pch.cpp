@@ -0,0 +1,5 @@
+// pch.cpp: source file corresponding to pre-compiled header; necessary for compilation to succeed
+// Artifact of developing in Visual Studio
+#include "pch.h"
+
+
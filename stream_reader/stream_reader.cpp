@@ -0,0 +1,303 @@
+#include "pch.h"
+#include "../boid_final_project/stream_format.h"
+#include "../boid_final_project/preprocessor.h"
+
+#include <vector>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+/*! \file stream_reader.cpp
+	\brief Reference reader for the live frame stream. Attaches to a running simulation, prints the flock centre of every
+		   frame it receives and reports how many frames it saw and how many the simulation dropped.
+*/
+
+using namespace std;
+
+static volatile sig_atomic_t stop_requested = 0;
+
+/**
+ * \brief  Stops the read loop on Ctrl+C so the reader detaches cleanly.
+ */
+static void RequestStop(int)
+{
+	stop_requested = 1;
+}
+
+/**
+ * \brief  Frames seen by the reader.
+ */
+struct ReadStatistics
+{
+	int frames = 0;
+	int first_step = -1;
+	int last_step = -1;
+	int step_gaps = 0;	//Frames missing between consecutive received steps
+};
+
+/**
+ * \brief  Prints one frame and adds it to the statistics.
+ * \param  frame | Frame header, followed by the positions
+ * \param  dimension | Spatial dimensions of each position
+ * \param  interval | Steps between published frames, 0 if unknown
+ * \param  statistics | Statistics to update
+ */
+static void ProcessFrame(const StreamFrameHeader *frame, int dimension, int interval, ReadStatistics &statistics)
+{
+	const float *positions = reinterpret_cast<const float*>(frame + 1);
+	double centre[3] = { 0, 0, 0 };
+
+	for (int boid = 0; boid < frame->boid_number; boid++)
+	{
+		for (int i = 0; i < dimension; i++)
+		{
+			centre[i] += positions[boid * dimension + i];
+		}
+	}
+
+	printf("step %6d centre", frame->step);
+	for (int i = 0; i < dimension; i++)
+	{
+		printf(" %9.3f", centre[i] / frame->boid_number);
+	}
+	printf("\n");
+
+	if (statistics.last_step >= 0 && interval > 0)
+	{
+		statistics.step_gaps += (frame->step - statistics.last_step) / interval - 1;
+	}
+	if (statistics.first_step < 0)
+	{
+		statistics.first_step = frame->step;
+	}
+	statistics.last_step = frame->step;
+	statistics.frames++;
+}
+
+/**
+ * \brief  Maps the shared memory region of a running simulation, waiting for one to start.
+ * \return  | Start of the region, null if interrupted
+ */
+static StreamHeader* MapRegion()
+{
+	bool waiting = false;
+
+	while (!stop_requested)
+	{
+#ifdef _WIN32
+		HANDLE mapping = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, STREAM_NAME);
+		if (mapping != NULL)
+		{
+			void *region = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0); //the view keeps the mapping alive
+			CloseHandle(mapping);
+			if (region)
+			{
+				return static_cast<StreamHeader*>(region);
+			}
+		}
+#else
+		int descriptor = shm_open(STREAM_NAME, O_RDWR, 0);
+		struct stat status;
+		if (descriptor >= 0 && fstat(descriptor, &status) == 0 && status.st_size >= sizeof(StreamHeader))
+		{
+			void *region = mmap(nullptr, status.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+			close(descriptor);
+			if (region != MAP_FAILED)
+			{
+				return static_cast<StreamHeader*>(region);
+			}
+		}
+		else if (descriptor >= 0)
+		{
+			close(descriptor);
+		}
+#endif
+		if (!waiting)
+		{
+			printf("Waiting for a simulation to stream to %s\n", STREAM_NAME);
+			waiting = true;
+		}
+		this_thread::sleep_for(chrono::milliseconds(100));
+	}
+
+	return nullptr;
+}
+
+/**
+ * \brief  Consumes frames from the shared memory ring until the simulation finishes or the reader is stopped.
+ *		   Sleeping delay milliseconds per frame simulates a slow consumer, which makes the simulation drop frames.
+ * \param  max_frames | Stop after this many frames, 0 for no limit
+ * \param  delay | Milliseconds to sleep after each frame
+ * \return  | Exit code
+ */
+static int ReadSharedMemory(int max_frames, int delay)
+{
+	StreamHeader *header = MapRegion();
+	if (!header)
+	{
+		return 1;
+	}
+
+	if (memcmp(header->magic, STREAM_MAGIC, sizeof(header->magic)) != 0 || header->version != STREAM_VERSION)
+	{
+		printf("%s is not a version %d boid stream\n", STREAM_NAME, STREAM_VERSION);
+		return 1;
+	}
+
+	//Start at the next frame to be published, announcing the index before attaching
+	header->read_index.store(header->write_index.load(memory_order_acquire), memory_order_release);
+	header->reader_attached.store(1, memory_order_release);
+	uint64_t dropped_at_attach = header->dropped.load(memory_order_relaxed);
+
+	printf("Attached: %d boids in %dD, a frame every %d steps, %d slots\n", header->boid_number, header->dimension, header->interval, header->slot_count);
+
+	ReadStatistics statistics;
+	vector<char> frame(header->slot_bytes);
+
+	while (!stop_requested && (max_frames == 0 || statistics.frames < max_frames))
+	{
+		uint64_t read_index = header->read_index.load(memory_order_relaxed);
+
+		if (read_index < header->write_index.load(memory_order_acquire))
+		{
+			memcpy(frame.data(), StreamSlot(header, read_index % header->slot_count), header->slot_bytes);
+			header->read_index.store(read_index + 1, memory_order_release); //slot may now be overwritten
+
+			ProcessFrame(reinterpret_cast<StreamFrameHeader*>(frame.data()), header->dimension, header->interval, statistics);
+			this_thread::sleep_for(chrono::milliseconds(delay));
+		}
+		else if (header->producer_alive.load(memory_order_acquire) == 0)
+		{
+			break;
+		}
+		else
+		{
+			this_thread::sleep_for(chrono::microseconds(200));
+		}
+	}
+
+	header->reader_attached.store(0, memory_order_release);
+	uint64_t dropped = header->dropped.load(memory_order_relaxed) - dropped_at_attach;
+
+	printf("Received %d frames, steps %d to %d, %d missing, %llu dropped by the simulation while attached\n",
+		statistics.frames, statistics.first_step, statistics.last_step, statistics.step_gaps, (unsigned long long)dropped);
+
+	return 0;
+}
+
+/**
+ * \brief  Binds the local socket and consumes frames sent to it until none arrive for two seconds or the reader is stopped.
+ * \param  path | Socket path given to the simulation with --stream-socket
+ * \param  max_frames | Stop after this many frames, 0 for no limit
+ * \param  delay | Milliseconds to sleep after each frame
+ * \return  | Exit code
+ */
+static int ReadSocket(const string &path, int max_frames, int delay)
+{
+#ifdef _WIN32
+	printf("Socket streaming is not available on Windows\n");
+	return 1;
+#else
+	sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	int descriptor = socket(AF_UNIX, SOCK_DGRAM, 0);
+
+	if (descriptor < 0 || path.size() >= sizeof(address.sun_path))
+	{
+		printf("Could not open a socket at %s\n", path.c_str());
+		return 1;
+	}
+
+	strcpy(address.sun_path, path.c_str());
+	unlink(path.c_str());
+	if (bind(descriptor, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+	{
+		printf("Could not bind %s\n", path.c_str());
+		close(descriptor);
+		return 1;
+	}
+
+	timeval timeout = { 2, 0 };
+	setsockopt(descriptor, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	printf("Listening on %s\n", path.c_str());
+
+	ReadStatistics statistics;
+	vector<char> frame(1 << 24);
+
+	while (!stop_requested && (max_frames == 0 || statistics.frames < max_frames))
+	{
+		ssize_t received = recv(descriptor, frame.data(), frame.size(), 0);
+		if (received < ssize_t(sizeof(StreamFrameHeader)))
+		{
+			if (statistics.frames > 0)
+			{
+				break;
+			}
+			continue;
+		}
+
+		const StreamFrameHeader *header = reinterpret_cast<const StreamFrameHeader*>(frame.data());
+		int dimension = (received - sizeof(StreamFrameHeader)) / (sizeof(float) * max(header->boid_number, 1));
+		ProcessFrame(header, dimension, 0, statistics);
+		this_thread::sleep_for(chrono::milliseconds(delay));
+	}
+
+	close(descriptor);
+	unlink(path.c_str());
+
+	printf("Received %d frames, steps %d to %d\n", statistics.frames, statistics.first_step, statistics.last_step);
+
+	return 0;
+#endif
+}
+
+int main(int argc, char* argv[])
+{
+	string socket_path;
+	int max_frames = 0;
+	int delay = 0;
+
+	for (int i = 1; i < argc; i++)
+	{
+		string argument = argv[i];
+
+		if (argument == "--socket" && i + 1 < argc)
+		{
+			socket_path = argv[++i];
+		}
+		else if (argument == "--frames" && i + 1 < argc)
+		{
+			max_frames = max(atoi(argv[++i]), 0);
+		}
+		else if (argument == "--delay" && i + 1 < argc)
+		{
+			delay = max(atoi(argv[++i]), 0);
+		}
+		else
+		{
+			printf("Usage %s [--socket PATH] [--frames N] [--delay MS]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	signal(SIGINT, RequestStop);
+
+	return socket_path.empty() ? ReadSharedMemory(max_frames, delay) : ReadSocket(socket_path, max_frames, delay);
+}
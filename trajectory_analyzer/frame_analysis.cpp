@@ -0,0 +1,253 @@
+#include "pch.h"
+#include "frame_analysis.h"
+#include <algorithm>
+#include <cmath>
+
+/*! \file frame_analysis.cpp
+	\brief Separation traces and pair correlation computed frame by frame in parallel over a mapped trajectory.
+*/
+
+/**
+ * \brief  Squared distance between two positions in the periodic simulation area, using the nearest image on every axis.
+ * \param  a | First position
+ * \param  b | Second position
+ * \param  length | Side length of the simulation area
+ * \return  | Squared minimum image distance
+ */
+template <int Dim>
+float MinimumImageDistanceSq(const float * a, const float * b, float length)
+{
+	float distance_sq = 0;
+
+	for (int i = 0; i < Dim; i++)
+	{
+		float difference = fabs(a[i] - b[i]);
+		difference = min(difference, length - difference);
+		distance_sq += difference * difference;
+	}
+
+	return distance_sq;
+}
+
+/**
+ * \brief  Sizes the cell list for a frame of boids.
+ *		   Fewer than three cells per axis would make neighbouring cells repeat, so such areas use a single cell.
+ * \param  length | Side length of the simulation area
+ * \param  max_radius | Largest separation that must be found
+ * \param  boid_number | Boids per frame
+ */
+template <int Dim>
+PeriodicCellList<Dim>::PeriodicCellList(float length, float max_radius, int boid_number)
+{
+	length_ = length;
+	max_radius_ = max_radius;
+	cell_num_ = int(floor(length / max_radius));
+	cell_num_ = cell_num_ < 3 ? 1 : cell_num_;
+	cell_length_ = length / cell_num_;
+
+	int cell_count = 1;
+	for (int i = 0; i < Dim; i++)
+	{
+		cell_count *= cell_num_;
+	}
+
+	cell_start_.resize(cell_count + 1);
+	sorted_.resize(boid_number);
+	cell_of_.resize(boid_number);
+}
+
+/**
+ * \brief  Sorts the boids of a frame into cells.
+ * \param  positions | Frame positions, boid_number * Dim floats
+ */
+template <int Dim>
+void PeriodicCellList<Dim>::Build(const float * positions)
+{
+	int boid_number = sorted_.size();
+	fill(cell_start_.begin(), cell_start_.end(), 0);
+
+	for (int boid = 0; boid < boid_number; boid++)
+	{
+		cell_of_[boid] = GetCell(positions + boid * Dim);
+		cell_start_[cell_of_[boid] + 1]++;
+	}
+
+	for (int cell = 1; cell < cell_start_.size(); cell++)
+	{
+		cell_start_[cell] += cell_start_[cell - 1];
+	}
+
+	vector<int> next(cell_start_.begin(), cell_start_.end() - 1);
+	for (int boid = 0; boid < boid_number; boid++)
+	{
+		sorted_[next[cell_of_[boid]]++] = boid;
+	}
+}
+
+/**
+ * \brief  Counts every pair of boids closer than max_radius into separation bins. Each pair is counted once.
+ * \param  positions | Frame positions the list was built from
+ * \param  bin_width | Width of a separation bin
+ * \param  bins | Number of bins
+ * \param  counts | Bin counts to add to
+ */
+template <int Dim>
+void PeriodicCellList<Dim>::HistogramPairs(const float * positions, float bin_width, int bins, double * counts) const
+{
+	const int stencil_size = cell_num_ == 1 ? 1 : (Dim == 2 ? 9 : 27);
+	float max_radius_sq = max_radius_ * max_radius_;
+	int boid_number = sorted_.size();
+
+	for (int boid = 0; boid < boid_number; boid++)
+	{
+		const float *position = positions + boid * Dim;
+		int coord[Dim];
+
+		for (int i = Dim - 1, cell = cell_of_[boid]; i >= 0; i--, cell /= cell_num_)
+		{
+			coord[i] = cell % cell_num_;
+		}
+
+		for (int stencil = 0; stencil < stencil_size; stencil++)
+		{
+			int near_coord[Dim];
+			int near_cell = 0;
+
+			//stencil index read as Dim base 3 digits, last axis fastest, wrapped periodically
+			for (int i = Dim - 1, digits = stencil; i >= 0; i--, digits /= 3)
+			{
+				near_coord[i] = (coord[i] + digits % 3 - 1 + cell_num_) % cell_num_;
+			}
+			for (int i = 0; i < Dim; i++)
+			{
+				near_cell = near_cell * cell_num_ + near_coord[i];
+			}
+
+			for (int index = cell_start_[near_cell]; index < cell_start_[near_cell + 1]; index++)
+			{
+				int other = sorted_[index];
+				if (other <= boid)
+				{
+					continue;
+				}
+
+				float distance_sq = MinimumImageDistanceSq<Dim>(position, positions + other * Dim, length_);
+				if (distance_sq < max_radius_sq)
+				{
+					counts[min(int(sqrt(distance_sq) / bin_width), bins - 1)]++;
+				}
+			}
+		}
+	}
+}
+
+/**
+ * \brief  Cell containing a position, clamped so positions exactly on the far edge fall in the last cell.
+ * \param  position | Position to locate
+ * \return  | Row major cell index, last axis fastest
+ */
+template <int Dim>
+int PeriodicCellList<Dim>::GetCell(const float * position) const
+{
+	int cell = 0;
+
+	for (int i = 0; i < Dim; i++)
+	{
+		int coord = min(max(int(position[i] / cell_length_), 0), cell_num_ - 1);
+		cell = cell * cell_num_ + coord;
+	}
+
+	return cell;
+}
+
+/**
+ * \brief  Minimum image distance from the traced boid to every boid, for every analysed frame.
+ *		   This is the per step distance list correlation.py builds in Python. Frames are processed in parallel.
+ * \param  trajectory | Mapped trajectory
+ * \param  settings | Traced boid (index within the file) and frame stride
+ * \return  | Row per analysed frame, column per boid, the traced boids own column is 0
+ */
+template <int Dim>
+vector<float> SeparationTraces(const MappedTrajectory & trajectory, const AnalysisSettings & settings)
+{
+	const TrajectoryHeader &header = trajectory.GetHeader();
+	int boid_number = header.boid_number;
+	int frames = (header.steps + settings.stride - 1) / settings.stride;
+	vector<float> traces(size_t(frames) * boid_number);
+
+	#pragma omp parallel for schedule(static)
+	for (int frame = 0; frame < frames; frame++)
+	{
+		const float *positions = trajectory.GetFrame(frame * settings.stride);
+		const float *traced = positions + settings.traced_boid * Dim;
+		float *row = &traces[size_t(frame) * boid_number];
+
+		for (int boid = 0; boid < boid_number; boid++)
+		{
+			row[boid] = sqrt(MinimumImageDistanceSq<Dim>(traced, positions + boid * Dim, header.length));
+		}
+	}
+
+	return traces;
+}
+
+/**
+ * \brief  Radial pair correlation function g(r) averaged over the analysed frames, using minimum image distances
+ *		   in the periodic area. Each thread keeps its own cell list and bin counts, merged once its frames are done.
+ * \param  trajectory | Mapped trajectory
+ * \param  settings | Largest radius, bin count and frame stride
+ * \return  | g(r) per bin, 1 for an ideal gas of the same density
+ */
+template <int Dim>
+vector<double> PairCorrelation(const MappedTrajectory & trajectory, const AnalysisSettings & settings)
+{
+	const TrajectoryHeader &header = trajectory.GetHeader();
+	int boid_number = header.boid_number;
+	int frames = (header.steps + settings.stride - 1) / settings.stride;
+	int bins = settings.bins;
+	float bin_width = settings.max_radius / bins;
+	vector<double> counts(bins, 0.0);
+
+	#pragma omp parallel
+	{
+		PeriodicCellList<Dim> cell_list(header.length, settings.max_radius, boid_number);
+		vector<double> thread_counts(bins, 0.0);
+
+		#pragma omp for schedule(dynamic) nowait
+		for (int frame = 0; frame < frames; frame++)
+		{
+			const float *positions = trajectory.GetFrame(frame * settings.stride);
+			cell_list.Build(positions);
+			cell_list.HistogramPairs(positions, bin_width, bins, thread_counts.data());
+		}
+
+		#pragma omp critical
+		for (int bin = 0; bin < bins; bin++)
+		{
+			counts[bin] += thread_counts[bin];
+		}
+	}
+
+	//Normalise by the pairs an ideal gas of the same density would place in each shell
+	const double pi = 3.14159265358979323846;
+	double volume = pow(double(header.length), Dim);
+	double pairs = 0.5 * boid_number * (boid_number - 1.0);
+	vector<double> g(bins);
+
+	for (int bin = 0; bin < bins; bin++)
+	{
+		double inner = bin * bin_width, outer = (bin + 1) * bin_width;
+		double shell_volume = Dim == 2 ? pi * (outer * outer - inner * inner) : 4.0 / 3.0 * pi * (pow(outer, 3) - pow(inner, 3));
+		double ideal = frames * pairs * shell_volume / volume;
+		g[bin] = ideal > 0 ? counts[bin] / ideal : 0;
+	}
+
+	return g;
+}
+
+template class PeriodicCellList<2>;
+template class PeriodicCellList<3>;
+template vector<float> SeparationTraces<2>(const MappedTrajectory&, const AnalysisSettings&);
+template vector<float> SeparationTraces<3>(const MappedTrajectory&, const AnalysisSettings&);
+template vector<double> PairCorrelation<2>(const MappedTrajectory&, const AnalysisSettings&);
+template vector<double> PairCorrelation<3>(const MappedTrajectory&, const AnalysisSettings&);
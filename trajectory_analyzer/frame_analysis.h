@@ -0,0 +1,53 @@
+#pragma once
+#include "pch.h"
+#include "mapped_trajectory.h"
+#include "omp.h"
+#include <vector>
+
+using namespace std;
+
+/**
+ * \brief  Settings of an offline analysis run.
+ */
+struct AnalysisSettings
+{
+	int traced_boid = 100;	 //!< Boid whose separation from every other boid is traced, as in correlation.py
+	int stride = 1;			 //!< Analyse every stride-th frame
+	float max_radius = 100;	 //!< Largest pair separation binned in g(r)
+	int bins = 100;			 //!< Number of g(r) bins
+};
+
+/**
+ * \brief  Periodic cell list over one frame, rebuilt per frame by counting sort.
+ *		   Cells are at least max_radius long so every pair within max_radius lies in neighbouring cells.
+ */
+template <int Dim>
+class PeriodicCellList
+{
+public:
+	PeriodicCellList(float length, float max_radius, int boid_number);
+
+	void Build(const float *positions);
+	void HistogramPairs(const float *positions, float bin_width, int bins, double *counts) const;
+
+private:
+
+	float length_;
+	float max_radius_;
+	int cell_num_;
+	float cell_length_;
+	vector<int> cell_start_; //offset of each cell in sorted_, plus one past the end
+	vector<int> sorted_;	 //boid indexes ordered by cell
+	vector<int> cell_of_;	 //cell of each boid
+
+	int GetCell(const float *position) const;
+};
+
+template <int Dim>
+float MinimumImageDistanceSq(const float *a, const float *b, float length);
+
+template <int Dim>
+vector<float> SeparationTraces(const MappedTrajectory &trajectory, const AnalysisSettings &settings);
+
+template <int Dim>
+vector<double> PairCorrelation(const MappedTrajectory &trajectory, const AnalysisSettings &settings);
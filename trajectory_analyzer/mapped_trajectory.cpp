@@ -0,0 +1,140 @@
+#include "pch.h"
+#include "mapped_trajectory.h"
+#include <cstdio>
+#include <cstring>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/*! \file mapped_trajectory.cpp
+	\brief Memory mapping and validation of binary trajectory files.
+*/
+
+/**
+ * \brief  Unmaps the file.
+ */
+MappedTrajectory::~MappedTrajectory()
+{
+	Close();
+}
+
+/**
+ * \brief  Maps a trajectory file and checks its header against the file size.
+ * \param  path | Path of the .bin file
+ * \return  | Boolean indicating if the file was mapped and is a valid trajectory
+ */
+bool MappedTrajectory::Open(const string & path)
+{
+	Close();
+
+#ifdef _WIN32
+	file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, nullptr);
+	LARGE_INTEGER file_size;
+	if (file_ == INVALID_HANDLE_VALUE || !GetFileSizeEx(file_, &file_size))
+	{
+		printf("Could not open %s\n", path.c_str());
+		return false;
+	}
+	size_ = size_t(file_size.QuadPart);
+
+	mapping_ = size_ > 0 ? CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+	data_ = mapping_ ? static_cast<const char*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+#else
+	file_ = open(path.c_str(), O_RDONLY);
+	struct stat file_status;
+	if (file_ < 0 || fstat(file_, &file_status) != 0)
+	{
+		printf("Could not open %s\n", path.c_str());
+		return false;
+	}
+	size_ = size_t(file_status.st_size);
+
+	void *mapping = size_ > 0 ? mmap(nullptr, size_, PROT_READ, MAP_SHARED, file_, 0) : MAP_FAILED;
+	data_ = mapping == MAP_FAILED ? nullptr : static_cast<const char*>(mapping);
+#endif
+
+	if (!data_ || size_ < sizeof(TrajectoryHeader))
+	{
+		printf("Could not map %s\n", path.c_str());
+		Close();
+		return false;
+	}
+
+	const TrajectoryHeader &header = GetHeader();
+	if (memcmp(header.magic, TRAJECTORY_MAGIC, sizeof(header.magic)) != 0 || header.version != TRAJECTORY_VERSION)
+	{
+		printf("%s is not a version %d boid trajectory\n", path.c_str(), TRAJECTORY_VERSION);
+		Close();
+		return false;
+	}
+
+	size_t expected_size = sizeof(TrajectoryHeader) + sizeof(float) * size_t(header.steps) * header.boid_number * header.dimension;
+	if (header.dimension < 2 || header.dimension > 3 || size_ < expected_size)
+	{
+		printf("%s is truncated or has an unsupported dimension\n", path.c_str());
+		Close();
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * \brief  Header of the mapped file. Only valid after a successful Open.
+ * \return  | Trajectory header
+ */
+const TrajectoryHeader & MappedTrajectory::GetHeader() const
+{
+	return *reinterpret_cast<const TrajectoryHeader*>(data_);
+}
+
+/**
+ * \brief  Positions of every boid at a step, boid_number * dimension floats in boid order.
+ * \param  step | Frame index
+ * \return  | Pointer into the mapping
+ */
+const float * MappedTrajectory::GetFrame(int step) const
+{
+	const TrajectoryHeader &header = GetHeader();
+	size_t frame_floats = size_t(header.boid_number) * header.dimension;
+	return reinterpret_cast<const float*>(data_ + sizeof(TrajectoryHeader)) + step * frame_floats;
+}
+
+/**
+ * \brief  Releases the mapping and file handle if open.
+ */
+void MappedTrajectory::Close()
+{
+#ifdef _WIN32
+	if (data_)
+	{
+		UnmapViewOfFile(data_);
+	}
+	if (mapping_)
+	{
+		CloseHandle(mapping_);
+	}
+	if (file_ != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(file_);
+	}
+	mapping_ = nullptr;
+	file_ = INVALID_HANDLE_VALUE;
+#else
+	if (data_)
+	{
+		munmap(const_cast<char*>(data_), size_);
+	}
+	if (file_ >= 0)
+	{
+		close(file_);
+	}
+	file_ = -1;
+#endif
+	data_ = nullptr;
+	size_ = 0;
+}
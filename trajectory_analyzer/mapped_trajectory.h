@@ -0,0 +1,46 @@
+#pragma once
+#include "pch.h"
+#include "../boid_final_project/trajectory_format.h"
+#include <string>
+#include <cstddef>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+using namespace std;
+
+/**
+ * \brief  Read only memory mapping of a binary trajectory file written by the simulation with --save binary.
+ *		   Frames are handed out as pointers into the mapping, so the operating system pages them in on demand
+ *		   and concurrent threads can read different frames without any parsing or copying.
+ */
+class MappedTrajectory
+{
+public:
+	MappedTrajectory() = default;
+	~MappedTrajectory();
+
+	MappedTrajectory(const MappedTrajectory &) = delete;
+	MappedTrajectory &operator=(const MappedTrajectory &) = delete;
+
+	bool Open(const string &path);
+
+	const TrajectoryHeader &GetHeader() const;
+	const float *GetFrame(int step) const;
+
+private:
+
+	const char *data_ = nullptr;
+	size_t size_ = 0;
+
+#ifdef _WIN32
+	HANDLE file_ = INVALID_HANDLE_VALUE;
+	HANDLE mapping_ = nullptr;
+#else
+	int file_ = -1;
+#endif
+
+	void Close();
+};
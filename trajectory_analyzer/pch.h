@@ -0,0 +1,6 @@
+
+#ifndef PCH_H
+#define PCH_H
+
+
+#endif //PCH_H
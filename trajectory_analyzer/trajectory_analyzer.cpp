@@ -0,0 +1,229 @@
+#include "pch.h"
+#include "mapped_trajectory.h"
+#include "frame_analysis.h"
+#include "omp.h"
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <algorithm>
+#include <numeric>
+#include <cstdio>
+#include <cstdlib>
+
+/*! \file trajectory_analyzer.cpp
+	\brief Entry point of the offline trajectory analyzer: separation statistics and g(r) from a binary trajectory, written as CSV.
+*/
+
+using namespace std;
+
+/**
+ * \brief  Writes the separation of the traced boid from its nearest and furthest boids (ranked by mean separation
+ *		   over the run, as correlation.py plots them) along with the mean and median separation at each frame.
+ * \param  name | Output file name
+ * \param  traces | Separation traces from SeparationTraces
+ * \param  header | Trajectory header
+ * \param  settings | Analysis settings
+ * \param  shown | How many nearest and how many furthest boids to write
+ */
+void WriteSeparation(const string &name, vector<float> &traces, const TrajectoryHeader &header, const AnalysisSettings &settings, int shown)
+{
+	int boid_number = header.boid_number;
+	int frames = traces.size() / boid_number;
+	int traced = settings.traced_boid;
+	vector<double> mean_separation(boid_number, 0.0);
+	vector<float> frame_mean(frames), frame_median(frames);
+
+	#pragma omp parallel
+	{
+		vector<float> others;
+
+		#pragma omp for schedule(static)
+		for (int frame = 0; frame < frames; frame++)
+		{
+			const float *row = &traces[size_t(frame) * boid_number];
+			others.assign(row, row + boid_number);
+			others.erase(others.begin() + traced);
+
+			frame_mean[frame] = accumulate(others.begin(), others.end(), 0.0) / others.size();
+			nth_element(others.begin(), others.begin() + others.size() / 2, others.end());
+			frame_median[frame] = others[others.size() / 2];
+		}
+
+		#pragma omp for schedule(static)
+		for (int boid = 0; boid < boid_number; boid++)
+		{
+			for (int frame = 0; frame < frames; frame++)
+			{
+				mean_separation[boid] += traces[size_t(frame) * boid_number + boid];
+			}
+		}
+	}
+
+	vector<int> order;
+	for (int boid = 0; boid < boid_number; boid++)
+	{
+		if (boid != traced)
+		{
+			order.push_back(boid);
+		}
+	}
+	sort(order.begin(), order.end(), [&](int a, int b) { return mean_separation[a] < mean_separation[b]; });
+
+	shown = min(shown, int(order.size()) / 2);
+	vector<int> columns(order.begin(), order.begin() + shown);
+	columns.insert(columns.end(), order.end() - shown, order.end());
+
+	ofstream file(name);
+	file << "step,mean,median";
+	for (int column = 0; column < columns.size(); column++)
+	{
+		file << (column < shown ? ",nearest_" : ",furthest_") << header.first_boid + columns[column];
+	}
+	file << "\n";
+
+	for (int frame = 0; frame < frames; frame++)
+	{
+		file << frame * settings.stride << "," << frame_mean[frame] << "," << frame_median[frame];
+		for (int boid : columns)
+		{
+			file << "," << traces[size_t(frame) * boid_number + boid];
+		}
+		file << "\n";
+	}
+}
+
+/**
+ * \brief  Writes g(r) with the centre of each bin.
+ * \param  name | Output file name
+ * \param  g | Pair correlation per bin
+ * \param  settings | Analysis settings
+ */
+void WritePairCorrelation(const string &name, vector<double> &g, const AnalysisSettings &settings)
+{
+	float bin_width = settings.max_radius / settings.bins;
+
+	ofstream file(name);
+	file << "r,g\n";
+	for (int bin = 0; bin < g.size(); bin++)
+	{
+		file << (bin + 0.5f) * bin_width << "," << g[bin] << "\n";
+	}
+}
+
+/**
+ * \brief  Runs both analyses on a mapped trajectory and writes their CSV files.
+ * \param  trajectory | Mapped trajectory
+ * \param  settings | Analysis settings
+ * \param  shown | Nearest and furthest boids to write separation columns for
+ * \param  output | Prefix of the CSV file names
+ */
+template <int Dim>
+void Analyse(const MappedTrajectory &trajectory, const AnalysisSettings &settings, int shown, const string &output)
+{
+	const TrajectoryHeader &header = trajectory.GetHeader();
+
+	double start_time = omp_get_wtime();
+	vector<float> traces = SeparationTraces<Dim>(trajectory, settings);
+	WriteSeparation(output + "-separation.csv", traces, header, settings, shown);
+	double separation_time = omp_get_wtime() - start_time;
+
+	start_time = omp_get_wtime();
+	vector<double> g = PairCorrelation<Dim>(trajectory, settings);
+	WritePairCorrelation(output + "-gr.csv", g, settings);
+	double correlation_time = omp_get_wtime() - start_time;
+
+	int frames = (header.steps + settings.stride - 1) / settings.stride;
+
+	printf("*******Analysis Completed*******\n");
+	printf(" --------------------------------\n");
+	printf("|  Number of Boids   |%10d|\n", header.boid_number);
+	printf(" --------------------------------\n");
+	printf("|  Frames Analysed   |%10d|\n", frames);
+	printf(" --------------------------------\n");
+	printf("|     Dimensions     |%10d|\n", Dim);
+	printf(" --------------------------------\n");
+	printf("|Number of Processors|%10d|\n", omp_get_max_threads());
+	printf(" --------------------------------\n");
+	printf("| Separation time/s  |%10f|\n", separation_time);
+	printf(" --------------------------------\n");
+	printf("|    g(r) time/s     |%10f|\n", correlation_time);
+	printf(" --------------------------------\n");
+	printf("|    Frames/s        |%10.1f|\n", frames / (separation_time + correlation_time));
+	printf(" --------------------------------\n");
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 2)
+	{
+		printf("Usage %s FILE.bin [--boid B] [--nearest N] [--rmax R] [--bins K] [--stride S] [--out PREFIX]\n", argv[0]);
+		return 1;
+	}
+
+	string input = argv[1];
+	string output = input.substr(0, input.rfind(".bin"));
+	AnalysisSettings settings;
+	int traced_boid = settings.traced_boid;
+	int shown = 4;
+
+	for (int i = 2; i < argc; i++)
+	{
+		string argument = argv[i];
+
+		if (argument == "--boid" && i + 1 < argc)
+		{
+			traced_boid = atoi(argv[++i]);
+		}
+		else if (argument == "--nearest" && i + 1 < argc)
+		{
+			shown = max(atoi(argv[++i]), 0);
+		}
+		else if (argument == "--rmax" && i + 1 < argc)
+		{
+			settings.max_radius = max(float(atof(argv[++i])), 1e-3f);
+		}
+		else if (argument == "--bins" && i + 1 < argc)
+		{
+			settings.bins = max(atoi(argv[++i]), 1);
+		}
+		else if (argument == "--stride" && i + 1 < argc)
+		{
+			settings.stride = max(atoi(argv[++i]), 1);
+		}
+		else if (argument == "--out" && i + 1 < argc)
+		{
+			output = argv[++i];
+		}
+		else
+		{
+			printf("Ignoring unrecognised argument %s\n", argv[i]);
+		}
+	}
+
+	MappedTrajectory trajectory;
+	if (!trajectory.Open(input))
+	{
+		return 1;
+	}
+
+	const TrajectoryHeader &header = trajectory.GetHeader();
+	settings.traced_boid = traced_boid - header.first_boid;
+
+	if (settings.traced_boid < 0 || settings.traced_boid >= header.boid_number || header.steps < 1)
+	{
+		printf("Boid %d is not in %s, which holds boids %d to %d\n", traced_boid, input.c_str(), header.first_boid, header.first_boid + header.boid_number - 1);
+		return 1;
+	}
+
+	if (header.dimension == 2)
+	{
+		Analyse<2>(trajectory, settings, shown, output);
+	}
+	else
+	{
+		Analyse<3>(trajectory, settings, shown, output);
+	}
+
+	return 0;
+}